@@ -65,6 +65,7 @@
 #include "pub_core_tooliface.h"
 #include "pub_core_translate.h"     // For VG_(translate)
 #include "pub_core_trampoline.h"
+#include "pub_core_transcache.h"
 #include "pub_core_transtab.h"
 #include "pub_core_inner.h"
 #if defined(ENABLE_INNER_CLIENT_REQUEST)
@@ -165,6 +166,8 @@ static void usage_NORETURN ( Bool debug_help )
 "                              checks for self-modifying code: none, only for\n"
 "                              code found in stacks, for all code, or for all\n"
 "                              code except that from file-backed mappings\n"
+"    --persistent-tc=<dir>     keep translations of code from files in <dir>\n"
+"                              and reuse them in later runs [none]\n"
 "    --read-inline-info=yes|no read debug info about inlined function calls\n"
 "                              and use it to do better stack traces.  [yes]\n"
 "                              on Linux/Android/Solaris for Memcheck/Helgrind/DRD\n"
@@ -195,6 +198,10 @@ static void usage_NORETURN ( Bool debug_help )
 "           more sectors may increase performance, but use more memory.\n"
 "    --avg-transtab-entry-size=<number> avg size in bytes of a translated\n"
 "           basic block [0, meaning use tool provided default]\n"
+"    --fast-cache-bits=<number> log2 of the size of each way of the fast\n"
+"           translation lookup cache, 12..18 on x86/amd64 [15]\n"
+"    --keep-hot-translations=no|yes move translations still in use out of\n"
+"           the sector being recycled, x86/amd64 only [no]\n"
 "    --aspace-minaddr=0xPP     avoid mapping memory below 0xPP [guessed]\n"
 "    --valgrind-stacksize=<number> size of valgrind (host) thread's stack\n"
 "                               (in bytes) ["
@@ -695,6 +702,11 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
       else if VG_BINT_CLO(arg, "--avg-transtab-entry-size",
                                VG_(clo_avg_transtab_entry_size),
                                50, 5000) {}
+      else if VG_BINT_CLO(arg, "--fast-cache-bits",
+                               VG_(clo_fast_cache_bits),
+                               VG_TT_FAST_MIN_BITS, VG_TT_FAST_MAX_BITS) {}
+      else if VG_BOOL_CLO(arg, "--keep-hot-translations",
+                               VG_(clo_keep_hot_translations)) {}
       else if VG_BINT_CLO(arg, "--merge-recursive-frames",
                                VG_(clo_merge_recursive_frames), 0,
                                VG_DEEPEST_BACKTRACE) {}
@@ -707,6 +719,7 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
                           VG_(clo_smc_check), Vg_SmcAll) {}
       else if VG_XACT_CLO(arg, "--smc-check=all-non-file",
                           VG_(clo_smc_check), Vg_SmcAllNonFile) {}
+      else if VG_STR_CLO (arg, "--persistent-tc", VG_(clo_persistent_tc)) {}
 
       else if VG_USETX_CLO (arg, "--kernel-variant",
                             "bproc,"
@@ -2151,6 +2164,14 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    VG_(debugLog)(1, "main", "Initialise TT/TC\n");
    VG_(init_tt_tc)();
 
+   //--------------------------------------------------------------
+   // Read the persistent translation cache
+   //   p: init_tt_tc      [translations are put back into it]
+   //   p: post_clo_init   [the tool's needs are final]
+   //--------------------------------------------------------------
+   VG_(debugLog)(1, "main", "Initialise the persistent translation cache\n");
+   VG_(init_transcache)();
+
    //--------------------------------------------------------------
    // Initialise the redirect table.
    //   p: init_tt_tc [so it can call VG_(search_transtab) safely]
@@ -2622,6 +2643,9 @@ void shutdown_actions_NORETURN( ThreadId tid,
       the error management machinery. */
    VG_TDICT_CALL(tool_fini, 0/*exitcode*/);
 
+   /* Keep this run's translations for the next one. */
+   VG_(save_transcache)();
+
    /* Show the error counts. */
    if (VG_(clo_xml)
        && (VG_(needs).core_errors || VG_(needs).tool_errors)) {
@@ -150,6 +150,8 @@ VgSmc VG_(clo_smc_check) = Vg_SmcStack;
 #  error "Unknown arch"
 #endif
 
+const HChar* VG_(clo_persistent_tc) = NULL;
+
 #if defined(VGO_darwin)
 UInt VG_(clo_resync_filter) = 1; /* enabled, but quiet */
 #else
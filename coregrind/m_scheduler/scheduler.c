@@ -111,6 +111,13 @@
 /* If False, a fault is Valgrind-internal (ie, a bug) */
 Bool VG_(in_generated_code) = False;
 
+/* The running thread's event counter, saved by
+   VG_(leave_generated_code_soon) when it set the counter to zero, or
+   -1.  run_thread_for_a_while puts it back, so that leaving early
+   neither counts blocks that were not run nor shortens the
+   timeslice. */
+static Int evc_saved = -1;
+
 /* 64-bit counter for the number of basic blocks done. */
 static ULong bbs_done = 0;
 
@@ -134,12 +141,14 @@ static ULong n_scheduling_events_MAJOR = 0;
    cache. */
 static ULong stats__n_xindirs = 0;
 static ULong stats__n_xindir_misses = 0;
+static ULong stats__n_xindir_way1_hits = 0;
 
 /* And 32-bit temp bins for the above, so that 32-bit platforms don't
    have to do 64 bit incs on the hot path through
    VG_(cp_disp_xindir). */
 /*global*/ UInt VG_(stats__n_xindirs_32) = 0;
 /*global*/ UInt VG_(stats__n_xindir_misses_32) = 0;
+/*global*/ UInt VG_(stats__n_xindir_way1_hits_32) = 0;
 
 /* Sanity checking counts. */
 static UInt sanity_fast_count = 0;
@@ -154,6 +163,10 @@ void VG_(print_scheduler_stats)(void)
                 stats__n_xindirs, stats__n_xindir_misses,
                 stats__n_xindirs / (stats__n_xindir_misses 
                                     ? stats__n_xindir_misses : 1));
+   if (VG_TT_FAST_WAYS > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: %'llu indir transfers found in fast-cache "
+                   "way 1\n", stats__n_xindir_way1_hits);
    VG_(message)(Vg_DebugMsg,
       "scheduler: %'llu/%'llu major/minor sched events.\n",
       n_scheduling_events_MAJOR, n_scheduling_events_MINOR);
@@ -841,6 +854,20 @@ void VG_(force_vgdb_poll) ( void )
    vgdb_next_poll = VGDB_POLL_ASAP;
 }
 
+void VG_(leave_generated_code_soon) ( void )
+{
+   ThreadState* tst;
+
+   vg_assert(VG_(in_generated_code));
+   if (evc_saved >= 0)
+      return;
+
+   tst = VG_(get_ThreadState)(VG_(running_tid));
+   evc_saved = (Int)tst->arch.vex.host_EvC_COUNTER;
+   vg_assert(evc_saved >= 0);
+   tst->arch.vex.host_EvC_COUNTER = 0;
+}
+
 /* Run the thread tid for a while, and return a VG_TRC_* value
    indicating why VG_(disp_run_translations) stopped, and possibly an
    auxiliary word.  Also, only allow the thread to run for at most
@@ -877,9 +904,16 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    do_pre_run_checks( tst );
    /* end Paranoia */
 
+   /* Tools may have asked for translations to go while the previous
+      run was in generated code.  Not when given alt_host_addr, which
+      the discard could dump along with the unredirected TC. */
+   if (!use_alt_host_addr)
+      VG_(do_requested_discards)();
+
    /* Futz with the XIndir stats counters. */
    vg_assert(VG_(stats__n_xindirs_32) == 0);
    vg_assert(VG_(stats__n_xindir_misses_32) == 0);
+   vg_assert(VG_(stats__n_xindir_way1_hits_32) == 0);
 
    /* Clear return area. */
    two_words[0] = two_words[1] = 0;
@@ -891,8 +925,14 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    } else {
       /* normal case -- redir translation */
       UInt cno = (UInt)VG_TT_FAST_HASH((Addr)tst->arch.vex.VG_INSTR_PTR);
-      if (LIKELY(VG_(tt_fast)[cno].guest == (Addr)tst->arch.vex.VG_INSTR_PTR))
-         host_code_addr = VG_(tt_fast)[cno].host;
+      if (LIKELY(VG_(tt_fast)[0][cno].guest
+                 == (Addr)tst->arch.vex.VG_INSTR_PTR))
+         host_code_addr = VG_(tt_fast)[0][cno].host;
+#     if VG_TT_FAST_WAYS > 1
+      else if (VG_(tt_fast)[1][cno].guest
+               == (Addr)tst->arch.vex.VG_INSTR_PTR)
+         host_code_addr = VG_(tt_fast)[1][cno].host;
+#     endif
       else {
          Addr res = 0;
          /* not found in VG_(tt_fast). Searching here the transtab
@@ -973,6 +1013,24 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    VG_(stats__n_xindirs_32) = 0;
    stats__n_xindir_misses += (ULong)VG_(stats__n_xindir_misses_32);
    VG_(stats__n_xindir_misses_32) = 0;
+   stats__n_xindir_way1_hits += (ULong)VG_(stats__n_xindir_way1_hits_32);
+   VG_(stats__n_xindir_way1_hits_32) = 0;
+
+   /* Undo VG_(leave_generated_code_soon).  If the thread left at the
+      event check that it forced, and was not due to leave there
+      anyway, the block it stopped at was not run.  Report that as a
+      fast cache miss, which just looks the block up again. */
+   if (evc_saved >= 0) {
+      Int evc_now = (Int)tst->arch.vex.host_EvC_COUNTER;
+      vg_assert(evc_now == 0 || evc_now == -1);
+      if (evc_now == -1 && evc_saved > 0) {
+         vg_assert(two_words[0] == VG_TRC_INNER_COUNTERZERO);
+         two_words[0] = VG_TRC_INNER_FASTMISS;
+      }
+      if (evc_now == 0 || evc_saved > 0)
+         tst->arch.vex.host_EvC_COUNTER = evc_saved;
+      evc_saved = -1;
+   }
 
    /* Inspect the event counter. */
    vg_assert((Int)tst->arch.vex.host_EvC_COUNTER >= -1);
@@ -1073,11 +1131,17 @@ void handle_chain_me ( ThreadId tid, void* place_to_chain, Bool toFastEP )
                                  ip, False/*dont_upd_fast_cache*/ );
    if (!found) {
       /* Not found; we need to request a translation. */
+      ULong recycled = VG_(get_sectors_recycled)();
       if (VG_(translate)( tid, ip, /*debug*/False, 0/*not verbose*/, 
                           bbs_done, True/*allow redirection*/ )) {
          found = VG_(search_transtab)( NULL, &to_sNo, &to_tteNo,
                                        ip, False ); 
          vg_assert2(found, "handle_chain_me: missing tt_fast entry");
+         /* If that emptied a sector, place_to_chain may be in it, and
+            now hold another translation's code.  Don't patch it; the
+            jump will ask again if its block is still there. */
+         if (VG_(get_sectors_recycled)() != recycled)
+            return;
       } else {
 	 // If VG_(translate)() fails, it's because it had to throw a
 	 // signal because the client jumped to a bad address.  That
@@ -1452,6 +1516,12 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
       case VG_TRC_INNER_COUNTERZERO:
 	 /* Timeslice is out.  Let a new thread be scheduled. */
 	 vg_assert(dispatch_ctr == 0);
+         /* Look up the block about to run, as a sample of the hot
+            ones: blocks that only run through chained jumps are
+            otherwise never looked up again. */
+         if (VG_(clo_keep_hot_translations))
+            (void)VG_(search_transtab)( NULL, NULL, NULL,
+                                        VG_(get_IP)(tid), False );
 	 break;
 
       case VG_TRC_FAULT_SIGNAL:
@@ -0,0 +1,608 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Translations kept across runs.                m_transcache.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_aspacemgr.h"
+#include "pub_core_clientstate.h"
+#include "pub_core_gdbserver.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"
+#include "pub_core_machine.h"
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_redir.h"
+#include "pub_core_tooliface.h"
+#include "pub_core_transtab.h"
+#include "pub_core_xarray.h"
+
+#include "pub_core_transcache.h"
+
+/* What makes a translation depend on more than the guest code it was
+   made from:
+
+   - Host code calls helpers and dispatcher entry points at absolute
+     addresses.  They only stay the same for the same tool executable,
+     which is linked at a fixed address.
+   - The tool and core options select the instrumentation and the VEX
+     settings; the host capabilities select the instructions used.
+   - Guest addresses are part of the code, so it can only be reused
+     where the guest code is mapped at the same address.
+   - The tool must not put addresses of its own run time data into
+     the code (VG_(needs_persistent_translations)).
+
+   The first two are covered by the cache file key, the others by
+   checking each translation before it is reused: the guest code must
+   still be in a client file mapping, have the same contents (by hash),
+   and no extent other than the first may have become the source of
+   a redirection (VEX does not chase into those). */
+
+/*------------------------------------------------------------*/
+/*--- The cache file                                       ---*/
+/*------------------------------------------------------------*/
+
+#define TCACHE_MAGIC   "VGTCACH2"
+
+/* The file is a TCacheHeader followed by 'n_entries' entries.  Each
+   entry is a TCacheEntry followed by its host code, padded to a
+   multiple of 8 bytes. */
+typedef
+   struct {
+      HChar magic[8];
+      ULong key;
+      ULong n_entries;
+      ULong size;    /* bytes of entries after the header */
+   }
+   TCacheHeader;
+
+typedef
+   struct {
+      ULong  nraddr;   /* entry address given to VG_(add_to_transtab) */
+      ULong  addr;     /* the (redirected) address it was made from */
+      ULong  base[3];  /* guest extents */
+      UShort len[3];
+      UShort n_used;
+      ULong  guest_hash;
+      ULong  code_hash;
+      UInt   kind;     /* redirection kind, see m_translate.c */
+      UInt   code_len;
+      UInt   n_guest_instrs;
+      UInt   is_self_checking;
+   }
+   TCacheEntry;
+
+#define TCACHE_ENTRY_SIZE(code_len) \
+   (sizeof(TCacheEntry) + VG_ROUNDUP((code_len), 8))
+
+static inline const UChar* entry_code ( const TCacheEntry* e )
+{
+   return (const UChar*)(e + 1);
+}
+
+/* Would VG_(add_to_transtab) accept this entry?  Entries are installed
+   without going through VEX again, so a damaged file must not be able
+   to trip the assertions there.  The code itself is checked against
+   'code_hash'.  It needs no patching on install: entries with a profile
+   counter are never recorded, and chain points are found from the code
+   when chaining. */
+static Bool entry_sane ( const TCacheEntry* e )
+{
+   UInt i;
+
+   /* 60000: should agree with the check in VG_(add_to_transtab). */
+   if (e->n_used < 1 || e->n_used > 3
+       || e->code_len == 0 || e->code_len >= 60000
+       || e->n_guest_instrs >= 200)
+      return False;
+   for (i = 0; i < e->n_used; i++)
+      if (e->len[i] == 0)
+         return False;
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- State                                                ---*/
+/*------------------------------------------------------------*/
+
+static Bool   enabled = False;
+static ULong  cache_key;
+static HChar* cache_path = NULL;
+
+/* The contents of the cache file read at startup. */
+static UChar* loaded      = NULL;
+static SizeT  loaded_size = 0;
+
+/* Open-addressing table of the translations to save at exit, by
+   nraddr.  They point into 'loaded', or to copies of new translations
+   made in this run. */
+static TCacheEntry** table      = NULL;
+static UInt          table_size = 0;   /* power of 2 */
+static UInt          table_used = 0;
+
+/* Stats */
+static ULong n_loaded    = 0;
+static ULong n_installed = 0;
+static ULong n_stale     = 0;
+static ULong n_recorded  = 0;
+static ULong n_saved     = 0;
+
+
+/*------------------------------------------------------------*/
+/*--- Hashing                                              ---*/
+/*------------------------------------------------------------*/
+
+/* 64-bit FNV-1a */
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+static ULong hash_bytes ( ULong h, const void* p, SizeT n )
+{
+   const UChar* b = p;
+   SizeT i;
+   for (i = 0; i < n; i++) {
+      h ^= b[i];
+      h *= FNV_PRIME;
+   }
+   return h;
+}
+
+static ULong hash_str ( ULong h, const HChar* s )
+{
+   /* include the terminating zero, so "ab","c" != "a","bc" */
+   return hash_bytes(h, s, VG_(strlen)(s) + 1);
+}
+
+static ULong hash_guest_code ( const VexGuestExtents* vge )
+{
+   ULong h = FNV_OFFSET;
+   UInt  i;
+   for (i = 0; i < vge->n_used; i++)
+      h = hash_bytes(h, (const void*)(Addr)vge->base[i], vge->len[i]);
+   return h;
+}
+
+static ULong compute_key ( void )
+{
+   ULong       h = FNV_OFFSET;
+   VexArch     arch;
+   VexArchInfo archinfo;
+   Int         i;
+
+   h = hash_str(h, VERSION);
+   h = hash_str(h, VG_(details).name);
+
+#  if defined(VGO_linux)
+   {
+      /* the tool executable itself */
+      struct vg_stat st;
+      SysRes sres = VG_(stat)("/proc/self/exe", &st);
+      if (!sr_isError(sres)) {
+         h = hash_bytes(h, &st.dev,        sizeof(st.dev));
+         h = hash_bytes(h, &st.ino,        sizeof(st.ino));
+         h = hash_bytes(h, &st.size,       sizeof(st.size));
+         h = hash_bytes(h, &st.mtime,      sizeof(st.mtime));
+         h = hash_bytes(h, &st.mtime_nsec, sizeof(st.mtime_nsec));
+      }
+   }
+#  endif
+
+   VG_(machine_get_VexArchInfo)(&arch, &archinfo);
+   h = hash_bytes(h, &arch,             sizeof(arch));
+   h = hash_bytes(h, &archinfo.hwcaps,  sizeof(archinfo.hwcaps));
+   h = hash_bytes(h, &archinfo.endness, sizeof(archinfo.endness));
+
+   for (i = 0; i < VG_(sizeXA)(VG_(args_for_valgrind)); i++)
+      h = hash_str(h, *(HChar**)VG_(indexXA)(VG_(args_for_valgrind), i));
+
+   h = hash_str(h, VG_(args_the_exename));
+   return h;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- The table                                            ---*/
+/*------------------------------------------------------------*/
+
+static inline UInt table_slot ( Addr nraddr )
+{
+   /* translations start at all sorts of alignments */
+   ULong h = (ULong)nraddr * 0x9E3779B97F4A7C15ULL;
+   return (UInt)(h >> 32) & (table_size - 1);
+}
+
+/* Returns the slot for nraddr: the one holding it, or the empty one
+   where it would go. */
+static UInt table_find ( Addr nraddr )
+{
+   UInt i = table_slot(nraddr);
+   while (table[i] != NULL && table[i]->nraddr != nraddr)
+      i = (i + 1) & (table_size - 1);
+   return i;
+}
+
+static void table_resize ( UInt new_size )
+{
+   TCacheEntry** old      = table;
+   UInt          old_size = table_size;
+   UInt          i;
+
+   table      = VG_(calloc)("transcache.table", new_size, sizeof(TCacheEntry*));
+   table_size = new_size;
+   for (i = 0; i < old_size; i++)
+      if (old[i] != NULL)
+         table[table_find(old[i]->nraddr)] = old[i];
+   if (old != NULL)
+      VG_(free)(old);
+}
+
+static Bool is_loaded ( const TCacheEntry* e )
+{
+   return (const UChar*)e >= loaded && (const UChar*)e < loaded + loaded_size;
+}
+
+/* Makes e the translation of its nraddr to be saved. */
+static void table_put ( TCacheEntry* e )
+{
+   UInt i;
+
+   if (2 * (table_used + 1) > table_size)
+      table_resize(table_size == 0 ? 4096 : 2 * table_size);
+
+   i = table_find(e->nraddr);
+   if (table[i] == NULL)
+      table_used++;
+   else if (!is_loaded(table[i]))
+      VG_(free)(table[i]);
+   table[i] = e;
+}
+
+static void table_remove ( UInt i )
+{
+   UInt j;
+
+   if (!is_loaded(table[i]))
+      VG_(free)(table[i]);
+   table[i] = NULL;
+   table_used--;
+
+   /* re-insert the rest of the cluster */
+   for (j = (i + 1) & (table_size - 1); table[j] != NULL;
+        j = (j + 1) & (table_size - 1)) {
+      TCacheEntry* e = table[j];
+      table[j] = NULL;
+      table[table_find(e->nraddr)] = e;
+   }
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Checks                                               ---*/
+/*------------------------------------------------------------*/
+
+/* Is [a, a+len) client code in a file mapping? */
+static Bool in_client_file ( Addr a, UInt len )
+{
+   NSegment const* seg = VG_(am_find_nsegment)(a);
+   return seg != NULL && seg->kind == SkFileC && seg->hasR && seg->hasX
+          && len > 0 && a + len - 1 <= seg->end;
+}
+
+static Bool extents_cacheable ( const VexGuestExtents* vge )
+{
+   UInt i;
+
+   for (i = 0; i < vge->n_used; i++)
+      if (!in_client_file(vge->base[i], vge->len[i]))
+         return False;
+
+   /* gdbserver breakpoints and single stepping */
+   return VG_(gdbserver_instrumentation_needed)(vge) == Vg_VgdbNo;
+}
+
+static void entry_extents ( const TCacheEntry* e, /*OUT*/VexGuestExtents* vge )
+{
+   UInt i;
+
+   VG_(memset)(vge, 0, sizeof(*vge));
+   vge->n_used = e->n_used;
+   for (i = 0; i < e->n_used; i++) {
+      vge->base[i] = e->base[i];
+      vge->len[i]  = e->len[i];
+   }
+}
+
+static Bool entry_valid ( const TCacheEntry* e, const VexGuestExtents* vge )
+{
+   UInt i;
+
+   if (!extents_cacheable(vge))
+      return False;
+
+   for (i = 1; i < vge->n_used; i++) {
+      Bool isWrap;
+      if (VG_(redir_do_lookup)(vge->base[i], &isWrap) != vge->base[i])
+         return False;
+   }
+
+   return hash_guest_code(vge) == e->guest_hash;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Reading and writing                                  ---*/
+/*------------------------------------------------------------*/
+
+static void load_file ( void )
+{
+   TCacheHeader hdr;
+   SysRes sres;
+   Int    fd;
+   SizeT  off;
+   ULong  n;
+
+   sres = VG_(open)(cache_path, VKI_O_RDONLY, 0);
+   if (sr_isError(sres))
+      return;   /* first run */
+   fd = sr_Res(sres);
+
+   if (VG_(read)(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+       || VG_(memcmp)(hdr.magic, TCACHE_MAGIC, sizeof(hdr.magic)) != 0
+       || hdr.key != cache_key
+       || hdr.size != (ULong)(VG_(fsize)(fd) - sizeof(hdr))) {
+      VG_(close)(fd);
+      return;
+   }
+
+   loaded_size = hdr.size;
+   loaded      = VG_(malloc)("transcache.loaded", loaded_size > 0 ? loaded_size : 1);
+   for (off = 0; off < loaded_size; ) {
+      Int chunk = loaded_size - off > 0x40000000 ? 0x40000000
+                                                 : (Int)(loaded_size - off);
+      Int r = VG_(read)(fd, loaded + off, chunk);
+      if (r <= 0)
+         break;
+      off += r;
+   }
+   VG_(close)(fd);
+
+   if (off != loaded_size) {
+      VG_(free)(loaded);
+      loaded = NULL;
+      loaded_size = 0;
+      return;
+   }
+
+   for (off = 0, n = 0; n < hdr.n_entries; n++) {
+      TCacheEntry* e = (TCacheEntry*)(loaded + off);
+      if (off + sizeof(TCacheEntry) > loaded_size
+          || !entry_sane(e)
+          || off + TCACHE_ENTRY_SIZE(e->code_len) > loaded_size
+          || hash_bytes(FNV_OFFSET, entry_code(e), e->code_len)
+             != e->code_hash)
+         break;   /* truncated or damaged, use what we have */
+      table_put(e);
+      off += TCACHE_ENTRY_SIZE(e->code_len);
+      n_loaded++;
+   }
+}
+
+static Bool write_all ( Int fd, const void* buf, SizeT len )
+{
+   const UChar* p = buf;
+   while (len > 0) {
+      Int chunk = len > 0x40000000 ? 0x40000000 : (Int)len;
+      Int w = VG_(write)(fd, p, chunk);
+      if (w <= 0)
+         return False;
+      p   += w;
+      len -= w;
+   }
+   return True;
+}
+
+void VG_(save_transcache) ( void )
+{
+   TCacheHeader hdr;
+   SysRes sres;
+   Int    fd;
+   UInt   i;
+   Bool   ok;
+
+   if (!enabled)
+      return;
+
+   HChar tmp_path[VG_(strlen)(cache_path) + 32];
+
+   VG_(memcpy)(hdr.magic, TCACHE_MAGIC, sizeof(hdr.magic));
+   hdr.key       = cache_key;
+   hdr.n_entries = 0;
+   hdr.size      = 0;
+   for (i = 0; i < table_size; i++) {
+      if (table[i] != NULL) {
+         hdr.n_entries++;
+         hdr.size += TCACHE_ENTRY_SIZE(table[i]->code_len);
+      }
+   }
+
+   /* write a new file and rename it, so that concurrent runs read
+      either the old or the new one */
+   VG_(sprintf)(tmp_path, "%s.%d", cache_path, VG_(getpid)());
+   sres = VG_(open)(tmp_path, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
+                    VKI_S_IRUSR|VKI_S_IWUSR);
+   if (sr_isError(sres)) {
+      VG_(umsg)("Warning: cannot create translation cache %s\n", tmp_path);
+      return;
+   }
+   fd = sr_Res(sres);
+
+   ok = write_all(fd, &hdr, sizeof(hdr));
+   for (i = 0; ok && i < table_size; i++) {
+      static const UChar pad[8] = { 0 };
+      const TCacheEntry* e = table[i];
+      if (e == NULL)
+         continue;
+      ok = write_all(fd, e, sizeof(*e))
+           && write_all(fd, entry_code(e), e->code_len)
+           && write_all(fd, pad, VG_ROUNDUP(e->code_len, 8) - e->code_len);
+      n_saved++;
+   }
+   VG_(close)(fd);
+
+   if (!ok || VG_(rename)(tmp_path, cache_path) != 0) {
+      VG_(umsg)("Warning: cannot write translation cache %s\n", cache_path);
+      VG_(unlink)(tmp_path);
+      return;
+   }
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "transcache: saved %llu translations to %s\n",
+                   n_saved, cache_path);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Top level                                            ---*/
+/*------------------------------------------------------------*/
+
+void VG_(init_transcache) ( void )
+{
+   vg_assert(!enabled);
+
+   if (VG_(clo_persistent_tc) == NULL)
+      return;
+
+   if (!VG_(needs).persistent_translations) {
+      VG_(umsg)("Warning: --persistent-tc is not supported by this tool, "
+                "ignored\n");
+      return;
+   }
+   if (VG_(clo_profyle_sbs)) {
+      /* the code contains the address of its profile counter */
+      VG_(umsg)("Warning: --persistent-tc is ignored with --profile-superblocks\n");
+      return;
+   }
+
+   cache_key  = compute_key();
+   cache_path = VG_(malloc)("transcache.path",
+                            VG_(strlen)(VG_(clo_persistent_tc)) + 64);
+   VG_(sprintf)(cache_path, "%s/vgtcache-%s-%016llx",
+                VG_(clo_persistent_tc), VG_(details).name, cache_key);
+
+   enabled = True;
+   load_file();
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "transcache: %llu translations in %s\n",
+                   n_loaded, cache_path);
+}
+
+Bool VG_(transcache_install) ( Addr nraddr, Addr addr, UInt kind )
+{
+   VexGuestExtents vge;
+   TCacheEntry*    e;
+   UInt            i, slot;
+
+   if (!enabled || table_size == 0)
+      return False;
+
+   slot = table_find(nraddr);
+   e    = table[slot];
+   if (e == NULL || e->addr != addr || e->kind != kind)
+      return False;
+
+   entry_extents(e, &vge);
+   if (!entry_valid(e, &vge)) {
+      /* the code changed, or is not where it was */
+      n_stale++;
+      table_remove(slot);
+      return False;
+   }
+
+   for (i = 0; i < vge.n_used; i++)
+      VG_(am_set_segment_hasT)(vge.base[i]);
+
+   VG_(add_to_transtab)( &vge, nraddr, (Addr)entry_code(e), e->code_len,
+                         e->is_self_checking, -1/*offs_profInc*/,
+                         e->n_guest_instrs );
+   n_installed++;
+   return True;
+}
+
+void VG_(transcache_record) ( Addr nraddr, Addr addr, UInt kind,
+                              const VexGuestExtents* vge,
+                              const UChar* code, UInt code_len,
+                              Bool is_self_checking,
+                              Int offs_profInc,
+                              UInt n_guest_instrs )
+{
+   TCacheEntry* e;
+   UInt         i;
+
+   if (!enabled || offs_profInc != -1 || !extents_cacheable(vge))
+      return;
+
+   e = VG_(malloc)("transcache.entry", TCACHE_ENTRY_SIZE(code_len));
+   VG_(memset)(e, 0, sizeof(*e));
+   e->nraddr = nraddr;
+   e->addr   = addr;
+   e->n_used = vge->n_used;
+   for (i = 0; i < vge->n_used; i++) {
+      e->base[i] = vge->base[i];
+      e->len[i]  = vge->len[i];
+   }
+   e->guest_hash       = hash_guest_code(vge);
+   e->code_hash        = hash_bytes(FNV_OFFSET, code, code_len);
+   e->kind             = kind;
+   e->code_len         = code_len;
+   e->n_guest_instrs   = n_guest_instrs;
+   e->is_self_checking = is_self_checking;
+   VG_(memcpy)((UChar*)(e + 1), code, code_len);
+
+   table_put(e);
+   n_recorded++;
+}
+
+void VG_(print_transcache_stats) ( void )
+{
+   if (!enabled)
+      return;
+
+   VG_(message)(Vg_DebugMsg,
+                "transcache: %'llu loaded, %'llu installed, %'llu stale, "
+                "%'llu recorded\n",
+                n_loaded, n_installed, n_stale, n_recorded);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -49,6 +49,7 @@
 #include "pub_core_tooliface.h"  // VG_(tdict)
 
 #include "pub_core_translate.h"
+#include "pub_core_transcache.h"
 #include "pub_core_transtab.h"
 #include "pub_core_dispatch.h" // VG_(run_innerloop__dispatch_{un}profiled)
                                // VG_(run_a_noredir_translation__return_point)
@@ -1624,6 +1625,12 @@ Bool VG_(translate) ( ThreadId tid,
       verbosity = VG_(clo_trace_flags);
    }
 
+   /* Reuse the translation made by an earlier run, if still valid
+      (--persistent-tc). */
+   if (!debugging_translation && verbosity == 0 && kind != T_NoRedir
+       && VG_(transcache_install)( nraddr, addr, kind ))
+      return True;
+
    /* Figure out which preamble-mangling callback to send. */
    preamble_fn = NULL;
    if (kind == T_Redir_Replace)
@@ -1801,6 +1808,11 @@ Bool VG_(translate) ( ThreadId tid,
                                 tres.n_sc_extents > 0,
                                 tres.offs_profInc,
                                 tres.n_guest_instrs );
+          VG_(transcache_record)( nraddr, addr, kind, &vge,
+                                  &tmpbuf[0], tmpbuf_used,
+                                  tres.n_sc_extents > 0,
+                                  tres.offs_profInc,
+                                  tres.n_guest_instrs );
       } else {
           vg_assert(tres.offs_profInc == -1); /* -1 == unset */
           VG_(add_to_unredir_transtab)( &vge,
@@ -44,6 +44,7 @@
 #include "pub_core_mallocfree.h" // VG_(out_of_memory_NORETURN)
 #include "pub_core_xarray.h"
 #include "pub_core_dispatch.h"   // For VG_(disp_cp*) addresses
+#include "pub_core_scheduler.h"  // VG_(leave_generated_code_soon)
 
 
 #define DEBUG_TRANSTAB 0
@@ -63,6 +64,13 @@ static SECno n_sectors = 0;
    provided default. */
 UInt VG_(clo_avg_transtab_entry_size) = 0;
 
+/* Log2 of the number of entries used in each way of VG_(tt_fast). */
+UInt VG_(clo_fast_cache_bits) = VG_TT_FAST_BITS;
+
+/* Move translations still in use into the youngest sector, instead
+   of throwing them away with the rest of the oldest one. */
+Bool VG_(clo_keep_hot_translations) = False;
+
 /*------------------ CONSTANTS ------------------*/
 /* Number of entries in hash table of each sector.  This needs to be a prime
    number to work properly, it must be <= 65535 (so that a TTE index
@@ -176,6 +184,11 @@ typedef
                are profiling. */
             ULong    count;
             UShort   weight;
+            /* Not profiling: the number of times this translation was
+               looked up, or found running when a thread's time slice
+               ran out, while it was not in the youngest sector.  A
+               saturating count, used by --keep-hot-translations. */
+            UShort   old_hits;
          } prof; // if status == InUse
          TTEno next_empty_tte; // if status != InUse
       } usage;
@@ -457,9 +470,13 @@ static Int    tc_sector_szQ = 0;
 static SECno sector_search_order[MAX_N_SECTORS];
 
 
-/* Fast helper for the TC.  A direct-mapped cache which holds a set of
-   recently used (guest address, host address) pairs.  This array is
-   referred to directly from m_dispatch/dispatch-<platform>.S.
+/* Fast helper for the TC.  A set associative cache which holds a set
+   of recently used (guest address, host address) pairs.  This array
+   is referred to directly from m_dispatch/dispatch-<platform>.S.
+   A new pair goes in way 0 and moves the one there to way 1, so a
+   block that alternates with another of the same index (a common
+   pattern for the targets of returns and of switch jumps) stays in
+   the cache.
 
    Entries in tt_fast may refer to any valid TC entry, regardless of
    which sector it's in.  Consequently we must be very careful to
@@ -480,7 +497,9 @@ typedef
    FastCacheEntry;
 */
 /*global*/ __attribute__((aligned(16)))
-           FastCacheEntry VG_(tt_fast)[VG_TT_FAST_SIZE];
+           FastCacheEntry VG_(tt_fast)[VG_TT_FAST_WAYS][VG_TT_FAST_SIZE];
+
+/*global*/ UWord VG_(tt_fast_mask) = (1 << VG_TT_FAST_BITS) - 1;
 
 /* Make sure we're not used before initialisation. */
 static Bool init_done = False;
@@ -491,6 +510,7 @@ static Bool init_done = False;
 /* Number of fast-cache updates and flushes done. */
 static ULong n_fast_flushes = 0;
 static ULong n_fast_updates = 0;
+static ULong n_fast_demotions = 0;
 
 /* Number of full lookups done. */
 static ULong n_full_lookups = 0;
@@ -508,6 +528,10 @@ static ULong n_dump_count = 0;
 static ULong n_dump_osize = 0;
 static ULong n_sectors_recycled = 0;
 
+/* Number/tsize of translations moved out of recycled sectors. */
+static ULong n_kept_count = 0;
+static ULong n_kept_tsize = 0;
+
 /* Number/osize of translations discarded due to requests to do so. */
 static ULong n_disc_count = 0;
 static ULong n_disc_osize = 0;
@@ -986,6 +1010,44 @@ static void unchain_one ( VexArch arch_host, VexEndness endness_host,
 }
 
 
+/* Undo the chained jumps out of the specified block, so that they go
+   to the dispatcher's chain-me points again, as when the block was
+   made.  Its code then depends on no other translation. */
+static
+void unchain_out_edges ( VexArch arch_host, VexEndness endness_host,
+                         SECno here_sNo, TTEno here_tteNo )
+{
+   UWord     i, j, n, m;
+   Int       evCheckSzB = LibVEX_evCheckSzB(arch_host);
+   TTEntryC* here_tteC  = index_tteC(here_sNo, here_tteNo);
+
+   n = OutEdgeArr__size(&here_tteC->out_edges);
+   for (i = 0; i < n; i++) {
+      OutEdge*  oe      = OutEdgeArr__index(&here_tteC->out_edges, i);
+      TTEntryC* to_tteC = index_tteC(oe->to_sNo, oe->to_tteNo);
+      // Find the corresponding entry in the "to" node's in_edges,
+      // undo the chaining it describes, and remove it.
+      m = InEdgeArr__size(&to_tteC->in_edges);
+      vg_assert(m > 0); // it must have at least one entry
+      for (j = 0; j < m; j++) {
+         InEdge* ie = InEdgeArr__index(&to_tteC->in_edges, j);
+         if (ie->from_sNo == here_sNo && ie->from_tteNo == here_tteNo
+             && ie->from_offs == oe->from_offs)
+           break;
+      }
+      vg_assert(j < m); // "ie must be findable"
+      UChar* to_slow_EP = (UChar*)to_tteC->tcptr;
+      UChar* to_fast_EP = to_slow_EP + evCheckSzB;
+      unchain_one(arch_host, endness_host,
+                  InEdgeArr__index(&to_tteC->in_edges, j),
+                  to_fast_EP, to_slow_EP);
+      InEdgeArr__deleteIndex(&to_tteC->in_edges, j);
+   }
+
+   OutEdgeArr__makeEmpty(&here_tteC->out_edges);
+}
+
+
 /* The specified block is about to be deleted.  Update the preds and
    succs of its associated blocks accordingly.  This includes undoing
    any chained jumps to this block. */
@@ -1458,30 +1520,43 @@ static inline HTTno HASH_TT ( Addr key )
 static void setFastCacheEntry ( Addr key, ULong* tcptr )
 {
    UInt cno = (UInt)VG_TT_FAST_HASH(key);
-   VG_(tt_fast)[cno].guest = key;
-   VG_(tt_fast)[cno].host  = (Addr)tcptr;
+#  if VG_TT_FAST_WAYS > 1
+   /* If 'key' is in way 1, this overwrites it, so that it is never
+      in both ways. */
+   if (VG_(tt_fast)[0][cno].guest != key) {
+      VG_(tt_fast)[1][cno] = VG_(tt_fast)[0][cno];
+      if (VG_(tt_fast)[1][cno].guest != TRANSTAB_BOGUS_GUEST_ADDR)
+         n_fast_demotions++;
+   }
+#  endif
+   VG_(tt_fast)[0][cno].guest = key;
+   VG_(tt_fast)[0][cno].host  = (Addr)tcptr;
    n_fast_updates++;
    /* This shouldn't fail.  It should be assured by m_translate
       which should reject any attempt to make translation of code
       starting at TRANSTAB_BOGUS_GUEST_ADDR. */
-   vg_assert(VG_(tt_fast)[cno].guest != TRANSTAB_BOGUS_GUEST_ADDR);
+   vg_assert(VG_(tt_fast)[0][cno].guest != TRANSTAB_BOGUS_GUEST_ADDR);
 }
 
 /* Invalidate the fast cache VG_(tt_fast). */
 static void invalidateFastCache ( void )
 {
-   UInt j;
+   UInt j, w;
+   UInt n = (UInt)VG_(tt_fast_mask) + 1;
    /* This loop is popular enough to make it worth unrolling a
-      bit, at least on ppc32. */
-   vg_assert(VG_TT_FAST_SIZE > 0 && (VG_TT_FAST_SIZE % 4) == 0);
-   for (j = 0; j < VG_TT_FAST_SIZE; j += 4) {
-      VG_(tt_fast)[j+0].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+1].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+2].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+3].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+      bit, at least on ppc32.  Only the entries in use need doing. */
+   vg_assert(n > 0 && n <= VG_TT_FAST_SIZE && (n % 4) == 0);
+   for (w = 0; w < VG_TT_FAST_WAYS; w++) {
+      FastCacheEntry* way = VG_(tt_fast)[w];
+      for (j = 0; j < n; j += 4) {
+         way[j+0].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+         way[j+1].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+         way[j+2].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+         way[j+3].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+      }
+      vg_assert(j == n);
    }
 
-   vg_assert(j == VG_TT_FAST_SIZE);
    n_fast_flushes++;
 }
 
@@ -1504,11 +1579,95 @@ static void add_to_empty_tt_list (SECno sNo, TTEno tteno)
    sectors[sNo].empty_tt_list = tteno;
 }
 
+/* --keep-hot-translations.  When the oldest sector is recycled, the
+   translations in it that have been used since it stopped being the
+   youngest (old_hits > 0) are moved to the start of its code area, and
+   so become part of the new youngest sector.  The rest are dumped as
+   usual.  Their chained exits are undone first, which on x86/amd64
+   leaves code that can run anywhere.  The other hosts may have code
+   that is not position independent, so this is not done there.
+
+   No more than half of the sector is kept, so that a large working
+   set cannot fill the new youngest sector with old translations. */
+#if defined(VGA_x86) || defined(VGA_amd64)
+#  define CAN_MOVE_TRANSLATIONS 1
+#else
+#  define CAN_MOVE_TRANSLATIONS 0
+#endif
+
+typedef
+   struct {
+      Addr            entry;
+      VexGuestExtents vge;
+      UChar*          code;
+      UInt            code_len;
+      UShort          weight;
+   }
+   KeptTranslation;
+
+/* Which TT entries of the sector being recycled are kept. */
+static UChar kept_tte[(N_TTES_PER_SECTOR + 7) / 8];
+
+static inline Bool is_kept_tte ( TTEno tteNo )
+{
+   return (kept_tte[tteNo / 8] >> (tteNo % 8)) & 1;
+}
+
+static TTEno put_in_sector ( SECno y, const VexGuestExtents* vge,
+                             Addr entry, Addr code, UInt code_len,
+                             Int offs_profInc, UShort weight );
+
+/* Choose the translations of sector sno to keep, and unchain their
+   exits.  Returns them in order of host code address, or NULL if
+   there are none. */
+static XArray* select_hot_translations ( VexArch arch_host,
+                                         VexEndness endness_host,
+                                         SECno sno )
+{
+   Sector* sec     = &sectors[sno];
+   XArray* kept    = NULL;
+   Word    n_kept  = 0;
+   ULong   keptQ   = 0;
+   Word    i, n;
+
+   VG_(memset)(kept_tte, 0, sizeof(kept_tte));
+
+   n = VG_(sizeXA)(sec->host_extents);
+   for (i = 0; i < n; i++) {
+      const HostExtent* hx = VG_(indexXA)(sec->host_extents, i);
+      TTEntryH* tteH = &sec->ttH[hx->tteNo];
+      TTEntryC* tteC = &sec->ttC[hx->tteNo];
+      if (tteH->status != InUse || tteC->usage.prof.old_hits == 0)
+         continue;
+      if (n_kept + 1 > N_TTES_PER_SECTOR / 2
+          || keptQ + (hx->len + 7) / 8 > tc_sector_szQ / 2)
+         break;
+
+      unchain_out_edges(arch_host, endness_host, sno, hx->tteNo);
+
+      KeptTranslation kt;
+      kt.entry    = tteC->entry;
+      TTEntryH__to_VexGuestExtents( &kt.vge, tteH );
+      kt.code     = hx->start;
+      kt.code_len = hx->len;
+      kt.weight   = tteC->usage.prof.weight;
+      if (kept == NULL)
+         kept = VG_(newXA)(ttaux_malloc, "transtab.select_hot_translations",
+                           ttaux_free, sizeof(KeptTranslation));
+      VG_(addToXA)(kept, &kt);
+      kept_tte[hx->tteNo / 8] |= 1 << (hx->tteNo % 8);
+      n_kept++;
+      keptQ += (hx->len + 7) / 8;
+   }
+   return kept;
+}
+
 static void initialiseSector ( SECno sno )
 {
    UInt i;
    SysRes  sres;
    Sector* sec;
+   XArray* kept = NULL;
    vg_assert(isValidSector(sno));
 
    { Bool sane = sanity_check_sector_search_order();
@@ -1613,6 +1772,12 @@ static void initialiseSector ( SECno sno )
       VG_(machine_get_VexArchInfo)( &arch_host, &archinfo_host );
       VexEndness endness_host = archinfo_host.endness;
 
+      kept = VG_(clo_keep_hot_translations)
+                ? select_hot_translations(arch_host, endness_host, sno)
+                : NULL;
+      if (kept)
+         n_dump_count -= VG_(sizeXA)(kept);
+
       /* Visit each just-about-to-be-abandoned translation. */
       if (DEBUG_TRANSTAB) VG_(printf)("QQQ unlink-entire-sector: %d START\n",
                                       sno);
@@ -1621,9 +1786,12 @@ static void initialiseSector ( SECno sno )
          if (sec->ttH[ei].status == InUse) {
             vg_assert(sec->ttC[ei].n_tte2ec >= 1);
             vg_assert(sec->ttC[ei].n_tte2ec <= 3);
-            n_dump_osize += TTEntryH__osize(&sec->ttH[ei]);
-            /* Tell the tool too. */
-            if (VG_(needs).superblock_discards) {
+            Bool is_kept = kept != NULL && is_kept_tte(ei);
+            if (!is_kept)
+               n_dump_osize += TTEntryH__osize(&sec->ttH[ei]);
+            /* Tell the tool too, unless the translation is only
+               being moved. */
+            if (VG_(needs).superblock_discards && !is_kept) {
                VexGuestExtents vge_tmp;
                TTEntryH__to_VexGuestExtents( &vge_tmp, &sec->ttH[ei] );
                VG_TDICT_CALL( tool_discard_superblock_info,
@@ -1679,6 +1847,25 @@ static void initialiseSector ( SECno sno )
    sec->tc_next = sec->tc;
    sec->tt_n_inuse = 0;
 
+   /* Put the kept translations back, at the start of the code area.
+      Each one moves down (or stays put), never over one still to be
+      moved, since they are taken in address order. */
+   if (kept) {
+      Word n = VG_(sizeXA)(kept);
+      for (i = 0; i < n; i++) {
+         const KeptTranslation* kt = VG_(indexXA)(kept, i);
+         vg_assert((ULong*)kt->code >= sec->tc_next);
+         put_in_sector(sno, &kt->vge, kt->entry, (Addr)kt->code,
+                       kt->code_len, -1/*offs_profInc*/, kt->weight);
+         n_kept_tsize += kt->code_len;
+      }
+      n_kept_count += n;
+      if (VG_(clo_stats) || VG_(debugLog_getLevel)() >= 1)
+         VG_(dmsg)("transtab: " "kept %ld hot translations in sector %d\n",
+                   n, sno);
+      VG_(deleteXA)(kept);
+   }
+
    invalidateFastCache();
 
    { Bool sane = sanity_check_sector_search_order();
@@ -1686,84 +1873,20 @@ static void initialiseSector ( SECno sno )
    }
 }
 
-/* Add a translation of vge to TT/TC.  The translation is temporarily
-   in code[0 .. code_len-1].
-
-   pre: youngest_sector points to a valid (although possibly full)
-   sector.
-*/
-void VG_(add_to_transtab)( const VexGuestExtents* vge,
-                           Addr             entry,
-                           Addr             code,
-                           UInt             code_len,
-                           Bool             is_self_checking,
-                           Int              offs_profInc,
-                           UInt             n_guest_instrs )
+/* Put a translation of vge into sector y, which must have room for
+   it.  The host code is at code[0 .. code_len-1], which may be in the
+   sector's own unused code area. */
+static TTEno put_in_sector ( SECno y, const VexGuestExtents* vge,
+                             Addr entry, Addr code, UInt code_len,
+                             Int offs_profInc, UShort weight )
 {
-   Int    tcAvailQ, reqdQ, y;
+   Int    tcAvailQ, reqdQ;
    ULong  *tcptr, *tcptr2;
    UChar* srcP;
    UChar* dstP;
 
-   vg_assert(init_done);
-   vg_assert(vge->n_used >= 1 && vge->n_used <= 3);
-
-   /* 60000: should agree with N_TMPBUF in m_translate.c. */
-   vg_assert(code_len > 0 && code_len < 60000);
-
-   /* Generally stay sane */
-   vg_assert(n_guest_instrs < 200); /* it can be zero, tho */
-
-   if (DEBUG_TRANSTAB)
-      VG_(printf)("add_to_transtab(entry = 0x%lx, len = %u) ...\n",
-                  entry, code_len);
-
-   n_in_count++;
-   n_in_tsize += code_len;
-   n_in_osize += vge_osize(vge);
-   if (is_self_checking)
-      n_in_sc_count++;
-
-   y = youngest_sector;
-   vg_assert(isValidSector(y));
-
-   if (sectors[y].tc == NULL)
-      initialiseSector(y);
-
-   /* Try putting the translation in this sector. */
    reqdQ = (code_len + 7) >> 3;
 
-   /* Will it fit in tc? */
-   tcAvailQ = ((ULong*)(&sectors[y].tc[tc_sector_szQ]))
-              - ((ULong*)(sectors[y].tc_next));
-   vg_assert(tcAvailQ >= 0);
-   vg_assert(tcAvailQ <= tc_sector_szQ);
-
-   if (tcAvailQ < reqdQ 
-       || sectors[y].tt_n_inuse >= N_TTES_PER_SECTOR) {
-      /* No.  So move on to the next sector.  Either it's never been
-         used before, in which case it will get its tt/tc allocated
-         now, or it has been used before, in which case it is set to be
-         empty, hence throwing out the oldest sector. */
-      vg_assert(tc_sector_szQ > 0);
-      Int tt_loading_pct = (100 * sectors[y].tt_n_inuse) 
-                           / N_HTTES_PER_SECTOR;
-      Int tc_loading_pct = (100 * (tc_sector_szQ - tcAvailQ)) 
-                           / tc_sector_szQ;
-      if (VG_(clo_stats) || VG_(debugLog_getLevel)() >= 1) {
-         VG_(dmsg)("transtab: "
-                   "declare  sector %d full "
-                   "(TT loading %2d%%, TC loading %2d%%, avg tce size %d)\n",
-                   y, tt_loading_pct, tc_loading_pct,
-                   8 * (tc_sector_szQ - tcAvailQ)/sectors[y].tt_n_inuse);
-      }
-      youngest_sector++;
-      if (youngest_sector >= n_sectors)
-         youngest_sector = 0;
-      y = youngest_sector;
-      initialiseSector(y);
-   }
-
    /* Be sure ... */
    tcAvailQ = ((ULong*)(&sectors[y].tc[tc_sector_szQ]))
               - ((ULong*)(sectors[y].tc_next));
@@ -1780,7 +1903,7 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
 
    dstP = (UChar*)tcptr;
    srcP = (UChar*)code;
-   VG_(memcpy)(dstP, srcP, code_len);
+   VG_(memmove)(dstP, srcP, code_len);
    sectors[y].tc_next += reqdQ;
    sectors[y].tt_n_inuse++;
 
@@ -1796,8 +1919,8 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
    TTEntryH__init(&sectors[y].ttH[tteix]);
    sectors[y].ttC[tteix].tcptr  = tcptr;
    sectors[y].ttC[tteix].usage.prof.count  = 0;
-   sectors[y].ttC[tteix].usage.prof.weight = 
-      n_guest_instrs == 0 ? 1 : n_guest_instrs;
+   sectors[y].ttC[tteix].usage.prof.weight = weight;
+   sectors[y].ttC[tteix].usage.prof.old_hits = 0;
    sectors[y].ttC[tteix].entry  = entry;
    TTEntryH__from_VexGuestExtents( &sectors[y].ttH[tteix], vge );
    sectors[y].ttH[tteix].status = InUse;
@@ -1852,11 +1975,96 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
                     hx.start, hx.len, y, tteix);
    }
 
-   /* Update the fast-cache. */
-   setFastCacheEntry( entry, tcptr );
-
    /* Note the eclass numbers for this translation. */
    upd_eclasses_after_add( &sectors[y], tteix );
+
+   return tteix;
+}
+
+/* Add a translation of vge to TT/TC.  The translation is temporarily
+   in code[0 .. code_len-1].
+
+   pre: youngest_sector points to a valid (although possibly full)
+   sector.
+*/
+void VG_(add_to_transtab)( const VexGuestExtents* vge,
+                           Addr             entry,
+                           Addr             code,
+                           UInt             code_len,
+                           Bool             is_self_checking,
+                           Int              offs_profInc,
+                           UInt             n_guest_instrs )
+{
+   Int    tcAvailQ, reqdQ, y;
+   ULong* tcptr;
+
+   vg_assert(init_done);
+   vg_assert(vge->n_used >= 1 && vge->n_used <= 3);
+
+   /* 60000: should agree with N_TMPBUF in m_translate.c. */
+   vg_assert(code_len > 0 && code_len < 60000);
+
+   /* Generally stay sane */
+   vg_assert(n_guest_instrs < 200); /* it can be zero, tho */
+
+   if (DEBUG_TRANSTAB)
+      VG_(printf)("add_to_transtab(entry = 0x%lx, len = %u) ...\n",
+                  entry, code_len);
+
+   n_in_count++;
+   n_in_tsize += code_len;
+   n_in_osize += vge_osize(vge);
+   if (is_self_checking)
+      n_in_sc_count++;
+
+   y = youngest_sector;
+   vg_assert(isValidSector(y));
+
+   if (sectors[y].tc == NULL)
+      initialiseSector(y);
+
+   /* Try putting the translation in this sector. */
+   reqdQ = (code_len + 7) >> 3;
+
+   /* Will it fit in tc? */
+   tcAvailQ = ((ULong*)(&sectors[y].tc[tc_sector_szQ]))
+              - ((ULong*)(sectors[y].tc_next));
+   vg_assert(tcAvailQ >= 0);
+   vg_assert(tcAvailQ <= tc_sector_szQ);
+
+   if (tcAvailQ < reqdQ 
+       || sectors[y].tt_n_inuse >= N_TTES_PER_SECTOR) {
+      /* No.  So move on to the next sector.  Either it's never been
+         used before, in which case it will get its tt/tc allocated
+         now, or it has been used before, in which case it is set to be
+         empty, hence throwing out the oldest sector. */
+      vg_assert(tc_sector_szQ > 0);
+      Int tt_loading_pct = (100 * sectors[y].tt_n_inuse) 
+                           / N_HTTES_PER_SECTOR;
+      Int tc_loading_pct = (100 * (tc_sector_szQ - tcAvailQ)) 
+                           / tc_sector_szQ;
+      if (VG_(clo_stats) || VG_(debugLog_getLevel)() >= 1) {
+         VG_(dmsg)("transtab: "
+                   "declare  sector %d full "
+                   "(TT loading %2d%%, TC loading %2d%%, avg tce size %d)\n",
+                   y, tt_loading_pct, tc_loading_pct,
+                   8 * (tc_sector_szQ - tcAvailQ)/sectors[y].tt_n_inuse);
+      }
+      youngest_sector++;
+      if (youngest_sector >= n_sectors)
+         youngest_sector = 0;
+      y = youngest_sector;
+      initialiseSector(y);
+   }
+
+   tcptr = sectors[y].ttC[ put_in_sector( y, vge, entry, code, code_len,
+                                          offs_profInc,
+                                          n_guest_instrs == 0
+                                             ? 1 : n_guest_instrs )
+                         ].tcptr;
+
+   /* Update the fast-cache. */
+   setFastCacheEntry( entry, tcptr );
 }
 
 
@@ -1896,6 +2104,9 @@ Bool VG_(search_transtab) ( /*OUT*/Addr*  res_hcode,
          if (tti < N_TTES_PER_SECTOR
              && sectors[sno].ttC[tti].entry == guest_addr) {
             /* found it */
+            if (sno != youngest_sector
+                && sectors[sno].ttC[tti].usage.prof.old_hits < 0xFFFF)
+               sectors[sno].ttC[tti].usage.prof.old_hits++;
             if (upd_cache)
                setFastCacheEntry( 
                   guest_addr, sectors[sno].ttC[tti].tcptr );
@@ -2241,6 +2452,50 @@ void VG_(discard_translations_safely) ( Addr  start, SizeT len,
    VG_(discard_translations)(start, len, who);
 }
 
+/* Range of a pending VG_(request_discard_translations), from
+   discard_req_start to discard_req_last inclusive. */
+static Bool         discard_req_pending = False;
+static Addr         discard_req_start;
+static Addr         discard_req_last;
+static const HChar* discard_req_who;
+
+void VG_(request_discard_translations) ( Addr  start, SizeT len,
+                                         const HChar* who )
+{
+   Addr last;
+
+   if (len == 0)
+      return;
+   last = start + len - 1;
+   vg_assert(last >= start);
+
+   if (!discard_req_pending) {
+      discard_req_pending = True;
+      discard_req_start   = start;
+      discard_req_last    = last;
+      discard_req_who     = who;
+   } else {
+      if (start < discard_req_start)
+         discard_req_start = start;
+      if (last > discard_req_last)
+         discard_req_last = last;
+   }
+
+   if (VG_(in_generated_code))
+      VG_(leave_generated_code_soon)();
+}
+
+void VG_(do_requested_discards) ( void )
+{
+   if (LIKELY(!discard_req_pending))
+      return;
+
+   discard_req_pending = False;
+   VG_(discard_translations)( discard_req_start,
+                              (ULong)(discard_req_last - discard_req_start) + 1,
+                              discard_req_who );
+}
+
 /*------------------------------------------------------------*/
 /*--- AUXILIARY: the unredirected TT/TC                    ---*/
 /*------------------------------------------------------------*/
@@ -2437,10 +2692,23 @@ void VG_(init_tt_tc) ( void )
    vg_assert(sizeof(FastCacheEntry) == 2 * sizeof(Addr));
    /* check fast cache entries are packed back-to-back with no spaces */
    vg_assert(sizeof( VG_(tt_fast) ) 
-             == VG_TT_FAST_SIZE * sizeof(FastCacheEntry));
+             == VG_TT_FAST_WAYS * VG_TT_FAST_SIZE * sizeof(FastCacheEntry));
    /* check fast cache is aligned as we requested.  Not fatal if it
       isn't, but we might as well make sure. */
-   vg_assert(VG_IS_16_ALIGNED( ((Addr) & VG_(tt_fast)[0]) ));
+   vg_assert(VG_IS_16_ALIGNED( ((Addr) & VG_(tt_fast)[0][0]) ));
+
+   if (VG_(clo_keep_hot_translations)
+       && (!CAN_MOVE_TRANSLATIONS || VG_(clo_profyle_sbs))) {
+      VG_(umsg)("Warning: --keep-hot-translations=yes is not supported "
+                "%s, ignored\n",
+                VG_(clo_profyle_sbs) ? "with --profile-sbs"
+                                     : "on this platform");
+      VG_(clo_keep_hot_translations) = False;
+   }
+
+   vg_assert(VG_(clo_fast_cache_bits) >= VG_TT_FAST_MIN_BITS);
+   vg_assert(VG_(clo_fast_cache_bits) <= VG_TT_FAST_MAX_BITS);
+   VG_(tt_fast_mask) = (1UL << VG_(clo_fast_cache_bits)) - 1;
 
    /* The TTEntryH size is critical for keeping the LLC miss rate down
       when doing a lot of discarding.  Hence check it here.  We also
@@ -2565,6 +2833,11 @@ UInt VG_(get_bbs_translated) ( void )
    return n_in_count;
 }
 
+ULong VG_(get_sectors_recycled) ( void )
+{
+   return n_sectors_recycled;
+}
+
 void VG_(print_tt_tc_stats) ( void )
 {
    VG_(message)(Vg_DebugMsg,
@@ -2573,6 +2846,9 @@ void VG_(print_tt_tc_stats) ( void )
    VG_(message)(Vg_DebugMsg,
       "    tt/tc: %'llu fast-cache updates, %'llu flushes\n",
       n_fast_updates, n_fast_flushes );
+   VG_(message)(Vg_DebugMsg,
+      "    tt/tc: fast-cache %d-way x %'lu entries, %'llu moved to way 1\n",
+      VG_TT_FAST_WAYS, VG_(tt_fast_mask) + 1, n_fast_demotions );
 
    VG_(message)(Vg_DebugMsg,
                 " transtab: new        %'llu "
@@ -2586,6 +2862,10 @@ void VG_(print_tt_tc_stats) ( void )
                 " transtab: dumped     %'llu (%'llu -> ?" "?) "
                 "(sectors recycled %'llu)\n",
                 n_dump_count, n_dump_osize, n_sectors_recycled );
+   if (VG_(clo_keep_hot_translations))
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: kept       %'llu (? -> %'llu)\n",
+                   n_kept_count, n_kept_tsize );
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %'llu (%'llu -> ?" "?)\n",
                 n_disc_count, n_disc_osize );
@@ -166,6 +166,11 @@ extern IRSB* VG_(instrument_for_gdbserver_if_needed)
       const VexGuestExtents* vge,
       IRType gWordTy, IRType hWordTy);
 
+/* Returns the reason for which gdbserver instrumentation is needed
+   for the guest code in vge, or Vg_VgdbNo if it is not needed. */
+extern VgVgdb VG_(gdbserver_instrumentation_needed)
+     (const VexGuestExtents* vge);
+
 /* reason for which gdbserver connection must be finished */
 typedef
    enum {
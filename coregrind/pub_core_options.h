@@ -318,6 +318,14 @@ extern UInt VG_(clo_num_transtab_sectors);
    provided default. */
 extern UInt VG_(clo_avg_transtab_entry_size);
 
+/* Log2 of the number of entries in each way of the fast translation
+   lookup cache, between VG_TT_FAST_MIN_BITS and VG_TT_FAST_MAX_BITS. */
+extern UInt VG_(clo_fast_cache_bits);
+
+/* Keep translations that are still in use when their sector is
+   recycled (m_transtab.c). */
+extern Bool VG_(clo_keep_hot_translations);
+
 /* Only client requested fixed mapping can be done below 
    VG_(clo_aspacem_minAddr). */
 extern Addr VG_(clo_aspacem_minAddr);
@@ -347,6 +355,10 @@ typedef
    auto-detected. */
 extern VgSmc VG_(clo_smc_check);
 
+/* Directory of the persistent translation cache (m_transcache.c),
+   or NULL if translations are not kept across runs. */
+extern const HChar* VG_(clo_persistent_tc);
+
 /* A set of minor kernel variants,
    so they can be properly handled by m_syswrap. */
 typedef
@@ -115,6 +115,10 @@ extern void VG_(print_scheduler_stats) ( void );
 /* If False, a fault is Valgrind-internal (ie, a bug) */
 extern Bool VG_(in_generated_code);
 
+/* Make the running thread leave generated code at the event check of
+   the next block it enters, without ending its timeslice early. */
+extern void VG_(leave_generated_code_soon) ( void );
+
 /* Sanity checks which may be done at any time.  The scheduler decides when. */
 extern void VG_(sanity_check_general) ( Bool force_expensive );
 
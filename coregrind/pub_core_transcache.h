@@ -0,0 +1,73 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Translations kept across runs.         pub_core_transcache.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_TRANSCACHE_H
+#define __PUB_CORE_TRANSCACHE_H
+
+//--------------------------------------------------------------------
+// PURPOSE: The persistent translation cache (--persistent-tc=<dir>).
+// Translations of client code in file mappings are saved to a file at
+// exit, and put back into the translation table instead of being made
+// again by VEX in later runs.
+//
+// A cache file is only used by runs of the same Valgrind tool binary,
+// with the same options, on the same host and client executable.  A
+// saved translation is only reused if the guest code it was made from
+// is mapped at the same address and has the same contents.
+//--------------------------------------------------------------------
+
+#include "pub_core_basics.h"
+#include "libvex.h"
+
+// Reads the cache file, if --persistent-tc is given and the tool
+// declared VG_(needs_persistent_translations).
+extern void VG_(init_transcache) ( void );
+
+// Writes the cache file.
+extern void VG_(save_transcache) ( void );
+
+// Adds the saved translation of 'nraddr' to the translation table, if
+// there is one that was made from 'addr' for the same 'kind' of
+// redirection and that is still valid.  Returns True if it did.
+extern Bool VG_(transcache_install) ( Addr nraddr, Addr addr, UInt kind );
+
+// Keeps a copy of a new translation, to be saved at exit.  The
+// arguments are those of VG_(add_to_transtab).
+extern void VG_(transcache_record) ( Addr nraddr, Addr addr, UInt kind,
+                                     const VexGuestExtents* vge,
+                                     const UChar* code, UInt code_len,
+                                     Bool is_self_checking,
+                                     Int offs_profInc,
+                                     UInt n_guest_instrs );
+
+extern void VG_(print_transcache_stats) ( void );
+
+#endif   // __PUB_CORE_TRANSCACHE_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
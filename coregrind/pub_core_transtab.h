@@ -51,7 +51,16 @@ typedef
    FastCacheEntry;
 
 extern __attribute__((aligned(16)))
-       FastCacheEntry VG_(tt_fast) [VG_TT_FAST_SIZE];
+       FastCacheEntry VG_(tt_fast) [VG_TT_FAST_WAYS][VG_TT_FAST_SIZE];
+
+/* Mask giving the entry number in each way, 2^VG_(clo_fast_cache_bits)
+   - 1.  Only read by the dispatcher on x86/amd64. */
+extern UWord VG_(tt_fast_mask);
+
+/* Number of times the oldest sector has been emptied for reuse.  Host
+   code addresses taken before a translation is made are not valid
+   after it if this has changed. */
+extern ULong VG_(get_sectors_recycled) ( void );
 
 #define TRANSTAB_BOGUS_GUEST_ADDR ((Addr)1)
 
@@ -113,6 +122,11 @@ extern Bool VG_(search_transtab) ( /*OUT*/Addr*  res_hcode,
 extern void VG_(discard_translations) ( Addr  start, ULong range,
                                         const HChar* who );
 
+/* Carry out the discard asked for with
+   VG_(request_discard_translations), if any.  Called by the scheduler
+   before it runs generated code. */
+extern void VG_(do_requested_discards) ( void );
+
 extern void VG_(print_tt_tc_stats) ( void );
 
 extern UInt VG_(get_bbs_translated) ( void );
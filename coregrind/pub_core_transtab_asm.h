@@ -31,8 +31,16 @@
 #ifndef __PUB_CORE_TRANSTAB_ASM_H
 #define __PUB_CORE_TRANSTAB_ASM_H
 
-/* Constants for the fast translation lookup cache.  It is a direct
-   mapped cache, with 2^VG_TT_FAST_BITS entries.
+/* Constants for the fast translation lookup cache.  It is a set
+   associative cache, with VG_TT_FAST_WAYS ways of 2^VG_TT_FAST_BITS
+   entries each.  The ways are stored one after another, each taking
+   VG_TT_FAST_SIZE entries; entry i of way w is VG_(tt_fast)[w][i].
+
+   On x86/amd64 the cache has 2 ways, and the number of entries in use
+   in each is set at startup (--fast-cache-bits), so the dispatcher
+   takes the mask from VG_(tt_fast_mask).  On the other targets it is
+   direct mapped with a fixed size, and the dispatcher uses
+   VG_TT_FAST_MASK.
 
    On x86/amd64, the cache index is computed as
    'address[VG_TT_FAST_BITS-1 : 0]'.
@@ -49,25 +57,36 @@
    On s390x the rightmost bit of an instruction address is zero.
    For best table utilization shift the address to the right by 1 bit. */
 
-#define VG_TT_FAST_BITS 15
-#define VG_TT_FAST_SIZE (1 << VG_TT_FAST_BITS)
+#define VG_TT_FAST_BITS 15   /* default */
+
+#if defined(VGA_x86) || defined(VGA_amd64)
+#  define VG_TT_FAST_WAYS     2
+#  define VG_TT_FAST_MIN_BITS 12
+#  define VG_TT_FAST_MAX_BITS 18
+#else
+#  define VG_TT_FAST_WAYS     1
+#  define VG_TT_FAST_MIN_BITS VG_TT_FAST_BITS
+#  define VG_TT_FAST_MAX_BITS VG_TT_FAST_BITS
+#endif
+
+#define VG_TT_FAST_SIZE (1 << VG_TT_FAST_MAX_BITS)
 #define VG_TT_FAST_MASK ((VG_TT_FAST_SIZE) - 1)
 
 /* This macro isn't usable in asm land; nevertheless this seems
    like a good place to put it. */
 
 #if defined(VGA_x86) || defined(VGA_amd64)
-#  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr))     ) & VG_TT_FAST_MASK)
+#  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr))     ) & VG_(tt_fast_mask))
 
 #elif defined(VGA_s390x) || defined(VGA_arm)
-#  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr)) >> 1) & VG_TT_FAST_MASK)
+#  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr)) >> 1) & VG_(tt_fast_mask))
 
 #elif defined(VGA_ppc32) || defined(VGA_ppc64be) || defined(VGA_ppc64le) \
       || defined(VGA_mips32) || defined(VGA_mips64) || defined(VGA_arm64)
-#  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr)) >> 2) & VG_TT_FAST_MASK)
+#  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr)) >> 2) & VG_(tt_fast_mask))
 
 #elif defined(VGA_tilegx)
-#  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr)) >> 3) & VG_TT_FAST_MASK)
+#  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr)) >> 3) & VG_(tt_fast_mask))
 
 #else
 #  error "VG_TT_FAST_HASH: unknown platform"
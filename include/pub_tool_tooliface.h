@@ -497,6 +497,13 @@ extern void VG_(needs_xml_output) ( void );
    function here. */
 extern void VG_(needs_final_IR_tidy_pass) ( IRSB*(*final_tidy)(IRSB*) );
 
+/* Can translations made in one run be reused by later runs of the tool
+   with the same options (--persistent-tc)?  Only if the instrumentation
+   depends on nothing but the guest code and the command line options;
+   in particular it must not put addresses of the tool's own data, or
+   values known only in this run, into the code. */
+extern void VG_(needs_persistent_translations) ( void );
+
 
 /* ------------------------------------------------------------------ */
 /* Core events to track */
@@ -36,6 +36,15 @@
 void VG_(discard_translations_safely) ( Addr  start, SizeT len,
                                         const HChar* who );
 
+/* Discard translations as soon as it is safe to do so.  Unlike
+   VG_(discard_translations_safely), this may be called at any time,
+   including from helpers called by generated code.  The running thread
+   leaves generated code at its next block boundary, and the
+   translations are discarded before any more code runs.  Requests made
+   in between are merged into one discard. */
+void VG_(request_discard_translations) ( Addr  start, SizeT len,
+                                         const HChar* who );
+
 #endif   // __PUB_TOOL_TRANSTAB_H
 
 /*--------------------------------------------------------------------*/
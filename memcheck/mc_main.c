@@ -7805,6 +7805,11 @@ static void mc_post_clo_init ( void )
 #     endif
       VG_(track_new_mem_stack)     ( mc_new_mem_stack     );
       VG_(track_new_mem_stack_signal) ( mc_new_mem_w_tid_no_ECU );
+
+      /* Origin tracking puts ExeContext uniques, which are only
+         meaningful in this run, into the code for stack pointer
+         changes.  Without it, translations can be kept. */
+      VG_(needs_persistent_translations)();
    }
 
    // We assume that brk()/sbrk() does not initialise new memory.  Is this
@@ -0,0 +1,77 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// mutex provides many short scheduling quanta: a number of threads
+// contend on one mutex, with a tiny critical section, and yield after
+// each unlock.  Under Valgrind this makes the tool see a thread switch
+// every few basic blocks, so it measures the cost of thread switch
+// handling in tools rather than the cost of the code being run.
+
+static int nr_thr = 8;       // nr of threads
+static int nr_loops = 20000; // nr of lock/unlock pairs per thread
+static int verbose = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static long counter = 0;
+
+static void *mutex_fn(void *v)
+{
+   int loops;
+   long local = 0;
+
+   for (loops = 0; loops < nr_loops; loops++) {
+      pthread_mutex_lock(&lock);
+      counter++;
+      local += counter & 1;
+      pthread_mutex_unlock(&lock);
+      sched_yield();
+   }
+   return (void *)local;
+}
+
+int main (int argc, char *argv[])
+{
+   int a, t;
+   pthread_t *thr;
+   long odd = 0;
+   void *res;
+
+   while ((a = getopt(argc, argv, "t:l:v")) != -1) {
+      switch (a) {
+      case 't': nr_thr = atoi(optarg); break;
+      case 'l': nr_loops = atoi(optarg); break;
+      case 'v': verbose++; break;
+      default:
+         printf("usage: mutex [-t nr_threads] [-l nr_loops] [-v]\n");
+         exit(1);
+      }
+   }
+
+   if (verbose)
+      printf("%d threads, %d lock/unlock pairs each\n", nr_thr, nr_loops);
+
+   thr = malloc(nr_thr * sizeof(pthread_t));
+   for (t = 0; t < nr_thr; t++) {
+      if (pthread_create(&thr[t], NULL, mutex_fn, NULL) != 0) {
+         perror("pthread_create");
+         exit(1);
+      }
+   }
+   for (t = 0; t < nr_thr; t++) {
+      pthread_join(thr[t], &res);
+      odd += (long)res;
+   }
+   free(thr);
+
+   if (counter != (long)nr_thr * nr_loops) {
+      printf("counter %ld, expected %ld\n", counter, (long)nr_thr * nr_loops);
+      return 1;
+   }
+   if (verbose)
+      printf("counter %ld, odd %ld\n", counter, odd);
+   return 0;
+}
@@ -147,6 +147,13 @@ static BB* new_bb(obj_node* obj, PtrdiffT offset,
    bb->is_entry    = 0;
    bb->bbcc_list   = 0;
    bb->last_bbcc   = 0;
+   bb->ev_template = 0;
+   bb->ev_count    = 0;
+   bb->def         = 0;
+   bb->def_size    = 0;
+   bb->def_sent    = False;
+   bb->ind_exit    = False;
+   bb->branch_def_sent = False;
 
    /* insert into BB hash table */
    idx = bb_hash_idx(obj, offset, bbs.size);
@@ -337,6 +344,10 @@ void CLG_(delete_bb)(Addr addr)
 	size = sizeof(BB)
 	    + bb->instr_count * sizeof(InstrInfo)
 	    + (bb->cjmp_count+1) * sizeof(CJmpInfo);
+	if (bb->ev_template)
+	    CLG_FREE(bb->ev_template);
+	if (bb->def)
+	    CLG_FREE(bb->def);
 	VG_(memset)( bb, 0xAA, size );
 	CLG_FREE(bb);
 	return;
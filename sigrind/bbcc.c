@@ -27,6 +27,7 @@
 */
 
 #include "global.h"
+#include "log_events.h"
 
 #include "pub_tool_threadstate.h"
 
@@ -37,7 +38,7 @@
 #define N_BBCC_INITIAL_ENTRIES  10437
 
 /* BBCC table (key is BB/Context), per thread, resizable */
-bbcc_hash current_bbccs;
+static bbcc_hash* current_bbccs = 0;
 
 void CLG_(init_bbcc_hash)(bbcc_hash* bbccs)
 {
@@ -53,27 +54,16 @@ void CLG_(init_bbcc_hash)(bbcc_hash* bbccs)
    for (i = 0; i < bbccs->size; i++) bbccs->table[i] = NULL;
 }
 
-void CLG_(copy_current_bbcc_hash)(bbcc_hash* dst)
-{
-  CLG_ASSERT(dst != 0);
-
-  dst->size    = current_bbccs.size;
-  dst->entries = current_bbccs.entries;
-  dst->table   = current_bbccs.table;
-}
-
 bbcc_hash* CLG_(get_current_bbcc_hash)()
 {
-  return &current_bbccs;
+  return current_bbccs;
 }
 
 void CLG_(set_current_bbcc_hash)(bbcc_hash* h)
 {
   CLG_ASSERT(h != 0);
 
-  current_bbccs.size    = h->size;
-  current_bbccs.entries = h->entries;
-  current_bbccs.table   = h->table;
+  current_bbccs = h;
 }
 
 /*
@@ -108,8 +98,8 @@ void CLG_(forall_bbccs)(void (*func)(BBCC*))
   BBCC *bbcc, *bbcc2;
   int i, j;
 	
-  for (i = 0; i < current_bbccs.size; i++) {
-    if ((bbcc=current_bbccs.table[i]) == NULL) continue;
+  for (i = 0; i < current_bbccs->size; i++) {
+    if ((bbcc=current_bbccs->table[i]) == NULL) continue;
     while (bbcc) {
       /* every bbcc should have a rec_array */
       CLG_ASSERT(bbcc->rec_array != 0);
@@ -164,8 +154,8 @@ BBCC* lookup_bbcc(BB* bb, Context* cxt)
 
    CLG_(stat).bbcc_lru_misses++;
 
-   idx = bbcc_hash_idx(bb, cxt, current_bbccs.size);
-   bbcc = current_bbccs.table[idx];
+   idx = bbcc_hash_idx(bb, cxt, current_bbccs->size);
+   bbcc = current_bbccs->table[idx];
    while (bbcc &&
 	  (bb      != bbcc->bb ||
 	   cxt     != bbcc->cxt)) {
@@ -191,17 +181,17 @@ static void resize_bbcc_hash(void)
     UInt new_idx;
     BBCC *curr_BBCC, *next_BBCC;
 
-    new_size = 2*current_bbccs.size+3;
+    new_size = 2*current_bbccs->size+3;
     new_table = (BBCC**) CLG_MALLOC("cl.bbcc.rbh.1",
                                     new_size * sizeof(BBCC*));
  
     for (i = 0; i < new_size; i++)
       new_table[i] = NULL;
  
-    for (i = 0; i < current_bbccs.size; i++) {
-	if (current_bbccs.table[i] == NULL) continue;
+    for (i = 0; i < current_bbccs->size; i++) {
+	if (current_bbccs->table[i] == NULL) continue;
  
-	curr_BBCC = current_bbccs.table[i];
+	curr_BBCC = current_bbccs->table[i];
 	while (NULL != curr_BBCC) {
 	    next_BBCC = curr_BBCC->next;
 
@@ -221,15 +211,15 @@ static void resize_bbcc_hash(void)
 	}
     }
 
-    VG_(free)(current_bbccs.table);
+    VG_(free)(current_bbccs->table);
 
 
     CLG_DEBUG(0,"Resize BBCC Hash: %u => %d (entries %u, conflicts %d/%d)\n",
-	     current_bbccs.size, new_size,
-	     current_bbccs.entries, conflicts1, conflicts2);
+	     current_bbccs->size, new_size,
+	     current_bbccs->entries, conflicts1, conflicts2);
 
-    current_bbccs.size = new_size;
-    current_bbccs.table = new_table;
+    current_bbccs->size = new_size;
+    current_bbccs->table = new_table;
     CLG_(stat).bbcc_hash_resizes++;
 }
 
@@ -315,16 +305,16 @@ void insert_bbcc_into_hash(BBCC* bbcc)
 	     bb_addr(bbcc->bb), bbcc->cxt->fn[0]->name);
 
     /* check fill degree of hash and resize if needed (>90%) */
-    current_bbccs.entries++;
-    if (100 * current_bbccs.entries / current_bbccs.size > 90)
+    current_bbccs->entries++;
+    if (100 * current_bbccs->entries / current_bbccs->size > 90)
 	resize_bbcc_hash();
 
-    idx = bbcc_hash_idx(bbcc->bb, bbcc->cxt, current_bbccs.size);
-    bbcc->next = current_bbccs.table[idx];
-    current_bbccs.table[idx] = bbcc;
+    idx = bbcc_hash_idx(bbcc->bb, bbcc->cxt, current_bbccs->size);
+    bbcc->next = current_bbccs->table[idx];
+    current_bbccs->table[idx] = bbcc;
 
     CLG_DEBUG(3,"- insert_bbcc_into_hash: %u entries\n",
-	     current_bbccs.entries);
+	     current_bbccs->entries);
 }
 
 /* String is returned in a dynamically allocated buffer. Caller is
@@ -500,7 +490,7 @@ static void handleUnderflow(BB* bb)
     source_bbcc->ecounter_sum++;
   
   /* Force a new top context, will be set active by push_cxt() */
-  CLG_(current_fn_stack).top--;
+  CLG_(current_fn_stack)->top--;
   CLG_(current_state).cxt = 0;
   caller = CLG_(get_fn_node)(bb);
   CLG_(push_cxt)( caller );
@@ -584,6 +574,10 @@ void CLG_(setup_bbcc)(BB* bb)
       jmpkind = last_bb->jmp[passed].jmpkind;
       isConditionalJump = (passed < last_bb->cjmp_count);
 
+      /* before any call/return events for this BB */
+      if (SGL_(clo).gen_cf == True)
+        SGL_(log_branches)(last_bb, passed, bb_addr(bb));
+
       CLG_DEBUGIF(4) {
       }
   }
@@ -594,12 +588,12 @@ void CLG_(setup_bbcc)(BB* bb)
 
   /* Manipulate JmpKind if needed, only using BB specific info */
 
-  csp = CLG_(current_call_stack).sp;
+  csp = CLG_(current_call_stack)->sp;
 
   /* A return not matching the top call in our callstack is a jump */
   if ( (jmpkind == jk_Return) && (csp >0)) {
       Int csp_up = csp-1;      
-      call_entry* top_ce = &(CLG_(current_call_stack).entry[csp_up]);
+      call_entry* top_ce = &(CLG_(current_call_stack)->entry[csp_up]);
 
       /* We have a real return if
        * - the stack pointer (SP) left the current stack frame, or
@@ -616,7 +610,7 @@ void CLG_(setup_bbcc)(BB* bb)
 	      if (top_ce->ret_addr == bb_addr(bb)) break;
 	      if (csp_up>0) {
 		  csp_up--;
-		  top_ce = &(CLG_(current_call_stack).entry[csp_up]);
+		  top_ce = &(CLG_(current_call_stack)->entry[csp_up]);
 		  if (top_ce->sp == sp) {
 		      popcount_on_return++;
 		      continue; 
@@ -661,7 +655,7 @@ void CLG_(setup_bbcc)(BB* bb)
 
 	if (CLG_(get_fn_node)(last_bb)->pop_on_jump && (csp>0)) {
 
-	    call_entry* top_ce = &(CLG_(current_call_stack).entry[csp-1]);
+	    call_entry* top_ce = &(CLG_(current_call_stack)->entry[csp-1]);
 	    
 	    if (top_ce->jcc) {
 
@@ -706,8 +700,8 @@ void CLG_(setup_bbcc)(BB* bb)
   if (jmpkind == jk_Return) {
     
     if ((csp == 0) || 
-	((CLG_(current_fn_stack).top > CLG_(current_fn_stack).bottom) &&
-	 ( *(CLG_(current_fn_stack).top-1)==0)) ) {
+	((CLG_(current_fn_stack)->top > CLG_(current_fn_stack)->bottom) &&
+	 ( *(CLG_(current_fn_stack)->top-1)==0)) ) {
 
       /* On an empty call stack or at a signal separation marker,
        * a RETURN generates an call stack underflow.
@@ -730,9 +724,9 @@ void CLG_(setup_bbcc)(BB* bb)
     if (jmpkind == jk_Call) {
       delayed_push = True;
 
-      csp = CLG_(current_call_stack).sp;
+      csp = CLG_(current_call_stack)->sp;
       if (call_emulation && csp>0)
-	sp = CLG_(current_call_stack).entry[csp-1].sp;	
+	sp = CLG_(current_call_stack)->entry[csp-1].sp;	
 
     }
   }
@@ -741,7 +735,7 @@ void CLG_(setup_bbcc)(BB* bb)
   if ((delayed_push && !skip) || (CLG_(current_state).cxt == 0)) {
     CLG_(push_cxt)(CLG_(get_fn_node)(bb));
   }
-  CLG_ASSERT(CLG_(current_fn_stack).top > CLG_(current_fn_stack).bottom);
+  CLG_ASSERT(CLG_(current_fn_stack)->top > CLG_(current_fn_stack)->bottom);
   
   /* If there is a fresh instrumented BBCC, assign current context */
   bbcc = CLG_(get_bbcc)(bb);
@@ -750,7 +744,7 @@ void CLG_(setup_bbcc)(BB* bb)
       
     bbcc->cxt = CLG_(current_state).cxt;
     bbcc->rec_array = 
-      new_recursion((*CLG_(current_fn_stack).top)->separate_recursions);
+      new_recursion((*CLG_(current_fn_stack)->top)->separate_recursions);
     bbcc->rec_array[0] = bbcc;
       
     insert_bbcc_into_hash(bbcc);
@@ -782,9 +776,9 @@ void CLG_(setup_bbcc)(BB* bb)
   if (last_bbcc)
     last_bbcc->lru_next_bbcc = bbcc;
 
-  if ((*CLG_(current_fn_stack).top)->separate_recursions >1) {
+  if ((*CLG_(current_fn_stack)->top)->separate_recursions >1) {
     UInt level, idx;
-    fn_node* top = *(CLG_(current_fn_stack).top);
+    fn_node* top = *(CLG_(current_fn_stack)->top);
 
     level = *CLG_(get_fn_entry)(top->number);
 
@@ -868,5 +862,10 @@ void CLG_(setup_bbcc)(BB* bb)
     CLG_(print_cxt)(-8, CLG_(current_state).cxt, bbcc->rec_index);
   CLG_DEBUG(3,"\n");
   
+  if (SGL_(clo).sample_on > 0)
+    SGL_(sample_block)(bb);
+  if (SGL_(clo).gen_bb == True)
+    SGL_(log_bb)(bb);
+
   CLG_(stat).bb_executions++;
 }
@@ -126,7 +126,19 @@ typedef
       VG_USERREQ__SIGIL_GOMP_TEAMBARRIERWAIT_ENTER,
       VG_USERREQ__SIGIL_GOMP_TEAMBARRIERWAIT_LEAVE,
       VG_USERREQ__SIGIL_GOMP_TEAMBARRIERWAITFINAL_ENTER,
-      VG_USERREQ__SIGIL_GOMP_TEAMBARRIERWAITFINAL_LEAVE
+      VG_USERREQ__SIGIL_GOMP_TEAMBARRIERWAITFINAL_LEAVE,
+
+      VG_USERREQ__SIGIL_SYNC_FAILED,
+      VG_USERREQ__SIGIL_PTHREAD_RDLOCK_ENTER,
+      VG_USERREQ__SIGIL_PTHREAD_RDLOCK_LEAVE,
+      VG_USERREQ__SIGIL_PTHREAD_WRLOCK_ENTER,
+      VG_USERREQ__SIGIL_PTHREAD_WRLOCK_LEAVE,
+      VG_USERREQ__SIGIL_PTHREAD_RWUNLOCK_ENTER,
+      VG_USERREQ__SIGIL_PTHREAD_RWUNLOCK_LEAVE,
+      VG_USERREQ__SIGIL_SEM_WAIT_ENTER,
+      VG_USERREQ__SIGIL_SEM_WAIT_LEAVE,
+      VG_USERREQ__SIGIL_SEM_POST_ENTER,
+      VG_USERREQ__SIGIL_SEM_POST_LEAVE
    } Vg_CallgrindClientRequest;
 
 /* Dump current state of cost centers, and zero them afterwards */
@@ -360,4 +372,51 @@ typedef
   VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_GOMP_TEAMBARRIERWAITFINAL_LEAVE,     \
                                   bar, 0, 0, 0, 0)
 
+
+/* Ends a call started with an _ENTER request that failed (e.g. a try
+   lock), without sending an event */
+#define SIGIL_SYNC_FAILED(obj) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_SYNC_FAILED,     \
+                                  obj, 0, 0, 0, 0)
+
+
+#define SIGIL_PTHREAD_RDLOCK_ENTER(rw) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_PTHREAD_RDLOCK_ENTER,     \
+                                  rw, 0, 0, 0, 0)
+#define SIGIL_PTHREAD_RDLOCK_LEAVE(rw) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_PTHREAD_RDLOCK_LEAVE,     \
+                                  rw, 0, 0, 0, 0)
+
+
+#define SIGIL_PTHREAD_WRLOCK_ENTER(rw) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_PTHREAD_WRLOCK_ENTER,     \
+                                  rw, 0, 0, 0, 0)
+#define SIGIL_PTHREAD_WRLOCK_LEAVE(rw) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_PTHREAD_WRLOCK_LEAVE,     \
+                                  rw, 0, 0, 0, 0)
+
+
+#define SIGIL_PTHREAD_RWUNLOCK_ENTER(rw) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_PTHREAD_RWUNLOCK_ENTER,     \
+                                  rw, 0, 0, 0, 0)
+#define SIGIL_PTHREAD_RWUNLOCK_LEAVE(rw) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_PTHREAD_RWUNLOCK_LEAVE,     \
+                                  rw, 0, 0, 0, 0)
+
+
+#define SIGIL_SEM_WAIT_ENTER(sem) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_SEM_WAIT_ENTER,     \
+                                  sem, 0, 0, 0, 0)
+#define SIGIL_SEM_WAIT_LEAVE(sem) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_SEM_WAIT_LEAVE,     \
+                                  sem, 0, 0, 0, 0)
+
+
+#define SIGIL_SEM_POST_ENTER(sem) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_SEM_POST_ENTER,     \
+                                  sem, 0, 0, 0, 0)
+#define SIGIL_SEM_POST_LEAVE(sem) \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__SIGIL_SEM_POST_LEAVE,     \
+                                  sem, 0, 0, 0, 0)
+
 #endif /* __CALLGRIND_H */
@@ -34,7 +34,8 @@
 /*--- Call stack, operations                               ---*/
 /*------------------------------------------------------------*/
 
-/* Stack of current thread. Gets initialized when switching to 1st thread.
+/* Stack of current thread, points into its thread_info.
+ * Gets initialized when switching to 1st thread.
  *
  * The artificial call stack is an array of call_entry's, representing
  * stack frames of the executing program. 
@@ -45,7 +46,7 @@
 
 #define N_CALL_STACK_INITIAL_ENTRIES 500
 
-call_stack CLG_(current_call_stack);
+call_stack* CLG_(current_call_stack) = 0;
 
 void CLG_(init_call_stack)(call_stack* s)
 {
@@ -60,33 +61,22 @@ void CLG_(init_call_stack)(call_stack* s)
 
 call_entry* CLG_(get_call_entry)(Int sp)
 {
-  CLG_ASSERT(sp <= CLG_(current_call_stack).sp);
-  return &(CLG_(current_call_stack).entry[sp]);
-}
-
-void CLG_(copy_current_call_stack)(call_stack* dst)
-{
-  CLG_ASSERT(dst != 0);
-
-  dst->size  = CLG_(current_call_stack).size;
-  dst->entry = CLG_(current_call_stack).entry;
-  dst->sp    = CLG_(current_call_stack).sp;
+  CLG_ASSERT(sp <= CLG_(current_call_stack)->sp);
+  return &(CLG_(current_call_stack)->entry[sp]);
 }
 
 void CLG_(set_current_call_stack)(call_stack* s)
 {
   CLG_ASSERT(s != 0);
 
-  CLG_(current_call_stack).size  = s->size;
-  CLG_(current_call_stack).entry = s->entry;
-  CLG_(current_call_stack).sp    = s->sp;
+  CLG_(current_call_stack) = s;
 }
 
 
 static __inline__
 void ensure_stack_size(Int i)
 {
-  call_stack *cs = &CLG_(current_call_stack);
+  call_stack *cs = CLG_(current_call_stack);
 
   if (i < cs->size) return;
 
@@ -101,35 +91,46 @@ void ensure_stack_size(Int i)
  
   CLG_DEBUGIF(2)
     VG_(printf)("        call stack enlarged to %u entries\n",
-		CLG_(current_call_stack).size);
+		CLG_(current_call_stack)->size);
+}
+
+
+/* Nesting depth of functions with collect_in set (--at-func,
+ * --collect-in), so that only leaving the outermost one ends collection */
+static UInt collect_in_depth = 0;
+
+static void start_collection(fn_node* fn)
+{
+  VG_(umsg)("*********************************************\n");
+  VG_(umsg)("Entering %s: turning on event collection\n", fn->name);
+  VG_(umsg)("*********************************************\n");
+  SGL_(is_in_event_collect_func) = True;
+  SGL_(set_fast_forward)(False);
+
+  // let Sigil2 know which thread this function starts in
+  SGL_(log_sync)(SGLPRIM_SYNC_SWAP, SGL_(active_tid), UNUSED_SYNC_DATA);
 }
 
+static void stop_collection(fn_node* fn)
+{
+  VG_(umsg)("*********************************************\n");
+  VG_(umsg)("Leaving %s: turning off event collection\n", fn->name);
+  VG_(umsg)("*********************************************\n");
+  SGL_(is_in_event_collect_func) = False;
+}
 
 /* Called when function entered nonrecursive */
 static void function_entered(fn_node* fn)
 {
   CLG_ASSERT(fn != 0);
 
-  if ( (SGL_(clo).collect_func != NULL) && (VG_(strcmp)(fn->name, SGL_(clo).collect_func) == 0) )
-  {
-    VG_(umsg)("*********************************************\n");
-    VG_(umsg)("Entering %s: turning on event collection\n", fn->name);
-    VG_(umsg)("*********************************************\n");
-    SGL_(is_in_event_collect_func) = True;
-
-    // let Sigil2 know which thread this function starts in
-    SGL_(log_sync)(SGLPRIM_SYNC_SWAP, SGL_(active_tid), UNUSED_SYNC_DATA);
-  }
-  else if ( (SGL_(clo).start_collect_func != NULL) && (VG_(strcmp)(fn->name, SGL_(clo).start_collect_func) == 0) )
-  {
-    VG_(umsg)("*********************************************\n");
-    VG_(umsg)("Entering %s: turning on event collection\n", fn->name);
-    VG_(umsg)("*********************************************\n");
-    SGL_(is_in_event_collect_func) = True;
-
-    // let Sigil2 know which thread this function starts in
-    SGL_(log_sync)(SGLPRIM_SYNC_SWAP, SGL_(active_tid), UNUSED_SYNC_DATA);
+  /* flags are resolved once per function, see SGL_(update_fn_collect) */
+  if (fn->collect_in) {
+    if (collect_in_depth++ == 0)
+      start_collection(fn);
   }
+  else if (fn->collect_start)
+    start_collection(fn);
 
   /* send to sigil */
   SGL_(log_fn_entry)(fn);
@@ -154,19 +155,15 @@ static void function_left(fn_node* fn)
   /*send to sigil*/
   SGL_(log_fn_leave)(fn);
 
-  if ( (SGL_(clo).collect_func != NULL) && (VG_(strcmp)(fn->name, SGL_(clo).collect_func) == 0) )
-  {
-    VG_(umsg)("*********************************************\n");
-    VG_(umsg)("Leaving %s: turning off event collection\n", fn->name);
-    VG_(umsg)("*********************************************\n");
-    SGL_(is_in_event_collect_func) = False;
+  if (fn->collect_in) {
+    if (collect_in_depth > 0 && --collect_in_depth == 0)
+      stop_collection(fn);
   }
-  else if ( (SGL_(clo).stop_collect_func != NULL) && (VG_(strcmp)(fn->name, SGL_(clo).stop_collect_func) == 0) )
-  {
-    VG_(umsg)("*********************************************\n");
-    VG_(umsg)("Leaving %s: turning off event collection\n", fn->name);
-    VG_(umsg)("*********************************************\n");
-    SGL_(is_in_event_collect_func) = False;
+  else if (fn->collect_stop) {
+    stop_collection(fn);
+
+    /* not for --at-func, which would retranslate on every call */
+    SGL_(set_fast_forward)(True);
   }
 
 #if CLG_ENABLE_DEBUG
@@ -200,8 +197,8 @@ void CLG_(push_call_stack)(BBCC* from, UInt jmp, BBCC* to, Addr sp, Bool skip)
      * The +1 is needed as push_cxt will store the
      * context at [current_sp]
      */
-    ensure_stack_size(CLG_(current_call_stack).sp +1);
-    current_entry = &(CLG_(current_call_stack).entry[CLG_(current_call_stack).sp]);
+    ensure_stack_size(CLG_(current_call_stack)->sp +1);
+    current_entry = &(CLG_(current_call_stack)->entry[CLG_(current_call_stack)->sp]);
 
     if (skip) {
 	jcc = 0;
@@ -254,10 +251,10 @@ void CLG_(push_call_stack)(BBCC* from, UInt jmp, BBCC* to, Addr sp, Bool skip)
     current_entry->ret_addr = ret_addr;
     current_entry->nonskipped = CLG_(current_state).nonskipped;
 
-    CLG_(current_call_stack).sp++;
+    CLG_(current_call_stack)->sp++;
 
     /* To allow for above assertion we set context of next frame to 0 */
-    CLG_ASSERT(CLG_(current_call_stack).sp < CLG_(current_call_stack).size);
+    CLG_ASSERT(CLG_(current_call_stack)->sp < CLG_(current_call_stack)->size);
     current_entry++;
     current_entry->cxt = 0;
 
@@ -281,7 +278,7 @@ void CLG_(push_call_stack)(BBCC* from, UInt jmp, BBCC* to, Addr sp, Bool skip)
 				  " .   .   .   .   .   .   .   .   .   .  ",
 				  ".   .   .   .   .   .   .   .   .   .   " };
 
-	    int s = CLG_(current_call_stack).sp;
+	    int s = CLG_(current_call_stack)->sp;
 	    UInt* pars = (UInt*) sp;
 
 	    BB* bb = jcc->to->bb;
@@ -294,12 +291,12 @@ void CLG_(push_call_stack)(BBCC* from, UInt jmp, BBCC* to, Addr sp, Bool skip)
 	  }
 	}
 	else if (CLG_(clo).verbose<4) {
-	    VG_(printf)("+ %2d ", CLG_(current_call_stack).sp);
+	    VG_(printf)("+ %2d ", CLG_(current_call_stack)->sp);
 	    VG_(printf)(", SP %#lx, RA %#lx\n", sp, ret_addr);
 	}
 	else {
 	    VG_(printf)("  Pushed ");
-	    CLG_(print_stackentry)(3, CLG_(current_call_stack).sp-1);
+	    CLG_(print_stackentry)(3, CLG_(current_call_stack)->sp-1);
 	}
     }
 #endif
@@ -325,10 +322,10 @@ void CLG_(pop_call_stack)()
     }
 
     lower_entry =
-	&(CLG_(current_call_stack).entry[CLG_(current_call_stack).sp-1]);
+	&(CLG_(current_call_stack)->entry[CLG_(current_call_stack)->sp-1]);
 
     CLG_DEBUG(4,"+ pop_call_stack: frame %d, jcc %p\n", 
-		CLG_(current_call_stack).sp, lower_entry->jcc);
+		CLG_(current_call_stack)->sp, lower_entry->jcc);
 
     /* jCC item not any more on real stack: pop */
     jcc = lower_entry->jcc;
@@ -346,8 +343,8 @@ void CLG_(pop_call_stack)()
 
 	/* restore context */
 	CLG_(current_state).cxt  = lower_entry->cxt;
-	CLG_(current_fn_stack).top =
-	  CLG_(current_fn_stack).bottom + lower_entry->fn_sp;
+	CLG_(current_fn_stack)->top =
+	  CLG_(current_fn_stack)->bottom + lower_entry->fn_sp;
 	CLG_ASSERT(CLG_(current_state).cxt != 0);
 
 	if (depth == 0) function_left(to_fn);
@@ -356,7 +353,7 @@ void CLG_(pop_call_stack)()
     /* To allow for an assertion in push_call_stack() */
     lower_entry->cxt = 0;
 
-    CLG_(current_call_stack).sp--;
+    CLG_(current_call_stack)->sp--;
 
 #if CLG_ENABLE_DEBUG
     CLG_DEBUGIF(1) {
@@ -364,20 +361,20 @@ void CLG_(pop_call_stack)()
 	    if (jcc) {
 		/* popped JCC target first */
 		VG_(printf)("- %2d %#lx => ",
-			    CLG_(current_call_stack).sp,
+			    CLG_(current_call_stack)->sp,
 			    bb_addr(jcc->to->bb));
 		CLG_(print_addr)(bb_jmpaddr(jcc->from->bb));
 		VG_(printf)(", SP %#lx\n",
-			    CLG_(current_call_stack).entry[CLG_(current_call_stack).sp].sp);
+			    CLG_(current_call_stack)->entry[CLG_(current_call_stack)->sp].sp);
 	    }
 	    else
 		VG_(printf)("- %2d [Skipped JCC], SP %#lx\n",
-			    CLG_(current_call_stack).sp,
-			    CLG_(current_call_stack).entry[CLG_(current_call_stack).sp].sp);
+			    CLG_(current_call_stack)->sp,
+			    CLG_(current_call_stack)->entry[CLG_(current_call_stack)->sp].sp);
 	}
 	else {
 	    VG_(printf)("  Popped ");
-	    CLG_(print_stackentry)(7, CLG_(current_call_stack).sp);
+	    CLG_(print_stackentry)(7, CLG_(current_call_stack)->sp);
 	    if (jcc) {
 		VG_(printf)("       returned to ");
 		CLG_(print_addr_ln)(bb_jmpaddr(jcc->from->bb));
@@ -397,7 +394,7 @@ Int CLG_(unwind_call_stack)(Addr sp, Int minpops)
     Int csp;
     Int unwind_count = 0;
     CLG_DEBUG(4,"+ unwind_call_stack(sp %#lx, minpops %d): frame %d\n",
-	      sp, minpops, CLG_(current_call_stack).sp);
+	      sp, minpops, CLG_(current_call_stack)->sp);
 
     /* We pop old stack frames.
      * For a call, be p the stack address with return address.
@@ -405,8 +402,8 @@ Int CLG_(unwind_call_stack)(Addr sp, Int minpops)
      *  - current sp is after a RET: >= p
      */
     
-    while( (csp=CLG_(current_call_stack).sp) >0) {
-	call_entry* top_ce = &(CLG_(current_call_stack).entry[csp-1]);
+    while( (csp=CLG_(current_call_stack)->sp) >0) {
+	call_entry* top_ce = &(CLG_(current_call_stack)->entry[csp-1]);
 
 	if ((top_ce->sp < sp) ||
 	    ((top_ce->sp == sp) && minpops>0)) {
@@ -414,7 +411,7 @@ Int CLG_(unwind_call_stack)(Addr sp, Int minpops)
 	    minpops--;
 	    unwind_count++;
 	    CLG_(pop_call_stack)();
-	    csp=CLG_(current_call_stack).sp;
+	    csp=CLG_(current_call_stack)->sp;
 	    continue;
 	}
 	break;
@@ -29,6 +29,8 @@
 
 #include "global.h"
 
+#include "pub_tool_seqmatch.h"
+
 
 
 /*------------------------------------------------------------*/
@@ -402,22 +404,164 @@ void CLG_(update_fn_config)(fn_node* fn)
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Event collection regions                             ---*/
+/*------------------------------------------------------------*/
+
+/* --collect-in=[<obj>:]<fn> patterns, with '*' and '?' wildcards.
+ * Like the configs above, they are matched once per function, when it
+ * is first seen, and the result is kept in fn_node flags. */
+typedef struct _collect_pattern collect_pattern;
+struct _collect_pattern {
+   HChar* obj;  /* NULL: any object */
+   HChar* fn;
+   collect_pattern* next;
+};
+
+static collect_pattern* collect_patterns = 0;
+
+/* The object part ends at the first ':' that is not part of a "::" */
+static void add_collect_pattern(const HChar* spec)
+{
+   collect_pattern* pat = (collect_pattern*) CLG_MALLOC("sgl.clo.acp.1",
+                                                        sizeof(collect_pattern));
+   const HChar* s;
+
+   pat->obj = NULL;
+   pat->fn  = VG_(strdup)("sgl.clo.acp.2", spec);
+   for (s = spec; *s; s++) {
+      if (*s == ':' && s[1] == ':') {
+         s++;
+         continue;
+      }
+      if (*s == ':') {
+         pat->obj = VG_(strdup)("sgl.clo.acp.3", spec);
+         pat->obj[s - spec] = 0;
+         pat->fn = pat->obj + (s - spec) + 1;
+         break;
+      }
+   }
+
+   pat->next = collect_patterns;
+   collect_patterns = pat;
+}
+
+static Bool obj_matches(const HChar* pattern, obj_node* obj)
+{
+   /* patterns without a directory match the file name */
+   if (VG_(strchr)(pattern, '/') == NULL)
+      return VG_(string_match)(pattern, obj->name + obj->last_slash_pos);
+   return VG_(string_match)(pattern, obj->name);
+}
+
+/* Set the collection flags of a function seen for the first time */
+void SGL_(update_fn_collect)(fn_node* fn)
+{
+   collect_pattern* pat;
+
+   fn->collect_in    = SGL_(clo).collect_func != NULL &&
+                       VG_(strcmp)(fn->name, SGL_(clo).collect_func) == 0;
+   fn->collect_start = SGL_(clo).start_collect_func != NULL &&
+                       VG_(strcmp)(fn->name, SGL_(clo).start_collect_func) == 0;
+   fn->collect_stop  = SGL_(clo).stop_collect_func != NULL &&
+                       VG_(strcmp)(fn->name, SGL_(clo).stop_collect_func) == 0;
+
+   for (pat = collect_patterns; pat && !fn->collect_in; pat = pat->next) {
+      if (pat->obj && !obj_matches(pat->obj, fn->file->obj))
+         continue;
+      if (VG_(string_match)(pat->fn, fn->name))
+         fn->collect_in = True;
+   }
+
+   if (fn->collect_in || fn->collect_start || fn->collect_stop)
+      CLG_DEBUG(1, "Collection region function %s (in %s)\n",
+                fn->name, fn->file->obj->name);
+}
+
+
 /*--------------------------------------------------------------------*/
 /*--- Command line processing                                      ---*/
 /*--------------------------------------------------------------------*/
 
+/* Comma separated list of reducers for --reduce, -1 if invalid */
+static Int parse_reduce(const HChar* list)
+{
+   Int reduce = 0;
+   const HChar* s = list;
+   SizeT len;
+
+   if (VG_(strcmp)(list, "none") == 0) return 0;
+
+   while (*s) {
+      len = 0;
+      while (s[len] && s[len] != ',') len++;
+
+      if (len == 9 && VG_(strncmp)(s, "footprint", 9) == 0)
+         reduce |= SGL_REDUCE_FOOTPRINT;
+      else if (len == 5 && VG_(strncmp)(s, "reuse", 5) == 0)
+         reduce |= SGL_REDUCE_REUSE;
+      else
+         return -1;
+
+      s += len;
+      if (*s == ',') s++;
+   }
+
+   return reduce;
+}
+
 Bool CLG_(process_cmd_line_option)(const HChar* arg)
 {
    const HChar* tmp_str;
 
    /* XXX tmpdir should not be set by the end-user, only for Sigil2 use */
    if      VG_STR_CLO(arg,  "--ipc-dir",    SGL_(clo).ipc_dir) {}
+   else if VG_STR_CLO(arg,  "--trace-out",  SGL_(clo).trace_out) {}
+   else if VG_XACT_CLO(arg, "--ipc-transport=fifo", SGL_(clo).ipc_transport, ipc_fifo) {}
+   else if VG_XACT_CLO(arg, "--ipc-transport=ring", SGL_(clo).ipc_transport, ipc_ring) {}
+   else if VG_XACT_CLO(arg, "--ipc-wait=block",  SGL_(clo).ipc_wait, ipc_block) {}
+   else if VG_XACT_CLO(arg, "--ipc-wait=hybrid", SGL_(clo).ipc_wait, ipc_hybrid) {}
+   else if VG_XACT_CLO(arg, "--ipc-wait=spin",   SGL_(clo).ipc_wait, ipc_spin) {}
+   else if VG_BINT_CLO(arg, "--ipc-buffers", SGL_(clo).ipc_buffers, 1, 1024) {}
+   else if VG_BINT_CLO(arg, "--ipc-buffer-events", SGL_(clo).ipc_buffer_events,
+                       4096, 1 << 24) {}
+   else if VG_XACT_CLO(arg, "--ipc-encoding=fixed",  SGL_(clo).ipc_encoding, ipc_fixed) {}
+   else if VG_XACT_CLO(arg, "--ipc-encoding=packed", SGL_(clo).ipc_encoding, ipc_packed) {}
+   else if VG_BOOL_CLO(arg, "--batch-events", SGL_(clo).batch_events) {}
+   else if VG_BOOL_CLO(arg, "--block-defs", SGL_(clo).block_defs) {}
+   else if VG_BOOL_CLO(arg, "--intern-fn-names", SGL_(clo).intern_fn_names) {}
+   else if VG_BINT_CLO(arg, "--sample-on",  SGL_(clo).sample_on,  0, 1000000) {}
+   else if VG_BINT_CLO(arg, "--sample-off", SGL_(clo).sample_off, 0, 1000000) {}
+   else if VG_BOOL_CLO(arg, "--sample-phases", SGL_(clo).sample_phases) {}
+   else if VG_BOOL_CLO(arg, "--fast-forward", SGL_(clo).fast_forward) {}
+   else if VG_BOOL_CLO(arg, "--coalesce-mem", SGL_(clo).coalesce_mem) {}
+   else if VG_STR_CLO(arg,  "--reduce",     tmp_str) {
+       Int reduce = parse_reduce(tmp_str);
+       if (reduce < 0) return False;
+       SGL_(clo).reduce = reduce;
+   }
+   else if VG_BINT_CLO(arg, "--reduce-interval", SGL_(clo).reduce_interval,
+                       1, 1000000) {}
+   else if VG_BINT_CLO(arg, "--reduce-line-size", SGL_(clo).reduce_line_size,
+                       4, 4096) {
+       if (SGL_(clo).reduce_line_size & (SGL_(clo).reduce_line_size - 1))
+          return False;
+   }
+   else if VG_XACT_CLO(arg, "--ipc-channels=single",
+                       SGL_(clo).ipc_channels, ipc_single) {}
+   else if VG_XACT_CLO(arg, "--ipc-channels=per-thread",
+                       SGL_(clo).ipc_channels, ipc_per_thread) {}
    else if VG_STR_CLO(arg,  "--at-func",    SGL_(clo).collect_func) {}
+   else if VG_STR_CLO(arg,  "--collect-in", tmp_str) {
+       add_collect_pattern(tmp_str);
+       SGL_(clo).collect_in = True;
+   }
    else if VG_STR_CLO(arg,  "--start-func", SGL_(clo).start_collect_func) {}
    else if VG_STR_CLO(arg,  "--stop-func",  SGL_(clo).stop_collect_func) {}
    else if VG_BOOL_CLO(arg, "--gen-mem",    SGL_(clo).gen_mem) {}
    else if VG_BOOL_CLO(arg, "--gen-comp",   SGL_(clo).gen_comp) {}
    else if VG_BOOL_CLO(arg, "--gen-sync",   SGL_(clo).gen_sync) {}
+   else if VG_BOOL_CLO(arg, "--gen-atomics", SGL_(clo).gen_atomics) {}
    else if VG_BOOL_CLO(arg, "--gen-instr",  SGL_(clo).gen_instr) {}
    else if VG_BOOL_CLO(arg, "--gen-fn",     SGL_(clo).gen_fn) {}
    else if VG_BOOL_CLO(arg, "--gen-cf",     SGL_(clo).gen_cf) {}
@@ -628,13 +772,33 @@ void CLG_(print_debug_usage)(void)
 void SGL_(set_clo_defaults)(void)
 {
   SGL_(clo).ipc_dir            = NULL;
+  SGL_(clo).trace_out          = NULL;
+  SGL_(clo).ipc_transport      = ipc_fifo;
+  SGL_(clo).ipc_wait           = ipc_block;
+  SGL_(clo).ipc_buffers        = 0;
+  SGL_(clo).ipc_buffer_events  = 0;
+  SGL_(clo).ipc_encoding       = ipc_fixed;
+  SGL_(clo).batch_events       = False;
+  SGL_(clo).ipc_channels       = ipc_single;
+  SGL_(clo).block_defs         = False;
+  SGL_(clo).intern_fn_names    = False;
+  SGL_(clo).sample_on          = 0;
+  SGL_(clo).sample_off         = 0;
+  SGL_(clo).sample_phases      = False;
+  SGL_(clo).fast_forward       = True;
+  SGL_(clo).coalesce_mem       = False;
+  SGL_(clo).reduce             = 0;
+  SGL_(clo).reduce_interval    = 10;
+  SGL_(clo).reduce_line_size   = 64;
   SGL_(clo).collect_func       = NULL;
+  SGL_(clo).collect_in         = False;
   SGL_(clo).start_collect_func = NULL;
   SGL_(clo).stop_collect_func  = NULL;
   SGL_(clo).gen_mem            = False;
   SGL_(clo).gen_comp           = False;
   SGL_(clo).gen_cf             = False;
   SGL_(clo).gen_sync           = False;
+  SGL_(clo).gen_atomics        = False;
   SGL_(clo).gen_instr          = False;
   SGL_(clo).gen_bb             = False;
   SGL_(clo).gen_fn             = False;
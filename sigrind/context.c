@@ -36,7 +36,7 @@
 #define N_FNSTACK_INITIAL_ENTRIES 500
 #define N_CXT_INITIAL_ENTRIES 2537
 
-fn_stack CLG_(current_fn_stack);
+fn_stack* CLG_(current_fn_stack) = 0;
 
 void CLG_(init_fn_stack)(fn_stack* s)
 {
@@ -49,22 +49,11 @@ void CLG_(init_fn_stack)(fn_stack* s)
   s->bottom[0] = 0;
 }
 
-void CLG_(copy_current_fn_stack)(fn_stack* dst)
-{
-  CLG_ASSERT(dst != 0);
-
-  dst->size   = CLG_(current_fn_stack).size;
-  dst->bottom = CLG_(current_fn_stack).bottom;
-  dst->top    = CLG_(current_fn_stack).top;
-}
-
 void CLG_(set_current_fn_stack)(fn_stack* s)
 {
   CLG_ASSERT(s != 0);
 
-  CLG_(current_fn_stack).size   = s->size;
-  CLG_(current_fn_stack).bottom = s->bottom;
-  CLG_(current_fn_stack).top    = s->top;
+  CLG_(current_fn_stack) = s;
 }
 
 static cxt_hash cxts;
@@ -273,7 +262,7 @@ Context* CLG_(get_cxt)(fn_node** fn)
  */
 void CLG_(push_cxt)(fn_node* fn)
 {
-  call_stack* cs = &CLG_(current_call_stack);
+  call_stack* cs = CLG_(current_call_stack);
   Int fn_entries;
 
   CLG_DEBUG(5, "+ push_cxt(fn '%s'): old ctx %d\n", 
@@ -285,33 +274,33 @@ void CLG_(push_cxt)(fn_node* fn)
   CLG_ASSERT(cs->sp < cs->size);
   CLG_ASSERT(cs->entry[cs->sp].cxt == 0);
   cs->entry[cs->sp].cxt = CLG_(current_state).cxt;
-  cs->entry[cs->sp].fn_sp = CLG_(current_fn_stack).top - CLG_(current_fn_stack).bottom;
+  cs->entry[cs->sp].fn_sp = CLG_(current_fn_stack)->top - CLG_(current_fn_stack)->bottom;
 
-  if (fn && (*(CLG_(current_fn_stack).top) == fn)) return;
+  if (fn && (*(CLG_(current_fn_stack)->top) == fn)) return;
   if (fn && (fn->group>0) &&
-      ((*(CLG_(current_fn_stack).top))->group == fn->group)) return;
+      ((*(CLG_(current_fn_stack)->top))->group == fn->group)) return;
 
   /* resizing needed ? */
-  fn_entries = CLG_(current_fn_stack).top - CLG_(current_fn_stack).bottom;
-  if (fn_entries == CLG_(current_fn_stack).size-1) {
-    UInt new_size = CLG_(current_fn_stack).size *2;
+  fn_entries = CLG_(current_fn_stack)->top - CLG_(current_fn_stack)->bottom;
+  if (fn_entries == CLG_(current_fn_stack)->size-1) {
+    UInt new_size = CLG_(current_fn_stack)->size *2;
     fn_node** new_array = (fn_node**) CLG_MALLOC("cl.context.pc.1",
 						 new_size * sizeof(fn_node*));
     int i;
-    for(i=0;i<CLG_(current_fn_stack).size;i++)
-      new_array[i] = CLG_(current_fn_stack).bottom[i];
-    VG_(free)(CLG_(current_fn_stack).bottom);
-    CLG_(current_fn_stack).top = new_array + fn_entries;
-    CLG_(current_fn_stack).bottom = new_array;
+    for(i=0;i<CLG_(current_fn_stack)->size;i++)
+      new_array[i] = CLG_(current_fn_stack)->bottom[i];
+    VG_(free)(CLG_(current_fn_stack)->bottom);
+    CLG_(current_fn_stack)->top = new_array + fn_entries;
+    CLG_(current_fn_stack)->bottom = new_array;
 
     CLG_DEBUG(0, "Resize Context Stack: %u => %u (pushing '%s')\n", 
-	     CLG_(current_fn_stack).size, new_size,
+	     CLG_(current_fn_stack)->size, new_size,
 	     fn ? fn->name : "0x0");
 
-    CLG_(current_fn_stack).size = new_size;
+    CLG_(current_fn_stack)->size = new_size;
   }
 
-  if (fn && (*(CLG_(current_fn_stack).top) == 0)) {
+  if (fn && (*(CLG_(current_fn_stack)->top) == 0)) {
     UInt *pactive;
 
     /* this is first function: increment its active count */
@@ -319,14 +308,14 @@ void CLG_(push_cxt)(fn_node* fn)
     (*pactive)++;
   }
 
-  CLG_(current_fn_stack).top++;
-  *(CLG_(current_fn_stack).top) = fn;
-  CLG_(current_state).cxt = CLG_(get_cxt)(CLG_(current_fn_stack).top);
+  CLG_(current_fn_stack)->top++;
+  *(CLG_(current_fn_stack)->top) = fn;
+  CLG_(current_state).cxt = CLG_(get_cxt)(CLG_(current_fn_stack)->top);
 
   CLG_DEBUG(5, "- push_cxt(fn '%s'): new cxt %d, fn_sp %ld\n",
 	    fn ? fn->name : "0x0",
 	    CLG_(current_state).cxt ?
 	    (Int)CLG_(current_state).cxt->base_number : -1,
-	    CLG_(current_fn_stack).top - CLG_(current_fn_stack).bottom + 0L);
+	    CLG_(current_fn_stack)->top - CLG_(current_fn_stack)->bottom + 0L);
 }
 			       
@@ -272,7 +272,7 @@ static void print_call_stack()
     int c;
 
     VG_(printf)("Call Stack:\n");
-    for(c=0;c<CLG_(current_call_stack).sp;c++)
+    for(c=0;c<CLG_(current_call_stack)->sp;c++)
       CLG_(print_stackentry)(-2, c);
 }
 #endif
@@ -416,7 +416,7 @@ void CLG_(print_context)(void)
   BBCC* bbcc;
 
   CLG_DEBUG(0,"In tid %u [%d] ",
-	   CLG_(current_tid),  CLG_(current_call_stack).sp);
+	   CLG_(current_tid),  CLG_(current_call_stack)->sp);
   bbcc =  CLG_(current_state).bbcc;
   print_mangled_cxt(CLG_(current_state).cxt,
 		    bbcc ? bbcc->rec_index : 0);
@@ -30,7 +30,7 @@
 
 #define N_INITIAL_FN_ARRAY_SIZE 10071
 
-static fn_array current_fn_active;
+static fn_array* current_fn_active = 0;
 
 static Addr runtime_resolve_addr = 0;
 static int  runtime_resolve_length = 0;
@@ -202,31 +202,138 @@ static Bool search_runtime_resolve(obj_node* obj)
 /*--- Object/File/Function hash entry operations           ---*/
 /*------------------------------------------------------------*/
 
-/* Object hash table, fixed */
-static obj_node* obj_table[N_OBJ_ENTRIES];
+/* Object hash table, resizable */
+static obj_node** obj_table;
+static UInt       obj_table_size;
+static UInt       obj_table_entries;
+
+/* Allocate a zeroed hash table of <size> chains */
+static void** new_hash_table(const HChar* cc, UInt size)
+{
+    UInt i;
+    void** table = (void**) CLG_MALLOC(cc, size * sizeof(void*));
+    for (i = 0; i < size; i++)
+	table[i] = NULL;
+    return table;
+}
+
+/* Tables grow when more than 80% full, like the BB hash */
+#define HASH_NEEDS_RESIZE(entries, size)  (10 * (entries) / (size) > 8)
+
+/* Account for a lookup that walked <steps> chain entries */
+#define COUNT_LOOKUP(kind, steps)                              \
+    do {                                                       \
+	CLG_(stat).kind##_hash_lookups++;                      \
+	CLG_(stat).kind##_hash_steps += (steps);               \
+	if ((steps) > CLG_(stat).kind##_hash_max_chain)        \
+	    CLG_(stat).kind##_hash_max_chain = (steps);        \
+    } while (0)
 
 void CLG_(init_obj_table)()
 {
-    Int i;
-    for (i = 0; i < N_OBJ_ENTRIES; i++)
-	obj_table[i] = 0;
+    obj_table_size    = N_OBJ_ENTRIES;
+    obj_table_entries = 0;
+    obj_table = (obj_node**) new_hash_table("cl.fn.iot.1", obj_table_size);
 }
 
-#define HASH_CONSTANT   256
+#define HASH_CONSTANT   31
 
-static UInt str_hash(const HChar *s, UInt table_size)
+/* The full hash is stored in the nodes, so tables can be resized
+ * without rehashing names, and most mismatches skip the strcmp */
+static UInt str_hash(const HChar *s)
 {
-    int hash_value = 0;
+    UInt hash_value = 0;
     for ( ; *s; s++)
-        hash_value = (HASH_CONSTANT * hash_value + *s) % table_size;
+        hash_value = HASH_CONSTANT * hash_value + (UChar)*s;
     return hash_value;
 }
 
 
+static void resize_obj_table(void)
+{
+    UInt i, new_size, new_idx;
+    obj_node **new_table, *curr, *next;
+
+    new_size  = 2 * obj_table_size + 3;
+    new_table = (obj_node**) new_hash_table("cl.fn.rot.1", new_size);
+
+    for (i = 0; i < obj_table_size; i++) {
+	for (curr = obj_table[i]; curr != NULL; curr = next) {
+	    next = curr->next;
+	    new_idx = curr->hash % new_size;
+	    curr->next = new_table[new_idx];
+	    new_table[new_idx] = curr;
+	}
+    }
+    VG_(free)(obj_table);
+
+    CLG_DEBUG(0, "Resize Obj Hash: %u => %u (entries %u)\n",
+	      obj_table_size, new_size, obj_table_entries);
+
+    obj_table_size = new_size;
+    obj_table      = new_table;
+    CLG_(stat).obj_hash_resizes++;
+}
+
+
+static void resize_file_table(obj_node* obj)
+{
+    UInt i, new_size, new_idx;
+    file_node **new_table, *curr, *next;
+
+    new_size  = 2 * obj->files_size + 3;
+    new_table = (file_node**) new_hash_table("cl.fn.rft.1", new_size);
+
+    for (i = 0; i < obj->files_size; i++) {
+	for (curr = obj->files[i]; curr != NULL; curr = next) {
+	    next = curr->next;
+	    new_idx = curr->hash % new_size;
+	    curr->next = new_table[new_idx];
+	    new_table[new_idx] = curr;
+	}
+    }
+    VG_(free)(obj->files);
+
+    CLG_DEBUG(1, "Resize File Hash of %s: %u => %u (entries %u)\n",
+	      obj->name, obj->files_size, new_size, obj->files_entries);
+
+    obj->files_size = new_size;
+    obj->files      = new_table;
+    CLG_(stat).file_hash_resizes++;
+}
+
+
+static void resize_fn_table(file_node* file)
+{
+    UInt i, new_size, new_idx;
+    fn_node **new_table, *curr, *next;
+
+    new_size  = 2 * file->fns_size + 3;
+    new_table = (fn_node**) new_hash_table("cl.fn.rfnt.1", new_size);
+
+    for (i = 0; i < file->fns_size; i++) {
+	for (curr = file->fns[i]; curr != NULL; curr = next) {
+	    next = curr->next;
+	    new_idx = curr->hash % new_size;
+	    curr->next = new_table[new_idx];
+	    new_table[new_idx] = curr;
+	}
+    }
+    VG_(free)(file->fns);
+
+    CLG_DEBUG(1, "Resize Fn Hash of %s: %u => %u (entries %u)\n",
+	      file->name, file->fns_size, new_size, file->fns_entries);
+
+    file->fns_size = new_size;
+    file->fns      = new_table;
+    CLG_(stat).fn_hash_resizes++;
+}
+
+
 static const HChar* anonymous_obj = "???";
 
 static __inline__ 
-obj_node* new_obj_node(DebugInfo* di, obj_node* next)
+obj_node* new_obj_node(DebugInfo* di, UInt hash, obj_node* next)
 {
    Int i;
    obj_node* obj;
@@ -235,9 +342,10 @@ obj_node* new_obj_node(DebugInfo* di, obj_node* next)
    obj->name  = di ? VG_(strdup)( "cl.fn.non.2",
                                   VG_(DebugInfo_get_filename)(di) )
                    : anonymous_obj;
-   for (i = 0; i < N_FILE_ENTRIES; i++) {
-      obj->files[i] = NULL;
-   }
+   obj->hash  = hash;
+   obj->files_size    = N_FILE_ENTRIES;
+   obj->files_entries = 0;
+   obj->files = (file_node**) new_hash_table("cl.fn.non.3", obj->files_size);
    CLG_(stat).distinct_objs ++;
    obj->number  = CLG_(stat).distinct_objs;
    /* JRS 2008 Feb 19: maybe rename .start/.size/.offset to
@@ -264,21 +372,28 @@ obj_node* new_obj_node(DebugInfo* di, obj_node* next)
 obj_node* CLG_(get_obj_node)(DebugInfo* di)
 {
     obj_node*    curr_obj_node;
-    UInt         objname_hash;
+    UInt         objname_hash, idx, steps = 0;
     const HChar* obj_name;
     
     obj_name = di ? VG_(DebugInfo_get_filename)(di) : anonymous_obj;
 
     /* lookup in obj hash */
-    objname_hash = str_hash(obj_name, N_OBJ_ENTRIES);
-    curr_obj_node = obj_table[objname_hash];
+    objname_hash = str_hash(obj_name);
+    curr_obj_node = obj_table[objname_hash % obj_table_size];
     while (NULL != curr_obj_node && 
-	   VG_(strcmp)(obj_name, curr_obj_node->name) != 0) {
+	   (curr_obj_node->hash != objname_hash ||
+	    VG_(strcmp)(obj_name, curr_obj_node->name) != 0)) {
 	curr_obj_node = curr_obj_node->next;
+	steps++;
     }
+    COUNT_LOOKUP(obj, steps);
     if (NULL == curr_obj_node) {
-	obj_table[objname_hash] = curr_obj_node = 
-	    new_obj_node(di, obj_table[objname_hash]);
+	if (HASH_NEEDS_RESIZE(obj_table_entries + 1, obj_table_size))
+	    resize_obj_table();
+	idx = objname_hash % obj_table_size;
+	obj_table[idx] = curr_obj_node = 
+	    new_obj_node(di, objname_hash, obj_table[idx]);
+	obj_table_entries++;
     }
 
     return curr_obj_node;
@@ -286,16 +401,16 @@ obj_node* CLG_(get_obj_node)(DebugInfo* di)
 
 
 static __inline__ 
-file_node* new_file_node(const HChar *filename,
+file_node* new_file_node(const HChar *filename, UInt hash,
 			 obj_node* obj, file_node* next)
 {
-  Int i;
   file_node* file = (file_node*) CLG_MALLOC("cl.fn.nfn.1",
                                            sizeof(file_node));
   file->name  = VG_(strdup)("cl.fn.nfn.2", filename);
-  for (i = 0; i < N_FN_ENTRIES; i++) {
-    file->fns[i] = NULL;
-  }
+  file->hash  = hash;
+  file->fns_size    = N_FN_ENTRIES;
+  file->fns_entries = 0;
+  file->fns = (fn_node**) new_hash_table("cl.fn.nfn.3", file->fns_size);
   CLG_(stat).distinct_files++;
   file->number  = CLG_(stat).distinct_files;
   file->obj     = obj;
@@ -308,7 +423,7 @@ file_node* CLG_(get_file_node)(obj_node* curr_obj_node,
                                const HChar *dir, const HChar *file)
 {
     file_node* curr_file_node;
-    UInt       filename_hash;
+    UInt       filename_hash, idx, steps = 0;
 
     /* Build up an absolute pathname, if there is a directory available */
     HChar filename[VG_(strlen)(dir) + 1 + VG_(strlen)(file) + 1];
@@ -319,16 +434,24 @@ file_node* CLG_(get_file_node)(obj_node* curr_obj_node,
     VG_(strcat)(filename, file);
 
     /* lookup in file hash */
-    filename_hash = str_hash(filename, N_FILE_ENTRIES);
-    curr_file_node = curr_obj_node->files[filename_hash];
+    filename_hash = str_hash(filename);
+    curr_file_node = curr_obj_node->files[filename_hash % curr_obj_node->files_size];
     while (NULL != curr_file_node && 
-	   VG_(strcmp)(filename, curr_file_node->name) != 0) {
+	   (curr_file_node->hash != filename_hash ||
+	    VG_(strcmp)(filename, curr_file_node->name) != 0)) {
 	curr_file_node = curr_file_node->next;
+	steps++;
     }
+    COUNT_LOOKUP(file, steps);
     if (NULL == curr_file_node) {
-	curr_obj_node->files[filename_hash] = curr_file_node = 
-	    new_file_node(filename, curr_obj_node, 
-			  curr_obj_node->files[filename_hash]);
+	if (HASH_NEEDS_RESIZE(curr_obj_node->files_entries + 1,
+			      curr_obj_node->files_size))
+	    resize_file_table(curr_obj_node);
+	idx = filename_hash % curr_obj_node->files_size;
+	curr_obj_node->files[idx] = curr_file_node = 
+	    new_file_node(filename, filename_hash, curr_obj_node, 
+			  curr_obj_node->files[idx]);
+	curr_obj_node->files_entries++;
     }
 
     return curr_file_node;
@@ -338,12 +461,13 @@ file_node* CLG_(get_file_node)(obj_node* curr_obj_node,
 static void resize_fn_array(void);
 
 static __inline__ 
-fn_node* new_fn_node(const HChar *fnname,
+fn_node* new_fn_node(const HChar *fnname, UInt hash,
 		     file_node* file, fn_node* next)
 {
     fn_node* fn = (fn_node*) CLG_MALLOC("cl.fn.nfnnd.1",
                                          sizeof(fn_node));
     fn->name = VG_(strdup)("cl.fn.nfnnd.2", fnname);
+    fn->hash = hash;
 
     CLG_(stat).distinct_fns++;
     fn->number   = CLG_(stat).distinct_fns;
@@ -361,6 +485,13 @@ fn_node* new_fn_node(const HChar *fnname,
     fn->is_malloc    = False;
     fn->is_realloc   = False;
     fn->is_free      = False;
+    fn->name_sent    = False;
+    fn->collect_in   = False;
+    fn->collect_start = False;
+    fn->collect_stop = False;
+    fn->reduce_read  = 0;
+    fn->reduce_write = 0;
+    fn->reduce_next  = NULL;
 
     fn->group        = 0;
     fn->separate_callers    = CLG_(clo).separate_callers;
@@ -370,7 +501,7 @@ fn_node* new_fn_node(const HChar *fnname,
     fn->verbosity    = -1;
 #endif
 
-    if (CLG_(stat).distinct_fns >= current_fn_active.size)
+    if (CLG_(stat).distinct_fns >= current_fn_active->size)
 	resize_fn_array();
 
     return fn;
@@ -385,21 +516,29 @@ fn_node* get_fn_node_infile(file_node* curr_file_node,
 			    const HChar *fnname)
 {
     fn_node* curr_fn_node;
-    UInt     fnname_hash;
+    UInt     fnname_hash, idx, steps = 0;
 
     CLG_ASSERT(curr_file_node != 0);
 
     /* lookup in function hash */
-    fnname_hash = str_hash(fnname, N_FN_ENTRIES);
-    curr_fn_node = curr_file_node->fns[fnname_hash];
+    fnname_hash = str_hash(fnname);
+    curr_fn_node = curr_file_node->fns[fnname_hash % curr_file_node->fns_size];
     while (NULL != curr_fn_node && 
-	   VG_(strcmp)(fnname, curr_fn_node->name) != 0) {
+	   (curr_fn_node->hash != fnname_hash ||
+	    VG_(strcmp)(fnname, curr_fn_node->name) != 0)) {
 	curr_fn_node = curr_fn_node->next;
+	steps++;
     }
+    COUNT_LOOKUP(fn, steps);
     if (NULL == curr_fn_node) {
-	curr_file_node->fns[fnname_hash] = curr_fn_node = 
-            new_fn_node(fnname, curr_file_node,
-			curr_file_node->fns[fnname_hash]);
+	if (HASH_NEEDS_RESIZE(curr_file_node->fns_entries + 1,
+			      curr_file_node->fns_size))
+	    resize_fn_table(curr_file_node);
+	idx = fnname_hash % curr_file_node->fns_size;
+	curr_file_node->fns[idx] = curr_fn_node = 
+            new_fn_node(fnname, fnname_hash, curr_file_node,
+			curr_file_node->fns[idx]);
+	curr_file_node->fns_entries++;
     }
 
     return curr_fn_node;
@@ -582,6 +721,7 @@ fn_node* CLG_(get_fn_node)(BB* bb)
       /* apply config options from function name patterns
        * given on command line */
       CLG_(update_fn_config)(fn);
+      SGL_(update_fn_collect)(fn);
     }
 
 
@@ -613,8 +753,8 @@ fn_node* CLG_(get_fn_node)(BB* bb)
 
 UInt* CLG_(get_fn_entry)(Int n)
 {
-  CLG_ASSERT(n < current_fn_active.size);
-  return current_fn_active.array + n;
+  CLG_ASSERT(n < current_fn_active->size);
+  return current_fn_active->array + n;
 }
 
 void CLG_(init_fn_array)(fn_array* a)
@@ -633,26 +773,17 @@ void CLG_(init_fn_array)(fn_array* a)
     a->array[i] = 0;
 }
 
-void CLG_(copy_current_fn_array)(fn_array* dst)
-{
-  CLG_ASSERT(dst != 0);
-
-  dst->size  = current_fn_active.size;
-  dst->array = current_fn_active.array;
-}
-
 fn_array* CLG_(get_current_fn_array)()
 {
-  return &current_fn_active;
+  return current_fn_active;
 }
 
 void CLG_(set_current_fn_array)(fn_array* a)
 {
   CLG_ASSERT(a != 0);
 
-  current_fn_active.size  = a->size;
-  current_fn_active.array = a->array;
-  if (current_fn_active.size <= CLG_(stat).distinct_fns)
+  current_fn_active = a;
+  if (current_fn_active->size <= CLG_(stat).distinct_fns)
     resize_fn_array();
 }
 
@@ -665,21 +796,21 @@ static void resize_fn_array(void)
     UInt* new_array;
     Int i;
 
-    UInt newsize = current_fn_active.size;
+    UInt newsize = current_fn_active->size;
     while (newsize <= CLG_(stat).distinct_fns) newsize *=2;
 
     CLG_DEBUG(0, "Resize fn_active_array: %u => %u\n",
-	     current_fn_active.size, newsize);
+	     current_fn_active->size, newsize);
 
     new_array = (UInt*) CLG_MALLOC("cl.fn.rfa.1", newsize * sizeof(UInt));
-    for(i=0;i<current_fn_active.size;i++)
-      new_array[i] = current_fn_active.array[i];
+    for(i=0;i<current_fn_active->size;i++)
+      new_array[i] = current_fn_active->array[i];
     while(i<newsize)
 	new_array[i++] = 0;
 
-    VG_(free)(current_fn_active.array);
-    current_fn_active.size = newsize;
-    current_fn_active.array = new_array;
+    VG_(free)(current_fn_active->array);
+    current_fn_active->size = newsize;
+    current_fn_active->array = new_array;
     CLG_(stat).fn_array_resizes++;
 }
 
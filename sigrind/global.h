@@ -47,6 +47,7 @@
 #include "pub_tool_machine.h"      // VG_(fnptr_to_fnentry)
 
 #include "events.h" // defines CLG_ macro
+#include "Core/Primitive.h" // SglEvVariant
 
 #define SGL_(str) VGAPPEND(vgSigrind_,str)
 
@@ -73,16 +74,65 @@
 
 #define DEFAULT_OUTFORMAT   "callgrind.out.%p"
 
+/* How Sigrind hands filled buffers over to Sigil2 */
+typedef enum {
+  ipc_fifo = 0,  /* full/empty buffer indices are sent over named pipes */
+  ipc_ring       /* atomic head/tail counters in shared memory (sigil2_shmem.h) */
+} SglIpcTransport;
+
+/* How Sigrind waits for Sigil2 to return an empty ring buffer */
+typedef enum {
+  ipc_block = 0, /* futex wait right away */
+  ipc_hybrid,    /* poll the ring tail for a while, then futex wait */
+  ipc_spin       /* only poll the ring tail */
+} SglIpcWait;
+
+/* How events are laid out in the event buffers */
+typedef enum {
+  ipc_fixed = 0, /* one SglEvVariant per event */
+  ipc_packed     /* variable-length records (sigil2_shmem.h) */
+} SglIpcEncoding;
+
+/* How guest threads map to shared-memory channels */
+typedef enum {
+  ipc_single = 0, /* all threads share channel 0, separated by SWAP events */
+  ipc_per_thread  /* one channel per thread (sigil2_shmem.h) */
+} SglIpcChannels;
+
+/* In-process reducers (--reduce, sigil2_shmem.h) */
+#define SGL_REDUCE_FOOTPRINT 0x1
+#define SGL_REDUCE_REUSE     0x2
+
 typedef struct _SglCommandLineOptions SglCommandLineOptions;
 struct _SglCommandLineOptions {
   const HChar* ipc_dir;
+  const HChar* trace_out; /* write buffers to chunk files instead of IPC */
+  SglIpcTransport ipc_transport;
+  SglIpcWait ipc_wait;
+  Int ipc_buffers;        /* 0: SIGIL2_IPC_BUFFERS */
+  Int ipc_buffer_events;  /* 0: SIGIL2_EVENTS_BUFFER_SIZE */
+  SglIpcEncoding ipc_encoding;
+  Bool batch_events;      /* one slot reservation per superblock */
+  SglIpcChannels ipc_channels;
+  Bool block_defs;        /* one BLOCK event instead of INSTR events */
+  Bool intern_fn_names;   /* function names are sent once */
+  Int sample_on;          /* Minstrs per sampling window, 0: no sampling */
+  Int sample_off;         /* Minstrs skipped between windows */
+  Bool sample_phases;     /* skip windows of already seen phases */
+  Bool fast_forward;      /* no event helpers while not collecting */
+  Bool coalesce_mem;      /* merge adjacent MEM events */
+  UInt reduce;            /* SGL_REDUCE_* reducers instead of MEM events */
+  Int reduce_interval;    /* Maccesses per summary */
+  Int reduce_line_size;   /* bytes, power of 2 */
   const HChar* collect_func;
+  Bool collect_in;        /* --collect-in patterns were given */
   const HChar* start_collect_func;
   const HChar* stop_collect_func;
   Bool gen_mem;
   Bool gen_comp;
   Bool gen_cf;
   Bool gen_sync;
+  Bool gen_atomics;
   Bool gen_instr;
   Bool gen_bb;
   Bool gen_fn;
@@ -155,6 +205,7 @@ struct _Statistics {
   ULong jcnd_counter;
   ULong jump_counter;
   ULong rec_call_counter;
+  ULong thread_switches;
   ULong ret_counter;
   ULong bb_executions;
 
@@ -172,6 +223,9 @@ struct _Statistics {
   Int  distinct_skips;
 
   Int  bb_hash_resizes;
+  Int  obj_hash_resizes;
+  Int  file_hash_resizes;
+  Int  fn_hash_resizes;
   Int  bbcc_hash_resizes;
   Int  jcc_hash_resizes;
   Int  cxt_hash_resizes;
@@ -187,6 +241,17 @@ struct _Statistics {
   Int  jcc_lru_misses;
   Int  cxt_lru_misses;
   Int  bbcc_clones;
+
+  /* chain entries walked by obj/file/fn lookups (fn.c) */
+  ULong obj_hash_lookups;
+  ULong obj_hash_steps;
+  UInt  obj_hash_max_chain;
+  ULong file_hash_lookups;
+  ULong file_hash_steps;
+  UInt  file_hash_max_chain;
+  ULong fn_hash_lookups;
+  ULong fn_hash_steps;
+  UInt  fn_hash_max_chain;
 };
 
 
@@ -322,6 +387,23 @@ struct _BB {
 
   UInt       instr_len;
   UInt       cost_count;
+
+  /* filled by CLG_(instrument) with --batch-events=yes:
+   * the events of the BB in emission order, without memory addresses */
+  SglEvVariant* ev_template;
+  UInt          ev_count;
+
+  /* filled by CLG_(instrument) with --block-defs=yes:
+   * the block definition payload, sent before the BB first runs */
+  UChar*        def;
+  UInt          def_size;
+  Bool          def_sent;
+
+  /* --gen-cf: ends in a jump to a computed address,
+   * SigrindBranchDef already sent */
+  Bool          ind_exit;
+  Bool          branch_def_sent;
+
   InstrInfo  instr[0];   /* info on instruction sizes and costs */
 };
 
@@ -408,6 +490,7 @@ struct _BBCC {
 
 struct _fn_node {
   HChar*     name;
+  UInt       hash;     /* str_hash of name */
   UInt       number;
   Context*   last_cxt; /* LRU info */
   Context*   pure_cxt; /* the context with only the function itself */
@@ -425,15 +508,26 @@ struct _fn_node {
   Bool is_realloc :1;
   Bool is_free :1;
 
+  Bool name_sent :1; /* SIGRIND_CXT_FUNC_NAME record sent */
+
+  Bool collect_in :1;    /* --at-func, --collect-in */
+  Bool collect_start :1; /* --start-func */
+  Bool collect_stop :1;  /* --stop-func */
+
   Int  group;
   Int  separate_callers;
   Int  separate_recursions;
+
+  /* --reduce: bytes since the last summary, chained if nonzero */
+  ULong    reduce_read;
+  ULong    reduce_write;
+  fn_node* reduce_next;
 #if CLG_ENABLE_DEBUG
   Int  verbosity; /* Stores old verbosity level while in function */
 #endif
 };
 
-/* Quite arbitrary fixed hash sizes */
+/* Quite arbitrary initial hash sizes, the tables are resized when full */
 
 #define   N_OBJ_ENTRIES         47
 #define  N_FILE_ENTRIES         53
@@ -441,7 +535,10 @@ struct _fn_node {
 
 struct _file_node {
    HChar*     name;
-   fn_node*   fns[N_FN_ENTRIES];
+   UInt       hash;
+   fn_node**  fns;         /* resizable */
+   UInt       fns_size;
+   UInt       fns_entries;
    UInt       number;
    obj_node*  obj;
    file_node* next;
@@ -459,7 +556,10 @@ struct _obj_node {
    SizeT      size;   /* Length of mapping */
    PtrdiffT   offset; /* Offset between symbol address and file offset */
 
-   file_node* files[N_FILE_ENTRIES];
+   file_node** files;      /* resizable */
+   UInt       files_size;
+   UInt       files_entries;
+   UInt       hash;
    UInt       number;
    obj_node*  next;
 };
@@ -531,7 +631,7 @@ struct _cxt_hash {
 
 /* Thread specific state structures, i.e. parts of a thread state.
  * There are variables for the current state of each part,
- * on which a thread state is copied at thread switch.
+ * which point into the thread_info of the running thread.
  */
 typedef struct _bbcc_hash bbcc_hash;
 struct _bbcc_hash {
@@ -578,8 +678,8 @@ struct _exec_stack {
 
 /* Thread State 
  *
- * This structure stores thread specific info while a thread is *not*
- * running. See function switch_thread() for save/restore on thread switch.
+ * This structure stores thread specific info. The parts are used in place
+ * while the thread runs, see function switch_thread().
  *
  * If --separate-threads=no, BBCCs and JCCs can be shared by all threads, i.e.
  * only structures of thread 1 are used.
@@ -693,6 +793,7 @@ struct event_sets {
 void SGL_(set_clo_defaults)(void);
 void CLG_(set_clo_defaults)(void);
 void CLG_(update_fn_config)(fn_node*);
+void SGL_(update_fn_collect)(fn_node*);
 Bool CLG_(process_cmd_line_option)(const HChar*);
 void CLG_(print_usage)(void);
 void CLG_(print_debug_usage)(void);
@@ -706,6 +807,9 @@ Bool CLG_(get_debug_info)(Addr, const HChar **dirname,
                           const HChar **fn_name, UInt*, DebugInfo**);
 void CLG_(collectBlockInfo)(IRSB* bbIn, UInt*, UInt*, Bool*);
 void CLG_(set_instrument_state)(const HChar*,Bool);
+void SGL_(request_retranslation)(void);
+void SGL_(set_fast_forward)(Bool state);
+void SGL_(sample_block)(BB* bb);
 void CLG_(dump_profile)(const HChar* trigger,Bool only_current_thread);
 void CLG_(zero_all_cost)(Bool only_current_thread);
 Int CLG_(get_dump_counter)(void);
@@ -725,7 +829,6 @@ static __inline__ Addr bb_jmpaddr(BB* bb)
 
 /* from fn.c */
 void CLG_(init_fn_array)(fn_array*);
-void CLG_(copy_current_fn_array)(fn_array* dst);
 fn_array* CLG_(get_current_fn_array)(void);
 void CLG_(set_current_fn_array)(fn_array*);
 UInt* CLG_(get_fn_entry)(Int n);
@@ -736,9 +839,16 @@ file_node* CLG_(get_file_node)(obj_node*, const HChar *dirname,
                                const HChar* filename);
 fn_node*  CLG_(get_fn_node)(BB* bb);
 
+/* from reduce.c */
+void SGL_(init_reduce)(void);
+void SGL_(reduce_mem)(Int type, Addr addr, Word size);
+void SGL_(finish_reduce)(void);
+
+/* from vec_ops.c */
+UInt SGL_(vec_op_shape)(IROp op, UInt* lanes, UInt* bits);
+
 /* from bbcc.c */
 void CLG_(init_bbcc_hash)(bbcc_hash* bbccs);
-void CLG_(copy_current_bbcc_hash)(bbcc_hash* dst);
 bbcc_hash* CLG_(get_current_bbcc_hash)(void);
 void CLG_(set_current_bbcc_hash)(bbcc_hash*);
 void CLG_(forall_bbccs)(void (*func)(BBCC*));
@@ -750,13 +860,11 @@ void CLG_(setup_bbcc)(BB* bb) VG_REGPARM(1);
 
 /* from jumps.c */
 void CLG_(init_jcc_hash)(jcc_hash*);
-void CLG_(copy_current_jcc_hash)(jcc_hash* dst);
 void CLG_(set_current_jcc_hash)(jcc_hash*);
 jCC* CLG_(get_jcc)(BBCC* from, UInt, BBCC* to);
 
 /* from callstack.c */
 void CLG_(init_call_stack)(call_stack*);
-void CLG_(copy_current_call_stack)(call_stack* dst);
 void CLG_(set_current_call_stack)(call_stack*);
 call_entry* CLG_(get_call_entry)(Int n);
 
@@ -766,7 +874,6 @@ Int CLG_(unwind_call_stack)(Addr sp, Int);
 
 /* from context.c */
 void CLG_(init_fn_stack)(fn_stack*);
-void CLG_(copy_current_fn_stack)(fn_stack*);
 void CLG_(set_current_fn_stack)(fn_stack*);
 
 void CLG_(init_cxt_table)(void);
@@ -784,7 +891,6 @@ void SGL_(switch_thread)(ThreadId tid);
 
 void CLG_(init_exec_state)(exec_state* es);
 void CLG_(init_exec_stack)(exec_stack*);
-void CLG_(copy_current_exec_stack)(exec_stack*);
 void CLG_(set_current_exec_stack)(exec_stack*);
 void CLG_(pre_signal)(ThreadId tid, Int sigNum, Bool alt_stack);
 void CLG_(post_signal)(ThreadId tid, Int sigNum);
@@ -801,10 +907,18 @@ extern Bool SGL_(is_in_event_collect_func); //ML: long name? feel free to change
 extern SglCommandLineOptions SGL_(clo);
 extern Bool* SGL_(thread_in_synccall);
 extern ThreadId SGL_(active_tid);
+extern Bool SGL_(sample_skipping);
+extern Bool SGL_(fast_forward);
 
 #define EVENT_GENERATION_ENABLED  \
    (!SGL_(thread_in_synccall)[SGL_(active_tid)] && (SGL_(is_in_event_collect_func)))
 
+/* Per-instruction events (instructions, memory, compute) are dropped
+ * between sampling windows; function and sync events are still sent,
+ * so that the consumer's view of the program stays consistent */
+#define INSTR_EVENT_GENERATION_ENABLED  \
+   (EVENT_GENERATION_ENABLED && !SGL_(sample_skipping))
+
 extern CommandLineOptions CLG_(clo);
 extern Statistics CLG_(stat);
 extern EventMapping* CLG_(dumpmap);
@@ -814,8 +928,8 @@ extern UInt* CLG_(fn_active_array);
 extern Bool CLG_(instrument_state);
  /* min of L1 and LL cache line sizes */
 extern Int CLG_(min_line_size);
-extern call_stack CLG_(current_call_stack);
-extern fn_stack   CLG_(current_fn_stack);
+extern call_stack* CLG_(current_call_stack);
+extern fn_stack*   CLG_(current_fn_stack);
 extern exec_state CLG_(current_state);
 extern ThreadId   CLG_(current_tid);
 extern FullCost   CLG_(total_cost);
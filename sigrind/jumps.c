@@ -34,7 +34,7 @@
 
 #define N_JCC_INITIAL_ENTRIES  4437
 
-static jcc_hash current_jccs;
+static jcc_hash* current_jccs = 0;
 
 void CLG_(init_jcc_hash)(jcc_hash* jccs)
 {
@@ -53,24 +53,11 @@ void CLG_(init_jcc_hash)(jcc_hash* jccs)
 }
 
 
-void CLG_(copy_current_jcc_hash)(jcc_hash* dst)
-{
-  CLG_ASSERT(dst != 0);
-
-  dst->size        = current_jccs.size;
-  dst->entries     = current_jccs.entries;
-  dst->table       = current_jccs.table;
-  dst->spontaneous = current_jccs.spontaneous;
-}
-
 void CLG_(set_current_jcc_hash)(jcc_hash* h)
 {
   CLG_ASSERT(h != 0);
 
-  current_jccs.size        = h->size;
-  current_jccs.entries     = h->entries;
-  current_jccs.table       = h->table;
-  current_jccs.spontaneous = h->spontaneous;
+  current_jccs = h;
 }
 
 __inline__
@@ -87,17 +74,17 @@ static void resize_jcc_table(void)
     UInt new_idx;
     jCC *curr_jcc, *next_jcc;
 
-    new_size  = 2* current_jccs.size +3;
+    new_size  = 2* current_jccs->size +3;
     new_table = (jCC**) CLG_MALLOC("cl.jumps.rjt.1",
                                    new_size * sizeof(jCC*));
  
     for (i = 0; i < new_size; i++)
       new_table[i] = NULL;
  
-    for (i = 0; i < current_jccs.size; i++) {
-	if (current_jccs.table[i] == NULL) continue;
+    for (i = 0; i < current_jccs->size; i++) {
+	if (current_jccs->table[i] == NULL) continue;
  
-	curr_jcc = current_jccs.table[i];
+	curr_jcc = current_jccs->table[i];
 	while (NULL != curr_jcc) {
 	    next_jcc = curr_jcc->next_hash;
 
@@ -116,15 +103,15 @@ static void resize_jcc_table(void)
 	}
     }
 
-    VG_(free)(current_jccs.table);
+    VG_(free)(current_jccs->table);
 
 
     CLG_DEBUG(0, "Resize JCC Hash: %u => %d (entries %u, conflicts %d/%d)\n",
-	     current_jccs.size, new_size,
-	     current_jccs.entries, conflicts1, conflicts2);
+	     current_jccs->size, new_size,
+	     current_jccs->entries, conflicts1, conflicts2);
 
-    current_jccs.size  = new_size;
-    current_jccs.table = new_table;
+    current_jccs->size  = new_size;
+    current_jccs->table = new_table;
     CLG_(stat).jcc_hash_resizes++;
 }
 
@@ -139,8 +126,8 @@ static jCC* new_jcc(BBCC* from, UInt jmp, BBCC* to)
    UInt new_idx;
 
    /* check fill degree of jcc hash table and resize if needed (>80%) */
-   current_jccs.entries++;
-   if (10 * current_jccs.entries / current_jccs.size > 8)
+   current_jccs->entries++;
+   if (10 * current_jccs->entries / current_jccs->size > 8)
        resize_jcc_table();
 
    jcc = (jCC*) CLG_MALLOC("cl.jumps.nj.1", sizeof(jCC));
@@ -162,14 +149,14 @@ static jCC* new_jcc(BBCC* from, UInt jmp, BBCC* to)
        from->jmp[jmp].jcc_list = jcc;
    }
    else {
-       jcc->next_from = current_jccs.spontaneous;
-       current_jccs.spontaneous = jcc;
+       jcc->next_from = current_jccs->spontaneous;
+       current_jccs->spontaneous = jcc;
    }
 
    /* insert into JCC hash table */
-   new_idx = jcc_hash_idx(from, jmp, to, current_jccs.size);
-   jcc->next_hash = current_jccs.table[new_idx];
-   current_jccs.table[new_idx] = jcc;
+   new_idx = jcc_hash_idx(from, jmp, to, current_jccs->size);
+   jcc->next_hash = current_jccs->table[new_idx];
+   current_jccs->table[new_idx] = jcc;
 
    CLG_(stat).distinct_jccs++;
 
@@ -208,8 +195,8 @@ jCC* CLG_(get_jcc)(BBCC* from, UInt jmp, BBCC* to)
 
     CLG_(stat).jcc_lru_misses++;
 
-    idx = jcc_hash_idx(from, jmp, to, current_jccs.size);
-    jcc = current_jccs.table[idx];
+    idx = jcc_hash_idx(from, jmp, to, current_jccs->size);
+    jcc = current_jccs->table[idx];
 
     while(jcc) {
 	if ((jcc->from == from) &&
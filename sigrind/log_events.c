@@ -24,6 +24,7 @@ Copyright (C) 2003-2015, Josef Weidendorfer (Josef.Weidendorfer@gmx.de)
 
 #include "log_events.h"
 #include "sigil2_ipc.h"
+#include "sigil2_shmem.h"
 #include "coregrind/pub_core_libcprint.h"
 
 //TODO(someday) these aren't needed for Sigil, but deleting them causes
@@ -35,33 +36,10 @@ Copyright (C) 2003-2015, Josef Weidendorfer (Josef.Weidendorfer@gmx.de)
 Addr   CLG_(bb_base);
 ULong* CLG_(cost_base);
 
-//#define COUNT_EVENT_CHECK
-#ifdef COUNT_EVENT_CHECK
-static unsigned long long mem_events = 0;
-static unsigned long long comp_events = 0;
-static unsigned long long sync_events = 0;
-static unsigned long long cxt_events = 0;
-#endif
-
-void SGL_(end_logging)()
-{
-#ifdef COUNT_EVENT_CHECK
-    VG_(printf)("Total Mem Events: %llu\n",  mem_events);
-    VG_(printf)("Total Comp Events: %llu\n", comp_events);
-    VG_(printf)("Total Sync Events: %llu\n", sync_events);
-    VG_(printf)("Total Cxt Events: %llu\n",  cxt_events);
-#endif
-}
-
-
 void SGL_(log_1I0D)(InstrInfo* ii)
 {
-    if (EVENT_GENERATION_ENABLED)
+    if (INSTR_EVENT_GENERATION_ENABLED)
     {
-#ifdef COUNT_EVENT_CHECK
-        cxt_events++;
-#endif
-
         SglEvVariant* slot = SGL_(acq_event_slot)();
         slot->tag          = SGL_CXT_TAG;
         slot->cxt.type     = SGLPRIM_CXT_INSTR;
@@ -75,11 +53,19 @@ void SGL_(log_1I0D)(InstrInfo* ii)
    change addEvent_D_guarded too. */
 static inline void log_mem(Int type, Addr data_addr, Word data_size)
 {
-    if (EVENT_GENERATION_ENABLED)
+    if (INSTR_EVENT_GENERATION_ENABLED)
     {
-#ifdef COUNT_EVENT_CHECK
-        ++mem_events;
-#endif
+        if (SGL_(clo).reduce != 0)
+        {
+            SGL_(reduce_mem)(type, data_addr, data_size);
+            return;
+        }
+
+        if (SGL_(clo).coalesce_mem)
+        {
+            SGL_(coalesce_mem)(type, data_addr, data_size);
+            return;
+        }
 
         SglEvVariant* slot   = SGL_(acq_event_slot)();
         slot->tag            = SGL_MEM_TAG;
@@ -98,45 +84,64 @@ void SGL_(log_0I1Dw)(InstrInfo* ii, Addr data_addr, Word data_size)
 }
 
 
-void SGL_(log_comp_event)(InstrInfo* ii, IRType op_type, IRExprTag arity)
+void SGL_(fill_comp_event)(SglEvVariant* slot, IRType op_type, IRExprTag arity)
 {
     /* SIMD and decimal floating point are unsupported
      * See VEX/pub/libvex_ir.h : IROp
      * for future updates on specific ops */
     tl_assert(op_type < Ity_D32 || op_type == Ity_F128);
 
-    if (EVENT_GENERATION_ENABLED)
-    {
-#ifdef COUNT_EVENT_CHECK
-        ++comp_events;
-#endif
+    slot->tag = SGL_COMP_TAG;
 
-        SglEvVariant* slot = SGL_(acq_event_slot)();
-        slot->tag = SGL_COMP_TAG;
+    if (op_type < Ity_F16)
+        slot->comp.type = SGLPRIM_COMP_IOP;
+    else
+        slot->comp.type = SGLPRIM_COMP_FLOP;
 
-        if (op_type < Ity_F16)
-            slot->comp.type = SGLPRIM_COMP_IOP;
-        else
-            slot->comp.type = SGLPRIM_COMP_FLOP;
+    switch (arity)
+    {
+    case Iex_Unop:
+        slot->comp.arity = SGLPRIM_COMP_UNARY;
+        break;
+    case Iex_Binop:
+        slot->comp.arity = SGLPRIM_COMP_BINARY;
+        break;
+    case Iex_Triop:
+        slot->comp.arity = SGLPRIM_COMP_TERNARY;
+        break;
+    case Iex_Qop:
+        slot->comp.arity = SGLPRIM_COMP_QUARTERNARY;
+        break;
+    default:
+        tl_assert(False);
+        break;
+    }
+}
+void SGL_(log_comp_event)(InstrInfo* ii, IRType op_type, IRExprTag arity)
+{
+    if (INSTR_EVENT_GENERATION_ENABLED)
+    {
+        SGL_(fill_comp_event)(SGL_(acq_event_slot)(), op_type, arity);
+    }
+}
 
-        switch (arity)
-        {
-        case Iex_Unop:
-            slot->comp.arity = SGLPRIM_COMP_UNARY;
-            break;
-        case Iex_Binop:
-            slot->comp.arity = SGLPRIM_COMP_BINARY;
-            break;
-        case Iex_Triop:
-            slot->comp.arity = SGLPRIM_COMP_TERNARY;
-            break;
-        case Iex_Qop:
-            slot->comp.arity = SGLPRIM_COMP_QUARTERNARY;
-            break;
-        default:
-            tl_assert(False);
-            break;
-        }
+
+void SGL_(fill_vec_event)(SglEvVariant* slot, UWord sum)
+{
+    slot->tag        = SGL_COMP_TAG;
+    slot->comp.type  = (sum & VEC_SUMMARY_FLOP) ? SIGRIND_COMP_VEC_FLOP
+                                                : SIGRIND_COMP_VEC_IOP;
+    slot->comp.arity = sum & ~VEC_SUMMARY_FLOP;
+}
+void SGL_(log_vec_events)(UWord sum1, UWord sum2, UWord sum3)
+{
+    if (INSTR_EVENT_GENERATION_ENABLED)
+    {
+        SGL_(fill_vec_event)(SGL_(acq_event_slot)(), sum1);
+        if (sum2 != 0)
+            SGL_(fill_vec_event)(SGL_(acq_event_slot)(), sum2);
+        if (sum3 != 0)
+            SGL_(fill_vec_event)(SGL_(acq_event_slot)(), sum3);
     }
 }
 
@@ -145,10 +150,6 @@ void SGL_(log_sync)(UChar type, UWord data1, UWord data2)
 {
     if (SGL_(clo).gen_sync == True)
     {
-#ifdef COUNT_EVENT_CHECK
-        ++sync_events;
-#endif
-
         SglEvVariant* slot  = SGL_(acq_event_slot)();
         slot->tag           = SGL_SYNC_TAG;
         slot->sync.type     = type;
@@ -158,13 +159,41 @@ void SGL_(log_sync)(UChar type, UWord data1, UWord data2)
 }
 
 
+void SGL_(log_fn_name)(fn_node* fn)
+{
+    Int len;
+    EventNameSlotTuple tuple;
+
+    /* the name is only sent before the first use of the id */
+    if (fn->name_sent == True)
+        return;
+    fn->name_sent = True;
+
+    len   = sizeof(UInt) + VG_(strlen)(fn->name) + 1;
+    tuple = SGL_(acq_event_name_slot)(len);
+
+    VG_(memcpy)(tuple.name_slot, &fn->number, sizeof(UInt));
+    VG_(strcpy)(tuple.name_slot + sizeof(UInt), fn->name);
+    tuple.event_slot->tag      = SGL_CXT_TAG;
+    tuple.event_slot->cxt.type = SIGRIND_CXT_FUNC_NAME;
+    tuple.event_slot->cxt.len  = len;
+    tuple.event_slot->cxt.idx  = tuple.name_idx;
+}
 static inline void log_fn(Int type, fn_node* fn)
 {
     if (EVENT_GENERATION_ENABLED && SGL_(clo).gen_fn == True)
     {
-#ifdef COUNT_EVENT_CHECK
-        cxt_events++;
-#endif
+        if (SGL_(clo).intern_fn_names == True)
+        {
+            SGL_(log_fn_name)(fn);
+
+            SglEvVariant* slot = SGL_(acq_event_slot)();
+            slot->tag          = SGL_CXT_TAG;
+            slot->cxt.type     = (type == SGLPRIM_CXT_FUNC_ENTER) ?
+                                 SIGRIND_CXT_FUNC_ENTER_ID : SIGRIND_CXT_FUNC_EXIT_ID;
+            slot->cxt.id       = fn->number;
+            return;
+        }
 
         /* request both slots simultaneously to allow proper flushing */
         /* TODO set max size for name length? */
@@ -191,9 +220,37 @@ void SGL_(log_fn_leave)(fn_node* fn)
 /***************************
  * Aggregate event logging
  ***************************/
+/* Where blocks write their memory addresses while events are not generated */
+static SglEvVariant discarded_block[SGL_MAX_BLOCK_EVENTS];
+
+static void log_block_def(BB* bb)
+{
+    EventNameSlotTuple tuple = SGL_(acq_event_name_slot)(bb->def_size);
+    tuple.event_slot->tag      = SGL_CXT_TAG;
+    tuple.event_slot->cxt.type = SIGRIND_CXT_BLOCK_DEF;
+    tuple.event_slot->cxt.len  = bb->def_size;
+    tuple.event_slot->cxt.idx  = tuple.name_idx;
+    VG_(memcpy)(tuple.name_slot, bb->def, bb->def_size);
+}
+SglEvVariant* SGL_(log_block)(BB* bb)
+{
+    if (INSTR_EVENT_GENERATION_ENABLED)
+    {
+        /* the definition must precede the block's first BLOCK event */
+        if (bb->def != NULL && bb->def_sent == False)
+        {
+            log_block_def(bb);
+            bb->def_sent = True;
+        }
+        return SGL_(acq_block_slots)(bb->ev_template, bb->ev_count);
+    }
+
+    SGL_(end_block)();
+    return discarded_block;
+}
 void SGL_(log_2I0D)(InstrInfo* ii1, InstrInfo* ii2)
 {
-    if (EVENT_GENERATION_ENABLED)
+    if (INSTR_EVENT_GENERATION_ENABLED)
     {
         SGL_(log_1I0D)(ii1);
         SGL_(log_1I0D)(ii2);
@@ -201,7 +258,7 @@ void SGL_(log_2I0D)(InstrInfo* ii1, InstrInfo* ii2)
 }
 void SGL_(log_3I0D)(InstrInfo* ii1, InstrInfo* ii2, InstrInfo* ii3)
 {
-    if (EVENT_GENERATION_ENABLED)
+    if (INSTR_EVENT_GENERATION_ENABLED)
     {
         SGL_(log_1I0D)(ii1);
         SGL_(log_1I0D)(ii2);
@@ -210,7 +267,7 @@ void SGL_(log_3I0D)(InstrInfo* ii1, InstrInfo* ii2, InstrInfo* ii3)
 }
 void SGL_(log_1I1Dr)(InstrInfo* ii, Addr data_addr, Word data_size)
 {
-    if (EVENT_GENERATION_ENABLED)
+    if (INSTR_EVENT_GENERATION_ENABLED)
     {
         SGL_(log_1I0D)(ii);
         SGL_(log_0I1Dr)(ii, data_addr, data_size);
@@ -218,22 +275,108 @@ void SGL_(log_1I1Dr)(InstrInfo* ii, Addr data_addr, Word data_size)
 }
 void SGL_(log_1I1Dw)(InstrInfo* ii, Addr data_addr, Word data_size)
 {
-    if (EVENT_GENERATION_ENABLED)
+    if (INSTR_EVENT_GENERATION_ENABLED)
     {
         SGL_(log_1I0D)(ii);
         SGL_(log_0I1Dw)(ii, data_addr, data_size);
     }
 }
 
-/***************************
- * Unimplemented Logging
- ***************************/
-void SGL_(log_global_event)(InstrInfo* ii)
+
+static void log_branch_def(BB* bb)
 {
+    SigrindBranchDef def;
+    UInt i, offset;
+    Int len = sizeof(def) + bb->cjmp_count * sizeof(UInt);
+    EventNameSlotTuple tuple = SGL_(acq_event_name_slot)(len);
+
+    def.base_addr    = bb_addr(bb);
+    def.num_branches = bb->cjmp_count;
+    def.ind_branch   = bb->ind_exit ? 1 : 0;
+    VG_(memcpy)(tuple.name_slot, &def, sizeof(def));
+    for (i = 0; i < bb->cjmp_count; i++)
+    {
+        offset = bb->instr[bb->jmp[i].instr].instr_offset;
+        VG_(memcpy)(tuple.name_slot + sizeof(def) + i * sizeof(UInt),
+                    &offset, sizeof(UInt));
+    }
+
+    tuple.event_slot->tag      = SGL_CXT_TAG;
+    tuple.event_slot->cxt.type = SIGRIND_CXT_BRANCH_DEF;
+    tuple.event_slot->cxt.len  = len;
+    tuple.event_slot->cxt.idx  = tuple.name_idx;
+}
+void SGL_(log_branches)(BB* bb, Int passed, Addr target)
+{
+    /* outcomes per event, below the marker bit */
+    const Int max_bits = sizeof(UWord) * 8 - 1;
+    Int executed, first, n;
+    Bool taken;
+    UWord bits;
+
+    if (bb->cjmp_count == 0 && bb->ind_exit == False)
+        return;
+
+    if (INSTR_EVENT_GENERATION_ENABLED)
+    {
+        if (bb->branch_def_sent == False)
+        {
+            log_branch_def(bb);
+            bb->branch_def_sent = True;
+        }
+
+        /* all side exits before 'passed' fell through; the block left
+         * through side exit 'passed' if there is one */
+        taken    = (passed < bb->cjmp_count);
+        executed = taken ? passed + 1 : passed;
+        for (first = 0; first < executed; first += n)
+        {
+            n    = (executed - first < max_bits) ? executed - first : max_bits;
+            bits = (UWord)1 << n;
+            if (taken && first + n == executed)
+                bits |= (UWord)1 << (n - 1);
+
+            SglEvVariant* slot = SGL_(acq_event_slot)();
+            slot->tag          = SGL_CXT_TAG;
+            slot->cxt.type     = SIGRIND_CXT_BRANCHES;
+            slot->cxt.idx      = bb_addr(bb);
+            slot->cxt.len      = bits;
+        }
+
+        if (bb->ind_exit && !taken)
+        {
+            SglEvVariant* slot = SGL_(acq_event_slot)();
+            slot->tag          = SGL_CXT_TAG;
+            slot->cxt.type     = SIGRIND_CXT_IND_BRANCH;
+            slot->cxt.idx      = bb_jmpaddr(bb);
+            slot->cxt.len      = target;
+        }
+    }
 }
-void SGL_(log_cond_branch)(InstrInfo* ii, Word taken)
+void SGL_(log_bb)(BB* bb)
 {
+    if (INSTR_EVENT_GENERATION_ENABLED)
+    {
+        SglEvVariant* slot = SGL_(acq_event_slot)();
+        slot->tag          = SGL_CXT_TAG;
+        slot->cxt.type     = SIGRIND_CXT_BB;
+        slot->cxt.id       = bb_addr(bb);
+    }
 }
-void SGL_(log_ind_branch)(InstrInfo* ii, UWord actual_dst)
+
+/***************************
+ * Atomic event logging
+ ***************************/
+/* Atomic read-modify-write (CAS, LOCK-prefix, LL-SC) with --gen-atomics.
+ * The plain read/write of the location is also sent with --gen-mem. */
+VG_REGPARM(3) void SGL_(log_global_event)(InstrInfo* ii, Addr addr, Word size)
 {
+    if ( INSTR_EVENT_GENERATION_ENABLED && SGL_(clo).gen_atomics == True )
+    {
+        SglEvVariant* slot  = SGL_(acq_event_slot)();
+        slot->tag           = SGL_SYNC_TAG;
+        slot->sync.type     = (UChar)SIGRIND_SYNC_ATOMIC;
+        slot->sync.data[0]  = addr;
+        slot->sync.data[1]  = size;
+    }
 }
@@ -12,8 +12,6 @@
  * handling. This is how dynamic application info is sent to Sigil2.
  ********************************************************************/
 
-void SGL_(end_logging)(void);
-
 /* 1 Instruction */
 void SGL_(log_1I0D)(InstrInfo* ii);
 
@@ -37,6 +35,19 @@ void SGL_(log_0I1Dw)(InstrInfo* ii, Addr data_addr, Word data_size);
 
 /* 1 Compute event */
 void SGL_(log_comp_event)(InstrInfo* ii, IRType op_type, IRExprTag arity);
+void SGL_(fill_comp_event)(SglEvVariant* slot, IRType op_type, IRExprTag arity);
+
+/* Up to 3 vector compute summaries (0 if unused)
+ * A summary is the packed arity of a SIGRIND_COMP_VEC_* event,
+ * with VEC_SUMMARY_FLOP set for SIGRIND_COMP_VEC_FLOP */
+#define VEC_SUMMARY_FLOP (1U << 31)
+void SGL_(log_vec_events)(UWord sum1, UWord sum2, UWord sum3);
+void SGL_(fill_vec_event)(SglEvVariant* slot, UWord sum);
+
+/* All events of a superblock (--batch-events)
+ * Returns the slots the block writes its memory addresses to,
+ * laid out as bb->ev_template */
+SglEvVariant* SGL_(log_block)(BB* bb);
 
 /* Function fn entered */
 void SGL_(log_fn_entry)(fn_node* fn);
@@ -44,6 +55,9 @@ void SGL_(log_fn_entry)(fn_node* fn);
 /* Function fn exited */
 void SGL_(log_fn_leave)(fn_node* fn);
 
+/* SIGRIND_CXT_FUNC_NAME record for fn, if not sent yet */
+void SGL_(log_fn_name)(fn_node* fn);
+
 /* Synchronization event or thread context swap
  * Some sync events have two pieces of data,
  * e.g. mutex and condition variable in a conditional wait.
@@ -51,13 +65,14 @@ void SGL_(log_fn_leave)(fn_node* fn);
 #define UNUSED_SYNC_DATA 0
 void SGL_(log_sync)(UChar type, UWord data1, UWord data2);
 
-/* unimplemented */
-void SGL_(log_global_event)(InstrInfo* ii);
+/* Branches of the last executed BB, which passed 'passed' side exits
+ * (see CLG_(setup_bbcc)) and jumped to 'target' */
+void SGL_(log_branches)(BB* bb, Int passed, Addr target);
 
-/* unimplemented */
-void SGL_(log_cond_branch)(InstrInfo* ii, Word taken);
+/* BB entered */
+void SGL_(log_bb)(BB* bb);
 
-/* unimplemented */
-void SGL_(log_ind_branch)(InstrInfo* ii, UWord actual_dst);
+/* Atomic access of 'size' bytes at 'addr' (--gen-atomics) */
+VG_REGPARM(3) void SGL_(log_global_event)(InstrInfo* ii, Addr addr, Word size);
 
 #endif
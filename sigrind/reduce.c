@@ -0,0 +1,282 @@
+#include "global.h"
+#include "log_events.h"
+#include "sigil2_ipc.h"
+#include "sigil2_shmem.h"
+
+/* In-process reducers (--reduce=footprint,reuse)
+ *
+ * Memory accesses are folded into per-interval summaries instead of
+ * being sent as MEM events, see "Reducers" in sigil2_shmem.h.
+ *
+ * Every line ever touched has an entry in one open-addressing hash
+ * table, keyed by line number, which holds the access count at its last
+ * access (for reuse times) and the intervals it was last read and
+ * written in (for distinct lines per interval, without clearing the
+ * table).  Accesses to the line of the previous access skip the lookup. */
+
+typedef struct {
+   Addr  key;        /* line number + 1, 0: empty */
+   ULong last;       /* access count at the last access */
+   UInt  read_in;    /* interval of the last read, 0: never */
+   UInt  written_in; /* interval of the last write, 0: never */
+} LineEntry;
+
+#define LINES_INITIAL_BITS 16
+
+static LineEntry* lines = NULL;
+static UInt       lines_bits;
+static UWord      lines_used;
+static LineEntry* last_line = NULL;
+
+static UInt  line_shift;
+static ULong accesses;      /* total */
+static UInt  interval;      /* current interval, starting at 1 */
+static ULong interval_left; /* accesses until the next summary */
+
+static SigrindReduceSummary summary;
+static fn_node*             summary_fns = NULL;
+static UInt                 summary_num_fns;
+
+/* per SIGRIND_CXT_REDUCE_FNS event, fits into the smallest name buffer */
+#define FNS_PER_EVENT 128
+
+
+/*------------------------------------------------------------*/
+/*--- Line table                                           ---*/
+/*------------------------------------------------------------*/
+
+static __inline__ UWord line_hash(Addr key, UInt bits)
+{
+   return (UWord)(((ULong)key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+static void alloc_lines(UInt bits)
+{
+   SizeT size = ((SizeT)1 << bits) * sizeof(LineEntry);
+
+   lines_bits = bits;
+   lines = (LineEntry*) CLG_MALLOC("sgl.reduce.al.1", size);
+   VG_(memset)(lines, 0, size);
+}
+
+static void resize_lines(void)
+{
+   LineEntry* old = lines;
+   UWord old_size = (UWord)1 << lines_bits;
+   UWord i, mask, idx;
+
+   alloc_lines(lines_bits + 1);
+   mask = ((UWord)1 << lines_bits) - 1;
+   for (i = 0; i < old_size; i++) {
+      if (old[i].key == 0) continue;
+      idx = line_hash(old[i].key, lines_bits);
+      while (lines[idx].key != 0)
+         idx = (idx + 1) & mask;
+      lines[idx] = old[i];
+   }
+   CLG_FREE(old);
+
+   last_line = NULL;
+}
+
+static LineEntry* get_line(Addr key)
+{
+   UWord mask = ((UWord)1 << lines_bits) - 1;
+   UWord idx = line_hash(key, lines_bits);
+
+   while (lines[idx].key != key) {
+      if (lines[idx].key == 0) {
+         /* keep the load factor below 1/2 */
+         if (2 * (lines_used + 1) > mask + 1) {
+            resize_lines();
+            return get_line(key);
+         }
+         lines_used++;
+         summary.new_lines++;
+         lines[idx].key = key;
+         return &lines[idx];
+      }
+      idx = (idx + 1) & mask;
+   }
+
+   return &lines[idx];
+}
+
+static __inline__ UInt reuse_bucket(ULong time)
+{
+   UInt k = 0;
+
+   while (time > 1 && k < SIGRIND_REDUCE_BUCKETS - 2) {
+      time >>= 1;
+      k++;
+   }
+   return k;
+}
+
+static __inline__ void touch_line(Addr key, Int type)
+{
+   LineEntry* e = last_line;
+
+   if (e == NULL || e->key != key)
+      e = get_line(key);
+
+   if (SGL_(clo).reduce & SGL_REDUCE_REUSE) {
+      if (e->last == 0)
+         summary.reuse[SIGRIND_REDUCE_BUCKETS - 1]++;
+      else
+         summary.reuse[reuse_bucket(accesses - e->last)]++;
+      e->last = accesses;
+   }
+
+   if (SGL_(clo).reduce & SGL_REDUCE_FOOTPRINT) {
+      if (type == SGLPRIM_MEM_LOAD) {
+         if (e->read_in != interval) {
+            e->read_in = interval;
+            summary.lines_read++;
+         }
+      }
+      else if (e->written_in != interval) {
+         e->written_in = interval;
+         summary.lines_written++;
+      }
+   }
+
+   last_line = e;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Summaries                                            ---*/
+/*------------------------------------------------------------*/
+
+static void send_fns(void)
+{
+   SigrindReduceFn rec;
+   EventNameSlotTuple tuple;
+   fn_node* fn;
+   UInt n, i;
+
+   while (summary_fns != NULL) {
+      /* names first, they must not end up between the records */
+      n = 0;
+      for (fn = summary_fns; fn != NULL && n < FNS_PER_EVENT; fn = fn->reduce_next) {
+         SGL_(log_fn_name)(fn);
+         n++;
+      }
+
+      tuple = SGL_(acq_event_name_slot)(n * sizeof(rec));
+      tuple.event_slot->tag      = SGL_CXT_TAG;
+      tuple.event_slot->cxt.type = SIGRIND_CXT_REDUCE_FNS;
+      tuple.event_slot->cxt.len  = n * sizeof(rec);
+      tuple.event_slot->cxt.idx  = tuple.name_idx;
+
+      VG_(memset)(&rec, 0, sizeof(rec));
+      for (i = 0; i < n; i++) {
+         fn = summary_fns;
+         rec.read_bytes  = fn->reduce_read;
+         rec.write_bytes = fn->reduce_write;
+         rec.fn          = fn->number;
+         VG_(memcpy)(tuple.name_slot + i * sizeof(rec), &rec, sizeof(rec));
+
+         summary_fns      = fn->reduce_next;
+         fn->reduce_read  = 0;
+         fn->reduce_write = 0;
+         fn->reduce_next  = NULL;
+      }
+   }
+}
+
+static void send_summary(void)
+{
+   EventNameSlotTuple tuple;
+
+   summary.line_size = SGL_(clo).reduce_line_size;
+   summary.num_fns   = summary_num_fns;
+
+   tuple = SGL_(acq_event_name_slot)(sizeof(summary));
+   tuple.event_slot->tag      = SGL_CXT_TAG;
+   tuple.event_slot->cxt.type = SIGRIND_CXT_REDUCE;
+   tuple.event_slot->cxt.len  = sizeof(summary);
+   tuple.event_slot->cxt.idx  = tuple.name_idx;
+   VG_(memcpy)(tuple.name_slot, &summary, sizeof(summary));
+
+   send_fns();
+
+   CLG_DEBUG(1, "Reduce: interval %u, %llu accesses, %llu new lines\n",
+             interval, summary.accesses, summary.new_lines);
+
+   VG_(memset)(&summary, 0, sizeof(summary));
+   summary_num_fns = 0;
+   interval++;
+   interval_left = (ULong)SGL_(clo).reduce_interval * 1000000;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Interface                                            ---*/
+/*------------------------------------------------------------*/
+
+void SGL_(init_reduce)(void)
+{
+   UInt size = SGL_(clo).reduce_line_size;
+
+   line_shift = 0;
+   while ((1U << line_shift) < size)
+      line_shift++;
+
+   alloc_lines(LINES_INITIAL_BITS);
+   lines_used = 0;
+   accesses = 0;
+   interval = 1;
+   interval_left = (ULong)SGL_(clo).reduce_interval * 1000000;
+   VG_(memset)(&summary, 0, sizeof(summary));
+   summary_num_fns = 0;
+}
+
+void SGL_(reduce_mem)(Int type, Addr addr, Word size)
+{
+   Addr first = addr >> line_shift;
+   Addr last  = (addr + (size > 0 ? size - 1 : 0)) >> line_shift;
+   Context* cxt;
+   fn_node* fn;
+
+   accesses++;
+   summary.accesses++;
+
+   touch_line(first + 1, type);
+   if (last != first)
+      touch_line(last + 1, type);
+
+   if (SGL_(clo).reduce & SGL_REDUCE_FOOTPRINT) {
+      if (type == SGLPRIM_MEM_LOAD)
+         summary.read_bytes += size;
+      else
+         summary.write_bytes += size;
+
+      cxt = CLG_(current_state).cxt;
+      if (cxt != NULL) {
+         fn = cxt->fn[0];
+         if (fn->reduce_read == 0 && fn->reduce_write == 0) {
+            fn->reduce_next = summary_fns;
+            summary_fns = fn;
+            summary_num_fns++;
+         }
+         if (type == SGLPRIM_MEM_LOAD)
+            fn->reduce_read += size;
+         else
+            fn->reduce_write += size;
+      }
+   }
+
+   if (--interval_left == 0)
+      send_summary();
+}
+
+void SGL_(finish_reduce)(void)
+{
+   if (summary.accesses > 0)
+      send_summary();
+
+   VG_(umsg)("Reduce: %llu accesses in %u summaries, %lu distinct lines\n",
+             accesses, interval - 1, lines_used);
+}
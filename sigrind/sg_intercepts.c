@@ -0,0 +1,449 @@
+/*--------------------------------------------------------------------*/
+/*--- Sigrind synchronization intercepts.                          ---*/
+/*---                                              sg_intercepts.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Sigrind, a Valgrind tool for generating
+   Sigil2 event streams.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* RUNS ON SIMULATED CPU
+   Wrappers for the synchronization functions that the Sigil2 wrapper
+   library does not cover: reader-writer locks, POSIX semaphores and
+   C11 threads.  They are modelled after helgrind's hg_intercepts.c and
+   bracket the real call with SIGIL_* client requests (see callgrind.h),
+   so that sg_main.c can log the matching SYNC events.
+
+   Pthread create/join/mutex/cond/barrier/spin and the GOMP functions are
+   still wrapped by the Sigil2 library; they must not be wrapped here as
+   well, or every event would be sent twice.
+
+   Since glibc 2.34 the pthread and C11 thread functions live in libc,
+   so every function is wrapped in both libpthread and libc.  Only one
+   of them defines the symbol for any given glibc. */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_redir.h"
+#include "pub_tool_clreq.h"
+#include "callgrind.h"
+#include "config.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+
+#define SGL_FUNC(ret_ty, soname, f, args...) \
+   ret_ty I_WRAP_SONAME_FNNAME_ZZ(soname,f)(args); \
+   ret_ty I_WRAP_SONAME_FNNAME_ZZ(soname,f)(args)
+
+/* wrap f in libpthread and libc, calling wrk(call_args...) */
+#define SGL_WRAP(f, wrk, params, call_args)                               \
+   SGL_FUNC(int, VG_Z_LIBPTHREAD_SONAME, f, params) { return wrk call_args; } \
+   SGL_FUNC(int, VG_Z_LIBC_SONAME, f, params) { return wrk call_args; }
+
+#define SGL_PARAMS(args...) args
+
+
+/*----------------------------------------------------------------*/
+/*--- pthread_rwlock_t functions                               ---*/
+/*----------------------------------------------------------------*/
+
+/* A failed (try, timed) lock ends with SIGIL_SYNC_FAILED instead of
+   the LEAVE request, so that no event is sent for it. */
+
+static int rwlock_rdlock_WRK(pthread_rwlock_t* rwlock)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_RDLOCK_ENTER(rwlock);
+   CALL_FN_W_W(ret, fn, rwlock);
+   if (ret == 0)
+      SIGIL_PTHREAD_RDLOCK_LEAVE(rwlock);
+   else
+      SIGIL_SYNC_FAILED(rwlock);
+   return ret;
+}
+
+static int rwlock_timedrdlock_WRK(pthread_rwlock_t* rwlock,
+                                  const struct timespec* abstime)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_RDLOCK_ENTER(rwlock);
+   CALL_FN_W_WW(ret, fn, rwlock, abstime);
+   if (ret == 0)
+      SIGIL_PTHREAD_RDLOCK_LEAVE(rwlock);
+   else
+      SIGIL_SYNC_FAILED(rwlock);
+   return ret;
+}
+
+static int rwlock_clockrdlock_WRK(pthread_rwlock_t* rwlock, clockid_t clock,
+                                  const struct timespec* abstime)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_RDLOCK_ENTER(rwlock);
+   CALL_FN_W_WWW(ret, fn, rwlock, clock, abstime);
+   if (ret == 0)
+      SIGIL_PTHREAD_RDLOCK_LEAVE(rwlock);
+   else
+      SIGIL_SYNC_FAILED(rwlock);
+   return ret;
+}
+
+static int rwlock_wrlock_WRK(pthread_rwlock_t* rwlock)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_WRLOCK_ENTER(rwlock);
+   CALL_FN_W_W(ret, fn, rwlock);
+   if (ret == 0)
+      SIGIL_PTHREAD_WRLOCK_LEAVE(rwlock);
+   else
+      SIGIL_SYNC_FAILED(rwlock);
+   return ret;
+}
+
+static int rwlock_timedwrlock_WRK(pthread_rwlock_t* rwlock,
+                                  const struct timespec* abstime)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_WRLOCK_ENTER(rwlock);
+   CALL_FN_W_WW(ret, fn, rwlock, abstime);
+   if (ret == 0)
+      SIGIL_PTHREAD_WRLOCK_LEAVE(rwlock);
+   else
+      SIGIL_SYNC_FAILED(rwlock);
+   return ret;
+}
+
+static int rwlock_clockwrlock_WRK(pthread_rwlock_t* rwlock, clockid_t clock,
+                                  const struct timespec* abstime)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_WRLOCK_ENTER(rwlock);
+   CALL_FN_W_WWW(ret, fn, rwlock, clock, abstime);
+   if (ret == 0)
+      SIGIL_PTHREAD_WRLOCK_LEAVE(rwlock);
+   else
+      SIGIL_SYNC_FAILED(rwlock);
+   return ret;
+}
+
+static int rwlock_unlock_WRK(pthread_rwlock_t* rwlock)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_RWUNLOCK_ENTER(rwlock);
+   CALL_FN_W_W(ret, fn, rwlock);
+   SIGIL_PTHREAD_RWUNLOCK_LEAVE(rwlock);
+   return ret;
+}
+
+SGL_WRAP(pthreadZurwlockZurdlock, rwlock_rdlock_WRK, // pthread_rwlock_rdlock
+         SGL_PARAMS(pthread_rwlock_t* rwlock), (rwlock))
+SGL_WRAP(pthreadZurwlockZutryrdlock, rwlock_rdlock_WRK, // pthread_rwlock_tryrdlock
+         SGL_PARAMS(pthread_rwlock_t* rwlock), (rwlock))
+SGL_WRAP(pthreadZurwlockZutimedrdlock, rwlock_timedrdlock_WRK, // pthread_rwlock_timedrdlock
+         SGL_PARAMS(pthread_rwlock_t* rwlock, const struct timespec* t),
+         (rwlock, t))
+SGL_WRAP(pthreadZurwlockZuclockrdlock, rwlock_clockrdlock_WRK, // pthread_rwlock_clockrdlock
+         SGL_PARAMS(pthread_rwlock_t* rwlock, clockid_t c,
+                    const struct timespec* t), (rwlock, c, t))
+
+SGL_WRAP(pthreadZurwlockZuwrlock, rwlock_wrlock_WRK, // pthread_rwlock_wrlock
+         SGL_PARAMS(pthread_rwlock_t* rwlock), (rwlock))
+SGL_WRAP(pthreadZurwlockZutrywrlock, rwlock_wrlock_WRK, // pthread_rwlock_trywrlock
+         SGL_PARAMS(pthread_rwlock_t* rwlock), (rwlock))
+SGL_WRAP(pthreadZurwlockZutimedwrlock, rwlock_timedwrlock_WRK, // pthread_rwlock_timedwrlock
+         SGL_PARAMS(pthread_rwlock_t* rwlock, const struct timespec* t),
+         (rwlock, t))
+SGL_WRAP(pthreadZurwlockZuclockwrlock, rwlock_clockwrlock_WRK, // pthread_rwlock_clockwrlock
+         SGL_PARAMS(pthread_rwlock_t* rwlock, clockid_t c,
+                    const struct timespec* t), (rwlock, c, t))
+
+SGL_WRAP(pthreadZurwlockZuunlock, rwlock_unlock_WRK, // pthread_rwlock_unlock
+         SGL_PARAMS(pthread_rwlock_t* rwlock), (rwlock))
+
+
+/*----------------------------------------------------------------*/
+/*--- POSIX semaphores                                         ---*/
+/*----------------------------------------------------------------*/
+
+static int sem_wait_WRK(sem_t* sem)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_SEM_WAIT_ENTER(sem);
+   CALL_FN_W_W(ret, fn, sem);
+   if (ret == 0)
+      SIGIL_SEM_WAIT_LEAVE(sem);
+   else
+      SIGIL_SYNC_FAILED(sem);
+   return ret;
+}
+
+static int sem_timedwait_WRK(sem_t* sem, const struct timespec* abstime)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_SEM_WAIT_ENTER(sem);
+   CALL_FN_W_WW(ret, fn, sem, abstime);
+   if (ret == 0)
+      SIGIL_SEM_WAIT_LEAVE(sem);
+   else
+      SIGIL_SYNC_FAILED(sem);
+   return ret;
+}
+
+static int sem_clockwait_WRK(sem_t* sem, clockid_t clock,
+                             const struct timespec* abstime)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_SEM_WAIT_ENTER(sem);
+   CALL_FN_W_WWW(ret, fn, sem, clock, abstime);
+   if (ret == 0)
+      SIGIL_SEM_WAIT_LEAVE(sem);
+   else
+      SIGIL_SYNC_FAILED(sem);
+   return ret;
+}
+
+/* logged before the post, which may let the waiter run at once */
+static int sem_post_WRK(sem_t* sem)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_SEM_POST_ENTER(sem);
+   CALL_FN_W_W(ret, fn, sem);
+   SIGIL_SEM_POST_LEAVE(sem);
+   return ret;
+}
+
+SGL_WRAP(semZuwait, sem_wait_WRK, // sem_wait
+         SGL_PARAMS(sem_t* sem), (sem))
+SGL_WRAP(semZuwaitZAZa, sem_wait_WRK, // sem_wait@*
+         SGL_PARAMS(sem_t* sem), (sem))
+SGL_WRAP(semZutrywait, sem_wait_WRK, // sem_trywait
+         SGL_PARAMS(sem_t* sem), (sem))
+SGL_WRAP(semZutrywaitZAZa, sem_wait_WRK, // sem_trywait@*
+         SGL_PARAMS(sem_t* sem), (sem))
+SGL_WRAP(semZutimedwait, sem_timedwait_WRK, // sem_timedwait
+         SGL_PARAMS(sem_t* sem, const struct timespec* t), (sem, t))
+SGL_WRAP(semZuclockwait, sem_clockwait_WRK, // sem_clockwait
+         SGL_PARAMS(sem_t* sem, clockid_t c, const struct timespec* t),
+         (sem, c, t))
+
+SGL_WRAP(semZupost, sem_post_WRK, // sem_post
+         SGL_PARAMS(sem_t* sem), (sem))
+SGL_WRAP(semZupostZAZa, sem_post_WRK, // sem_post@*
+         SGL_PARAMS(sem_t* sem), (sem))
+
+
+/*----------------------------------------------------------------*/
+/*--- C11 threads                                              ---*/
+/*----------------------------------------------------------------*/
+
+/* <threads.h> is not available everywhere, but in glibc the types are
+   pthread types underneath: thrd_t is a pthread_t, and mtx_t and cnd_t
+   are only passed by pointer here.  The C11 functions do not call the
+   public pthread functions, so the Sigil2 library does not see them;
+   they are reported as their pthread counterparts. */
+
+#define SGL_THRD_SUCCESS 0  /* thrd_success */
+
+typedef int (*sgl_thrd_start_t)(void*);
+
+static int thrd_create_WRK(pthread_t* thr, sgl_thrd_start_t func, void* arg)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_CREATE_ENTER(thr);
+   CALL_FN_W_WWW(ret, fn, thr, func, arg);
+   if (ret == SGL_THRD_SUCCESS)
+      SIGIL_PTHREAD_CREATE_LEAVE(*thr);
+   else
+      SIGIL_SYNC_FAILED(thr);
+   return ret;
+}
+
+static int thrd_join_WRK(pthread_t thr, int* res)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_JOIN_ENTER(thr);
+   CALL_FN_W_WW(ret, fn, thr, res);
+   SIGIL_PTHREAD_JOIN_LEAVE(thr);
+   return ret;
+}
+
+static int mtx_lock_WRK(void* mtx)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_LOCK_ENTER(mtx);
+   CALL_FN_W_W(ret, fn, mtx);
+   if (ret == SGL_THRD_SUCCESS)
+      SIGIL_PTHREAD_LOCK_LEAVE(mtx);
+   else
+      SIGIL_SYNC_FAILED(mtx);
+   return ret;
+}
+
+static int mtx_timedlock_WRK(void* mtx, const struct timespec* abstime)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_LOCK_ENTER(mtx);
+   CALL_FN_W_WW(ret, fn, mtx, abstime);
+   if (ret == SGL_THRD_SUCCESS)
+      SIGIL_PTHREAD_LOCK_LEAVE(mtx);
+   else
+      SIGIL_SYNC_FAILED(mtx);
+   return ret;
+}
+
+static int mtx_unlock_WRK(void* mtx)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_UNLOCK_ENTER(mtx);
+   CALL_FN_W_W(ret, fn, mtx);
+   SIGIL_PTHREAD_UNLOCK_LEAVE(mtx);
+   return ret;
+}
+
+static int cnd_wait_WRK(void* cnd, void* mtx)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_CONDWAIT_ENTER(cnd, mtx);
+   CALL_FN_W_WW(ret, fn, cnd, mtx);
+   SIGIL_PTHREAD_CONDWAIT_LEAVE(cnd, mtx);
+   return ret;
+}
+
+/* the mutex is held again after a timeout too */
+static int cnd_timedwait_WRK(void* cnd, void* mtx,
+                             const struct timespec* abstime)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_CONDWAIT_ENTER(cnd, mtx);
+   CALL_FN_W_WWW(ret, fn, cnd, mtx, abstime);
+   SIGIL_PTHREAD_CONDWAIT_LEAVE(cnd, mtx);
+   return ret;
+}
+
+static int cnd_signal_WRK(void* cnd)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_CONDSIG_ENTER(cnd);
+   CALL_FN_W_W(ret, fn, cnd);
+   SIGIL_PTHREAD_CONDSIG_LEAVE(cnd);
+   return ret;
+}
+
+static int cnd_broadcast_WRK(void* cnd)
+{
+   int    ret;
+   OrigFn fn;
+   VALGRIND_GET_ORIG_FN(fn);
+
+   SIGIL_PTHREAD_CONDBROAD_ENTER(cnd);
+   CALL_FN_W_W(ret, fn, cnd);
+   SIGIL_PTHREAD_CONDBROAD_LEAVE(cnd);
+   return ret;
+}
+
+SGL_WRAP(thrdZucreate, thrd_create_WRK, // thrd_create
+         SGL_PARAMS(pthread_t* thr, sgl_thrd_start_t func, void* arg),
+         (thr, func, arg))
+SGL_WRAP(thrdZujoin, thrd_join_WRK, // thrd_join
+         SGL_PARAMS(pthread_t thr, int* res), (thr, res))
+
+SGL_WRAP(mtxZulock, mtx_lock_WRK, // mtx_lock
+         SGL_PARAMS(void* mtx), (mtx))
+SGL_WRAP(mtxZutrylock, mtx_lock_WRK, // mtx_trylock
+         SGL_PARAMS(void* mtx), (mtx))
+SGL_WRAP(mtxZutimedlock, mtx_timedlock_WRK, // mtx_timedlock
+         SGL_PARAMS(void* mtx, const struct timespec* t), (mtx, t))
+SGL_WRAP(mtxZuunlock, mtx_unlock_WRK, // mtx_unlock
+         SGL_PARAMS(void* mtx), (mtx))
+
+SGL_WRAP(cndZuwait, cnd_wait_WRK, // cnd_wait
+         SGL_PARAMS(void* cnd, void* mtx), (cnd, mtx))
+SGL_WRAP(cndZutimedwait, cnd_timedwait_WRK, // cnd_timedwait
+         SGL_PARAMS(void* cnd, void* mtx, const struct timespec* t),
+         (cnd, mtx, t))
+SGL_WRAP(cndZusignal, cnd_signal_WRK, // cnd_signal
+         SGL_PARAMS(void* cnd), (cnd))
+SGL_WRAP(cndZubroadcast, cnd_broadcast_WRK, // cnd_broadcast
+         SGL_PARAMS(void* cnd), (cnd))
+
+
+/*--------------------------------------------------------------------*/
+/*--- end                                          sg_intercepts.c ---*/
+/*--------------------------------------------------------------------*/
@@ -40,6 +40,7 @@
 #include "callgrind.h"
 
 #include "sigil2_ipc.h"
+#include "sigil2_shmem.h"
 #include "log_events.h"
 #include "Core/PrimitiveEnums.h"
 
@@ -47,7 +48,9 @@
 #include "coregrind/pub_core_clientstate.h"
 #include "pub_tool_threadstate.h"
 #include "pub_tool_gdbserver.h"
-#include "pub_tool_transtab.h"       // VG_(discard_translations_safely)
+#include "pub_tool_transtab.h"       // VG_(discard_translations_safely),
+                                     // VG_(request_discard_translations)
+#include "pub_tool_vkiscnums.h"      // __NR_futex
 
 
 /*------------------------------------------------------------*/
@@ -125,6 +128,8 @@ struct _Event {
          IRAtom* dst;
       } Bi;
       struct {
+         IRAtom* ea;
+         Int     szB;
       } G;
       struct {
          IRExprTag arity;
@@ -139,6 +144,9 @@ struct _Event {
    address temporaries. */
 #define N_EVENTS 16
 
+/* Distinct vector op shapes summarized at a time, one helper call */
+#define N_VEC_PENDING 3
+
 /* A struct which holds all the running state during instrumentation.
    Mostly to avoid passing loads of parameters everywhere. */
 typedef struct {
@@ -160,8 +168,36 @@ typedef struct {
 
     /* The output SB being constructed. */
     IRSB* sbOut;
+
+    /* --batch-events: the events of this block are collected in
+       ev_template instead of being passed to helpers; memory addresses
+       are stored into the block's slots, which start at ev_slots. */
+    Bool          batch;
+    IRTemp        ev_slots;
+    SglEvVariant* ev_template;
+    UInt          ev_count;
+
+    /* --block-defs: instruction markers are collected in 'markers'
+       instead of the template, which then starts with the BLOCK event;
+       ev_pos counts markers and template events */
+    SigrindBlockDefInstr* markers;
+    UInt                  num_markers;
+    UInt                  ev_pos;
+
+    /* skip translation (see "Retranslation"): only setup_bbcc is
+       called, all events are dropped */
+    Bool          skip;
+
+    /* vector ops since the last exit, merged by shape
+       (see "Vector compute events" in sigil2_shmem.h) */
+    UWord vec_pending[N_VEC_PENDING];
+    UInt  vec_used;
 } ClgState;
 
+static SglEvVariant         block_template[SGL_MAX_BLOCK_EVENTS];
+static SigrindBlockDefInstr block_markers[SGL_MAX_BLOCK_EVENTS];
+static ULong                next_block_id = 0;
+
 /*------------------------------------------------------------*/
 /*--- Global variables                                     ---*/
 /*------------------------------------------------------------*/
@@ -183,8 +219,13 @@ exec_state CLG_(current_state);
 /*------------------------------------------------------------*/
 
 static void flushEvents ( ClgState* clgs );
+static void flushEventsBatch ( ClgState* clgs );
 static void addEvent_Comp( ClgState* clgs, InstrInfo* inode, IRExprTag arity, IRType op_type );
-static void addEvent_G ( ClgState* clgs, InstrInfo* inode );
+static void addEvent_VecComp( ClgState* clgs, IRExprTag arity, UInt type,
+                              UInt lanes, UInt bits );
+static void flushVecEvents ( ClgState* clgs );
+static void addEvent_G ( ClgState* clgs, InstrInfo* inode, Int datasize,
+                         IRAtom* ea );
 static void addEvent_Bi ( ClgState* clgs, InstrInfo* inode, IRAtom* whereTo );
 static void addEvent_Bc ( ClgState* clgs, InstrInfo* inode, IRAtom* guard );
 static void addEvent_D_guarded ( ClgState* clgs, InstrInfo* inode,
@@ -203,13 +244,69 @@ static Int get_Event_dszB ( Event* ev );
 static void showEvent ( Event* ev );
 static Addr IRConst2Addr(IRConst* con);
 static void addConstMemStoreStmt( IRSB* bbOut, UWord addr, UInt val, IRType hWordTy);
+static void addSlotStoreStmt( ClgState* clgs, UInt slot, UInt offset, IRAtom* data );
+static void addBlockUsedStmts( ClgState* clgs, IRType hWordTy );
+static void setBlockDef( ClgState* clgs, Addr origAddr );
+static UInt count_block_events( IRSB* sbIn );
 
 
 
+/*------------------------------------------------------------*/
+/*--- Retranslation                                        ---*/
+/*------------------------------------------------------------*/
+
+/* While events are not collected (fast-forward, --fast-forward=yes) and
+ * between sampling windows, blocks are translated with only the call to
+ * setup_bbcc, which keeps function tracking alive, and no event helpers
+ * (see ClgState.skip).
+ *
+ * Switching between skip and full translations discards all of them,
+ * like CLG_(set_instrument_state).  The switch happens in setup_bbcc,
+ * inside generated code, where VG_(discard_translations_safely) is not
+ * allowed, so the discard is requested from the core instead.  The
+ * current block still runs with its old translation; the next one is
+ * translated in the new mode. */
+
+Bool SGL_(fast_forward) = False;
+
+void SGL_(request_retranslation)(void)
+{
+   VG_(request_discard_translations)( (Addr)0x1000, ~(SizeT)0xfff, "sigrind" );
+}
+
+void SGL_(set_fast_forward)(Bool state)
+{
+   if (SGL_(clo).fast_forward == False || SGL_(fast_forward) == state)
+      return;
+
+   CLG_DEBUG(1, "Fast-forward %s\n", state ? "ON" : "OFF");
+   SGL_(fast_forward) = state;
+   SGL_(request_retranslation)();
+}
+
+/* Blocks of the functions that turn on event collection are always
+ * fully instrumented, so that no events are lost in the block where
+ * fast-forward ends */
+static Bool starts_collection(BB* bb)
+{
+   fn_node* fn = CLG_(get_fn_node)(bb);
+
+   return fn->collect_in || fn->collect_start;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Instrumentation                                      ---*/
 /*------------------------------------------------------------*/
 
+/* --batch-events: setup_bbcc and the slot reservation for the whole BB
+ * in one helper call */
+static VG_REGPARM(1) SglEvVariant* setup_bbcc_batch(BB* bb)
+{
+   CLG_(setup_bbcc)(bb);
+   return SGL_(log_block)(bb);
+}
+
 /* add helper call to setup_bbcc, with pointer to BB struct as argument
  *
  * precondition for setup_bbcc:
@@ -233,9 +330,17 @@ static void addBBSetupCall(ClgState* clgs)
 
    arg1 = mkIRExpr_HWord( (HWord)clgs->bb );
    argv = mkIRExprVec_1(arg1);
-   di = unsafeIRDirty_0_N( 1, "setup_bbcc",
-			      VG_(fnptr_to_fnentry)( & CLG_(setup_bbcc) ),
-			      argv);
+   if (clgs->batch) {
+      clgs->ev_slots = newIRTemp(clgs->sbOut->tyenv,
+                                 sizeof(HWord)==4 ? Ity_I32 : Ity_I64);
+      di = unsafeIRDirty_1_N( clgs->ev_slots, 1, "setup_bbcc_batch",
+                              VG_(fnptr_to_fnentry)( & setup_bbcc_batch ),
+                              argv);
+   }
+   else
+      di = unsafeIRDirty_0_N( 1, "setup_bbcc",
+                              VG_(fnptr_to_fnentry)( & CLG_(setup_bbcc) ),
+                              argv);
    addStmtToIRSB( clgs->sbOut, IRStmt_Dirty(di) );
 }
 
@@ -295,10 +400,31 @@ static IRSB* CLG_(instrument)( VgCallbackClosure* closure,
     */
    clgs.bb = CLG_(get_bb)(origAddr, sbIn, &(clgs.seen_before));
 
+   clgs.skip = SGL_(sample_skipping) ||
+               (SGL_(fast_forward) && !starts_collection(clgs.bb));
+   clgs.batch = False;
+   if (SGL_(clo).batch_events && !clgs.skip) {
+      UInt max_events = count_block_events(sbIn);
+      clgs.batch = (max_events > 0 && max_events <= SGL_MAX_BLOCK_EVENTS);
+   }
+   clgs.ev_template = block_template;
+   clgs.ev_count = 0;
+   clgs.markers = block_markers;
+   clgs.num_markers = 0;
+   clgs.ev_pos = 0;
+   if (clgs.batch && SGL_(clo).block_defs) {
+      /* filled in at the end of the block */
+      VG_(memset)(&clgs.ev_template[0], 0, sizeof(SglEvVariant));
+      clgs.ev_template[0].tag      = SGL_CXT_TAG;
+      clgs.ev_template[0].cxt.type = SIGRIND_CXT_BLOCK;
+      clgs.ev_count = 1;
+   }
+
    addBBSetupCall(&clgs);
 
    // Set up running state
    clgs.events_used = 0;
+   clgs.vec_used = 0;
    clgs.ii_index = 0;
    clgs.instr_offset = 0;
 
@@ -360,9 +486,30 @@ static IRSB* CLG_(instrument)( VgCallbackClosure* closure,
                   if (SGL_(clo).gen_comp == True)
                   {
                      IRType op_type = typeOfIRExpr(sbIn->tyenv, data);
-                     /* SIMD and decimal floating point ops are unsupported.
+                     IROp   op;
+                     UInt   type, lanes, bits;
+
+                     switch (data->tag) {
+                        case Iex_Unop:  op = data->Iex.Unop.op; break;
+                        case Iex_Binop: op = data->Iex.Binop.op; break;
+                        case Iex_Triop: op = data->Iex.Triop.details->op; break;
+                        default:        op = data->Iex.Qop.details->op; break;
+                     }
+
+                     /* SIMD ops are summarized per exit; whole-register
+                      * ops without lanes count as one wide lane */
+                     type = SGL_(vec_op_shape)(op, &lanes, &bits);
+                     if (type == 0 && (op_type == Ity_V128 || op_type == Ity_V256)) {
+                        type  = SIGRIND_COMP_VEC_IOP;
+                        lanes = 1;
+                        bits  = (op_type == Ity_V128) ? 128 : 256;
+                     }
+
+                     if (type != 0)
+                        addEvent_VecComp( &clgs, data->tag, type, lanes, bits );
+                     /* Decimal floating point ops are unsupported.
                       * See VEX/pub/libvex_ir.h */
-                     if (op_type < Ity_D32 || op_type == Ity_F128)
+                     else if (op_type < Ity_D32 || op_type == Ity_F128)
                         addEvent_Comp( &clgs, curr_inode, data->tag, op_type );
                   }
                   break;
@@ -456,7 +603,7 @@ static IRSB* CLG_(instrument)( VgCallbackClosure* closure,
                addEvent_Dr( &clgs, curr_inode, dataSize, cas->addr );
                addEvent_Dw( &clgs, curr_inode, dataSize, cas->addr );
             }
-            addEvent_G(  &clgs, curr_inode );
+            addEvent_G(  &clgs, curr_inode, dataSize, cas->addr );
             break;
          }
          case Ist_LLSC:
@@ -477,7 +624,8 @@ static IRSB* CLG_(instrument)( VgCallbackClosure* closure,
                   really matter since they always have to be used in
                   pairs anyway.  Hence put it (quite arbitrarily) on
                   the SC. */
-               addEvent_G(  &clgs, curr_inode );
+               addEvent_G(  &clgs, curr_inode, sizeofIRType(dataTy),
+                            st->Ist.LLSC.addr );
             }
             break;
          case Ist_Exit: {
@@ -542,6 +690,11 @@ static IRSB* CLG_(instrument)( VgCallbackClosure* closure,
             /* We may never reach the next statement, so need to flush
                all outstanding transactions now. */
             flushEvents( &clgs );
+            flushVecEvents( &clgs );
+
+            /* Number of events done if the exit is taken */
+            if (clgs.batch)
+               addBlockUsedStmts( &clgs, hWordTy );
 
             CLG_ASSERT(clgs.ii_index>0);
             if (!clgs.seen_before) {
@@ -600,6 +753,7 @@ static IRSB* CLG_(instrument)( VgCallbackClosure* closure,
          case Iex_RdTmp:
             /* looks like an indirect branch (branch to unknown) */
             addEvent_Bi( &clgs, curr_inode, sbIn->next );
+            clgs.bb->ind_exit = True;
             break;
          default:
             /* shouldn't happen - if the incoming IR is properly
@@ -611,6 +765,7 @@ static IRSB* CLG_(instrument)( VgCallbackClosure* closure,
 
    /* At the end of the bb.  Flush outstandings. */
    flushEvents( &clgs );
+   flushVecEvents( &clgs );
 
    /* Update global variable jmps_passed at end of SB.
     * As CLG_(current_state).jmps_passed is reset to 0 in setup_bbcc,
@@ -627,6 +782,27 @@ static IRSB* CLG_(instrument)( VgCallbackClosure* closure,
    CLG_ASSERT(clgs.bb->cjmp_count == cJumps);
    CLG_ASSERT(clgs.bb->instr_count == clgs.ii_index);
 
+   /* As with jmps_passed, the count of done events only needs to be
+    * restored if a side exit changed it. The template is read by
+    * setup_bbcc_batch at run time. */
+   if (clgs.batch) {
+      if (cJumps>0)
+         addBlockUsedStmts( &clgs, hWordTy );
+
+      if (SGL_(clo).block_defs)
+         setBlockDef( &clgs, origAddr );
+
+      if (clgs.bb->ev_template)
+         CLG_FREE(clgs.bb->ev_template);
+      clgs.bb->ev_template = NULL;
+      clgs.bb->ev_count = clgs.ev_count;
+      if (clgs.ev_count > 0) {
+         SizeT size = clgs.ev_count * sizeof(SglEvVariant);
+         clgs.bb->ev_template = (SglEvVariant*) CLG_MALLOC("sgl.instrument.1", size);
+         VG_(memcpy)(clgs.bb->ev_template, clgs.ev_template, size);
+      }
+   }
+
    /* Info for final exit from BB */
    {
      ClgJumpKind jk;
@@ -696,6 +872,16 @@ static void flushEvents ( ClgState* clgs )
 	Event*     ev2;
 	Event*     ev3;
 
+	if (clgs->skip) {
+		clgs->events_used = 0;
+		return;
+	}
+
+	if (clgs->batch) {
+		flushEventsBatch(clgs);
+		return;
+	}
+
 	for(i = 0; i < clgs->events_used; i = inew) 
 	{
 		helperName = NULL;
@@ -820,27 +1006,23 @@ static void flushEvents ( ClgState* clgs )
 		   inew = i+1;
 		   break;
 		case Ev_Bc:
-			/* Conditional branch */
-			helperName = "log_cond_branch";
-			helperAddr = SGL_(log_cond_branch);
-			argv = mkIRExprVec_2( i_node_expr, ev->Ev.Bc.taken );
-			regparms = 2;
-			inew = i+1;
-			break;
 		case Ev_Bi:
-			/* Branch to an unknown destination */
-			helperName = "log_ind_branch";
-			helperAddr = SGL_(log_ind_branch);
-			argv = mkIRExprVec_2( i_node_expr, ev->Ev.Bi.dst );
-			regparms = 2;
+			/* Branches are logged per BB from the jmps_passed
+			 * count in setup_bbcc, see SGL_(log_branches) */
+			helperName = NULL;
+			helperAddr = NULL;
+			argv = NULL;
+			regparms = 0;
 			inew = i+1;
 			break;
 		case Ev_G:
 			/* Global bus event (CAS, LOCK-prefix, LL-SC, etc) */
 			helperName = "log_global_event";
 			helperAddr = SGL_(log_global_event);
-			argv = mkIRExprVec_1( i_node_expr );
-			regparms = 1;
+			argv = mkIRExprVec_3( i_node_expr,
+					      ev->Ev.G.ea,
+					      mkIRExpr_HWord( ev->Ev.G.szB ) );
+			regparms = 3;
 			inew = i+1;
 			break;
 		case Ev_Comp:
@@ -889,6 +1071,193 @@ static void flushEvents ( ClgState* clgs )
 	clgs->events_used = 0;
 }
 
+/* --batch-events: append the outstanding events to the block's template
+   instead of calling helpers.  Only memory addresses are dynamic; they
+   are stored directly into the block's slots. */
+static void flushEventsBatch ( ClgState* clgs )
+{
+   Int i;
+   Event* ev;
+   SglEvVariant* slot;
+
+   for (i = 0; i < clgs->events_used; i++) {
+      ev = &clgs->events[i];
+
+      CLG_DEBUGIF(5) {
+         VG_(printf)("  batch ");
+         showEvent( ev );
+      }
+
+      /* no events are generated for these (see log_events.c) */
+      if (ev->tag == Ev_Bc || ev->tag == Ev_Bi || ev->tag == Ev_G)
+         continue;
+
+      tl_assert(clgs->ev_count < SGL_MAX_BLOCK_EVENTS);
+      slot = &clgs->ev_template[clgs->ev_count];
+      VG_(memset)(slot, 0, sizeof(*slot));
+
+      /* the instruction marker is part of the block definition */
+      if (ev->tag == Ev_Ir && SGL_(clo).block_defs) {
+         clgs->markers[clgs->num_markers].position = clgs->ev_pos++;
+         clgs->markers[clgs->num_markers].offset   = ev->inode->instr_offset;
+         clgs->num_markers++;
+         continue;
+      }
+
+      switch (ev->tag) {
+      case Ev_Ir:
+         slot->tag      = SGL_CXT_TAG;
+         slot->cxt.type = SGLPRIM_CXT_INSTR;
+         slot->cxt.id   = ev->inode->instr_addr;
+         break;
+      case Ev_Dr:
+      case Ev_Dw:
+      case Ev_Dm:
+         /* Dm events have same effect as Dw events */
+         slot->tag      = SGL_MEM_TAG;
+         slot->mem.type = (ev->tag == Ev_Dr) ? SGLPRIM_MEM_LOAD
+                                             : SGLPRIM_MEM_STORE;
+         slot->mem.size = get_Event_dszB(ev);
+         addSlotStoreStmt( clgs, clgs->ev_count,
+                           offsetof(SglEvVariant, mem.begin_addr),
+                           get_Event_dea(ev) );
+         break;
+      case Ev_Comp:
+         SGL_(fill_comp_event)(slot, ev->Ev.Comp.op_type, ev->Ev.Comp.arity);
+         break;
+      default:
+         tl_assert(0);
+      }
+
+      clgs->ev_count++;
+      clgs->ev_pos++;
+   }
+
+   clgs->events_used = 0;
+}
+
+/* Generate code for the vector summaries collected since the last
+   exit: with --batch-events they are appended to the template,
+   otherwise passed as constants to a helper. */
+static void flushVecEvents ( ClgState* clgs )
+{
+   UInt i;
+   IRExpr** argv;
+   IRDirty* di;
+
+   if (clgs->skip || clgs->vec_used == 0) {
+      clgs->vec_used = 0;
+      return;
+   }
+
+   if (clgs->batch) {
+      for (i = 0; i < clgs->vec_used; i++) {
+         tl_assert(clgs->ev_count < SGL_MAX_BLOCK_EVENTS);
+         SGL_(fill_vec_event)(&clgs->ev_template[clgs->ev_count],
+                              clgs->vec_pending[i]);
+         clgs->ev_count++;
+         clgs->ev_pos++;
+      }
+      clgs->vec_used = 0;
+      return;
+   }
+
+   for (i = clgs->vec_used; i < N_VEC_PENDING; i++)
+      clgs->vec_pending[i] = 0;
+
+   argv = mkIRExprVec_3( mkIRExpr_HWord(clgs->vec_pending[0]),
+                         mkIRExpr_HWord(clgs->vec_pending[1]),
+                         mkIRExpr_HWord(clgs->vec_pending[2]) );
+   di = unsafeIRDirty_0_N( 3, "log_vec_events",
+                           VG_(fnptr_to_fnentry)( SGL_(log_vec_events) ),
+                           argv );
+   addStmtToIRSB( clgs->sbOut, IRStmt_Dirty(di) );
+
+   clgs->vec_used = 0;
+}
+
+/* Upper bound for the number of events a superblock generates with
+   --batch-events, or more than SGL_MAX_BLOCK_EVENTS if its events
+   cannot be batched. */
+static UInt count_block_events ( IRSB* sbIn )
+{
+   Int  i;
+   UInt count = 0;
+
+   for (i = 0; i < sbIn->stmts_used; i++) {
+      switch (sbIn->stmts[i]->tag) {
+         /* an Ir event is added for these, see CLG_(instrument) */
+         case Ist_NoOp:
+         case Ist_AbiHint:
+         case Ist_Put:
+         case Ist_PutI:
+         case Ist_MBE:
+         case Ist_IMark:
+         /* memory or (vector) compute event */
+         case Ist_WrTmp:
+         case Ist_Store:
+            count += 1;
+            break;
+         case Ist_LLSC:
+            if (SGL_(clo).gen_atomics == True)
+               return SGL_MAX_BLOCK_EVENTS + 1;
+            count += 1;
+            break;
+         case Ist_Dirty:
+            count += 2;
+            break;
+         case Ist_CAS:
+            /* atomics are logged one by one by log_global_event */
+            if (SGL_(clo).gen_atomics == True)
+               return SGL_MAX_BLOCK_EVENTS + 1;
+            count += 2;
+            break;
+         case Ist_LoadG:
+         case Ist_StoreG:
+            /* guarded accesses need guarded helper calls */
+            if (SGL_(clo).gen_mem == True)
+               return SGL_MAX_BLOCK_EVENTS + 1;
+            break;
+         default:
+            break;
+      }
+   }
+
+   return count;
+}
+
+static void addEvent_VecComp ( ClgState* clgs, IRExprTag arity, UInt type,
+                               UInt lanes, UInt bits )
+{
+   UInt  i;
+   UWord sum;
+   UWord one   = SIGRIND_COMP_VEC(0, 0, 0, 1);
+   UWord count = SIGRIND_COMP_VEC(0, 0, 0, SIGRIND_COMP_VEC_MAX_COUNT);
+
+   switch (arity) {
+      case Iex_Unop:  sum = SGLPRIM_COMP_UNARY; break;
+      case Iex_Binop: sum = SGLPRIM_COMP_BINARY; break;
+      case Iex_Triop: sum = SGLPRIM_COMP_TERNARY; break;
+      case Iex_Qop:   sum = SGLPRIM_COMP_QUARTERNARY; break;
+      default:        tl_assert(0);
+   }
+   sum = SIGRIND_COMP_VEC(sum, lanes, bits, 0);
+   if (type == SIGRIND_COMP_VEC_FLOP)
+      sum |= VEC_SUMMARY_FLOP;
+
+   for (i = 0; i < clgs->vec_used; i++) {
+      if ((clgs->vec_pending[i] & ~count) == sum &&
+          (clgs->vec_pending[i] & count) != count) {
+         clgs->vec_pending[i] += one;
+         return;
+      }
+   }
+
+   if (clgs->vec_used == N_VEC_PENDING)
+      flushVecEvents(clgs);
+   clgs->vec_pending[clgs->vec_used++] = sum + one;
+}
+
 static void addEvent_Ir ( ClgState* clgs, InstrInfo* inode )
 {
    Event* evt;
@@ -1039,10 +1408,12 @@ void addEvent_Bi ( ClgState* clgs, InstrInfo* inode, IRAtom* whereTo )
 }
 
 static
-void addEvent_G ( ClgState* clgs, InstrInfo* inode )
+void addEvent_G ( ClgState* clgs, InstrInfo* inode, Int datasize,
+                  IRAtom* ea )
 {
    Event* evt;
-   if (!CLG_(clo).collect_bus) return;
+   tl_assert(isIRAtom(ea));
+   if (!CLG_(clo).collect_bus && !SGL_(clo).gen_atomics) return;
 
    if (clgs->events_used == N_EVENTS)
       flushEvents(clgs);
@@ -1051,6 +1422,8 @@ void addEvent_G ( ClgState* clgs, InstrInfo* inode )
    init_Event(evt);
    evt->tag       = Ev_G;
    evt->inode     = inode;
+   evt->Ev.G.ea   = ea;
+   evt->Ev.G.szB  = datasize;
    clgs->events_used++;
 }
 
@@ -1140,11 +1513,11 @@ static void zero_thread_cost(thread_info* t)
 {
   Int i;
 
-  for(i = 0; i < CLG_(current_call_stack).sp; i++) {
-    if (!CLG_(current_call_stack).entry[i].jcc) continue;
+  for(i = 0; i < CLG_(current_call_stack)->sp; i++) {
+    if (!CLG_(current_call_stack)->entry[i].jcc) continue;
 
     /* reset call counters to current for active calls */
-    CLG_(current_call_stack).entry[i].jcc->call_counter = 0;
+    CLG_(current_call_stack)->entry[i].jcc->call_counter = 0;
   }
 
   CLG_(forall_bbccs)(CLG_(zero_bbcc));
@@ -1173,12 +1546,12 @@ void unwind_thread(thread_info* t)
     CLG_(post_signal)(CLG_(current_tid),CLG_(current_state).sig);
 
   /* unwind regular call stack */
-  while(CLG_(current_call_stack).sp>0)
+  while(CLG_(current_call_stack)->sp>0)
     CLG_(pop_call_stack)();
 
   /* reset context and function stack for context generation */
   CLG_(init_exec_state)( &CLG_(current_state) );
-  CLG_(current_fn_stack).top = CLG_(current_fn_stack).bottom;
+  CLG_(current_fn_stack)->top = CLG_(current_fn_stack)->bottom;
 }
 
 void CLG_(set_instrument_state)(const HChar* reason, Bool state)
@@ -1203,6 +1576,121 @@ void CLG_(set_instrument_state)(const HChar* reason, Bool state)
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Sampling (--sample-on, --sample-off)                 ---*/
+/*------------------------------------------------------------*/
+
+/* Gaps between windows use skip translations (see "Retranslation"), so
+ * they cost little more than uninstrumented execution. */
+
+#define SAMPLE_SIG_DIMS   32
+#define SAMPLE_MAX_PHASES 256
+/* Two gaps are the same phase if less than this percentage of their
+ * instructions would have to move to other dimensions of the signature */
+#define SAMPLE_PHASE_DIFF 10
+
+Bool SGL_(sample_skipping) = False;
+
+static Long  sample_left;       /* instructions left in window or gap */
+static ULong sample_instrs;     /* instructions counted so far */
+static ULong sample_windows;
+static ULong sample_gaps;
+
+/* --sample-phases: the basic block vector of the current gap, hashed
+ * into SAMPLE_SIG_DIMS dimensions, and the normalized vectors of all
+ * gaps that were followed by a window */
+static ULong  sample_sig[SAMPLE_SIG_DIMS];
+static UShort sample_phase[SAMPLE_MAX_PHASES][SAMPLE_SIG_DIMS];
+static UInt   sample_num_phases = 0;
+
+static __inline__ UInt sample_dim(BB* bb)
+{
+   return ((UInt)bb_addr(bb) * 0x9E3779B1U) >> 27;
+}
+
+/* Did the gap that just ended execute code that was not seen in any of
+ * the gaps before sampled windows?  If so, it is remembered as a new phase. */
+static Bool sample_new_phase(void)
+{
+   UShort sig[SAMPLE_SIG_DIMS];
+   ULong total = 0, dist;
+   UInt i, d;
+
+   for (d = 0; d < SAMPLE_SIG_DIMS; d++)
+      total += sample_sig[d];
+   if (total == 0)
+      return False;
+
+   for (d = 0; d < SAMPLE_SIG_DIMS; d++) {
+      sig[d] = (UShort)(sample_sig[d] * 0xffff / total);
+      sample_sig[d] = 0;
+   }
+
+   for (i = 0; i < sample_num_phases; i++) {
+      dist = 0;
+      for (d = 0; d < SAMPLE_SIG_DIMS; d++)
+         dist += (sig[d] > sample_phase[i][d]) ? sig[d] - sample_phase[i][d]
+                                               : sample_phase[i][d] - sig[d];
+      /* dist is at most 2 * 0xffff */
+      if (dist * 100 < SAMPLE_PHASE_DIFF * 2 * 0xffffULL)
+         return False;
+   }
+
+   if (sample_num_phases < SAMPLE_MAX_PHASES) {
+      VG_(memcpy)(sample_phase[sample_num_phases], sig, sizeof(sig));
+      sample_num_phases++;
+   }
+   return True;
+}
+
+static void sample_mark(UInt type)
+{
+   SglEvVariant* slot = SGL_(acq_event_slot)();
+   slot->tag          = SGL_CXT_TAG;
+   slot->cxt.type     = type;
+   slot->cxt.id       = sample_instrs;
+}
+
+/* Called from setup_bbcc for every executed block if sampling is on */
+void SGL_(sample_block)(BB* bb)
+{
+   if (!SGL_(is_in_event_collect_func))
+      return;
+
+   sample_instrs += bb->instr_count;
+   sample_left   -= bb->instr_count;
+   if (SGL_(sample_skipping) && SGL_(clo).sample_phases)
+      sample_sig[sample_dim(bb)] += bb->instr_count;
+
+   if (LIKELY(sample_left > 0))
+      return;
+
+   if (!SGL_(sample_skipping)) {
+      sample_mark(SIGRIND_CXT_SAMPLE_OFF);
+      SGL_(sample_skipping) = True;
+      sample_left = (Long)SGL_(clo).sample_off * 1000000;
+      sample_gaps++;
+   }
+   else if (SGL_(clo).sample_phases && !sample_new_phase()) {
+      /* stay in the gap, the translations are still valid */
+      sample_left = (Long)SGL_(clo).sample_off * 1000000;
+      sample_gaps++;
+      return;
+   }
+   else {
+      SGL_(sample_skipping) = False;
+      sample_left = (Long)SGL_(clo).sample_on * 1000000;
+      sample_windows++;
+      sample_mark(SIGRIND_CXT_SAMPLE_ON);
+   }
+
+   CLG_DEBUG(1, "Sampling: window %s after %llu instructions\n",
+             SGL_(sample_skipping) ? "ends" : "starts", sample_instrs);
+
+   SGL_(request_retranslation)();
+}
+
+
 /* Dump current state */
 static void dump_state_togdb(void)
 {
@@ -1233,6 +1721,24 @@ static void dump_state_togdb(void)
 }
 
   
+/* Producer throughput, to tell whether Sigrind or Sigil2 is the
+   bottleneck: a long stall time means Sigil2 did not keep up */
+static void print_ipc_stats ( UInt (*print)(const HChar* format, ...) )
+{
+   const SigrindIpcStats* s = &SGL_(ipc_stat);
+   ULong stall_usecs = s->stall_nsecs / 1000;
+
+   print("Events: %llu mem, %llu comp, %llu sync, %llu cxt, %llu cf\n",
+         s->events[SGL_MEM_TAG], s->events[SGL_COMP_TAG],
+         s->events[SGL_SYNC_TAG], s->events[SGL_CXT_TAG],
+         s->events[SGL_CF_TAG]);
+   print("Buffers: %llu published, %llu event bytes, %llu name bytes\n",
+         s->buffers, s->event_bytes, s->name_bytes);
+   print("Stalls: %llu waits for an empty buffer (%llu blocked), "
+         "%llu.%03llu ms\n", s->stalls, s->stall_blocks,
+         stall_usecs / 1000, stall_usecs % 1000);
+}
+
 static void print_monitor_help ( void )
 {
    VG_(gdb_printf) ("\n");
@@ -1245,6 +1751,8 @@ static void print_monitor_help ( void )
    VG_(gdb_printf) ("        print status\n");
    VG_(gdb_printf) ("  instrumentation [on|off]\n");
    VG_(gdb_printf) ("        get/set (if on/off given) instrumentation state\n");
+   VG_(gdb_printf) ("  ipc\n");
+   VG_(gdb_printf) ("        print event, buffer and stall counters\n");
    VG_(gdb_printf) ("\n");
 }
 
@@ -1258,7 +1766,7 @@ static Bool handle_gdb_monitor_command (ThreadId tid, const HChar *req)
    VG_(strcpy) (s, req);
 
    wcmd = VG_(strtok_r) (s, " ", &ssaveptr);
-   switch (VG_(keyword_id) ("help dump zero status instrumentation", 
+   switch (VG_(keyword_id) ("help dump zero status instrumentation ipc", 
                             wcmd, kwd_report_duplicated_matches)) {
    case -2: /* multiple matches */
       return True;
@@ -1307,6 +1815,11 @@ static Bool handle_gdb_monitor_command (ThreadId tid, const HChar *req)
      return True;
    }
 
+   case 5: { /* ipc */
+     print_ipc_stats(VG_(gdb_printf));
+     return True;
+   }
+
    default: 
       tl_assert(0);
       return False;
@@ -1513,6 +2026,58 @@ Bool CLG_(handle_client_request)(ThreadId tid, UWord *args, UWord *ret)
       }
       break;
 
+   /* rwlocks, semaphores and C11 threads, see sg_intercepts.c */
+   case VG_USERREQ__SIGIL_SYNC_FAILED:
+      SGL_(thread_in_synccall)[SGL_(active_tid)] = False;
+      break;
+
+   case VG_USERREQ__SIGIL_PTHREAD_RDLOCK_ENTER:
+   case VG_USERREQ__SIGIL_PTHREAD_WRLOCK_ENTER:
+   case VG_USERREQ__SIGIL_PTHREAD_RWUNLOCK_ENTER:
+   case VG_USERREQ__SIGIL_SEM_WAIT_ENTER:
+      SGL_(thread_in_synccall)[SGL_(active_tid)] = True;
+      break;
+   case VG_USERREQ__SIGIL_PTHREAD_RDLOCK_LEAVE:
+      SGL_(thread_in_synccall)[SGL_(active_tid)] = False;
+      if ( EVENT_GENERATION_ENABLED )
+      {
+         SGL_(log_sync)((UChar)SIGRIND_SYNC_RDLOCK, args[1], UNUSED_SYNC_DATA);
+      }
+      break;
+   case VG_USERREQ__SIGIL_PTHREAD_WRLOCK_LEAVE:
+      SGL_(thread_in_synccall)[SGL_(active_tid)] = False;
+      if ( EVENT_GENERATION_ENABLED )
+      {
+         SGL_(log_sync)((UChar)SIGRIND_SYNC_WRLOCK, args[1], UNUSED_SYNC_DATA);
+      }
+      break;
+   case VG_USERREQ__SIGIL_PTHREAD_RWUNLOCK_LEAVE:
+      SGL_(thread_in_synccall)[SGL_(active_tid)] = False;
+      if ( EVENT_GENERATION_ENABLED )
+      {
+         SGL_(log_sync)((UChar)SIGRIND_SYNC_RWUNLOCK, args[1], UNUSED_SYNC_DATA);
+      }
+      break;
+   case VG_USERREQ__SIGIL_SEM_WAIT_LEAVE:
+      SGL_(thread_in_synccall)[SGL_(active_tid)] = False;
+      if ( EVENT_GENERATION_ENABLED )
+      {
+         SGL_(log_sync)((UChar)SIGRIND_SYNC_SEMWAIT, args[1], UNUSED_SYNC_DATA);
+      }
+      break;
+
+   case VG_USERREQ__SIGIL_SEM_POST_ENTER:
+      /* log before the post can let a waiter run */
+      if ( EVENT_GENERATION_ENABLED )
+      {
+         SGL_(log_sync)((UChar)SIGRIND_SYNC_SEMPOST, args[1], UNUSED_SYNC_DATA);
+      }
+      SGL_(thread_in_synccall)[SGL_(active_tid)] = True;
+      break;
+   case VG_USERREQ__SIGIL_SEM_POST_LEAVE:
+      SGL_(thread_in_synccall)[SGL_(active_tid)] = False;
+      break;
+
    default:
       return False;
    }
@@ -1522,6 +2087,68 @@ Bool CLG_(handle_client_request)(ThreadId tid, UWord *args, UWord *ret)
 }
 
 
+/* Futexes
+ *
+ * Primitives that use futexes directly, without a wrapped function,
+ * are seen at the futex syscall: a wake is logged before it is issued,
+ * a wait after it returned successfully.  Inside wrapped functions
+ * EVENT_GENERATION_ENABLED is false, so nothing is sent twice. */
+
+#if defined(VGO_linux)
+static UInt futex_sync_type(UWord op)
+{
+   switch (op & ~(VKI_FUTEX_PRIVATE_FLAG | VKI_FUTEX_CLOCK_REALTIME)) {
+   case VKI_FUTEX_WAIT:
+   case VKI_FUTEX_WAIT_BITSET:
+   case VKI_FUTEX_WAIT_REQUEUE_PI:
+   case VKI_FUTEX_LOCK_PI:
+   case VKI_FUTEX_TRYLOCK_PI:
+      return SIGRIND_SYNC_FUTEXWAIT;
+   case VKI_FUTEX_WAKE:
+   case VKI_FUTEX_WAKE_BITSET:
+   case VKI_FUTEX_WAKE_OP:
+   case VKI_FUTEX_REQUEUE:
+   case VKI_FUTEX_CMP_REQUEUE:
+   case VKI_FUTEX_CMP_REQUEUE_PI:
+   case VKI_FUTEX_UNLOCK_PI:
+      return SIGRIND_SYNC_FUTEXWAKE;
+   default:
+      return 0;
+   }
+}
+#endif
+
+static void sgl_pre_syscall(ThreadId tid, UInt syscallno,
+                            UWord* args, UInt nArgs)
+{
+#if defined(VGO_linux)
+   if (syscallno != __NR_futex || SGL_(clo).gen_sync == False)
+      return;
+
+   if (futex_sync_type(args[1]) == SIGRIND_SYNC_FUTEXWAKE) {
+      CLG_(switch_thread)(tid);
+      if ( EVENT_GENERATION_ENABLED )
+         SGL_(log_sync)((UChar)SIGRIND_SYNC_FUTEXWAKE, args[0], UNUSED_SYNC_DATA);
+   }
+#endif
+}
+
+static void sgl_post_syscall(ThreadId tid, UInt syscallno,
+                             UWord* args, UInt nArgs, SysRes res)
+{
+#if defined(VGO_linux)
+   if (syscallno != __NR_futex || SGL_(clo).gen_sync == False)
+      return;
+
+   if (futex_sync_type(args[1]) == SIGRIND_SYNC_FUTEXWAIT && !sr_isError(res)) {
+      CLG_(switch_thread)(tid);
+      if ( EVENT_GENERATION_ENABLED )
+         SGL_(log_sync)((UChar)SIGRIND_SYNC_FUTEXWAIT, args[0], UNUSED_SYNC_DATA);
+   }
+#endif
+}
+
+
 /* Syscall Timing */
 
 /* struct timeval syscalltime[VG_N_THREADS]; */
@@ -1532,9 +2159,36 @@ UInt *syscalltime;
 #endif
 
 
+static
+void print_hash_stat(const HChar* name, Int entries, Int resizes,
+                     ULong lookups, ULong steps, UInt max_chain)
+{
+   /* average chain entries walked per lookup, in hundredths */
+   ULong avg = lookups > 0 ? steps * 100 / lookups : 0;
+
+   VG_(message)(Vg_DebugMsg,
+                "%s hash: %d entries, %d resizes, %llu lookups, "
+                "%llu.%02llu steps/lookup, longest %u\n",
+                name, entries, resizes, lookups,
+                avg / 100, avg % 100, max_chain);
+}
+
 static
 void clg_print_stats(void)
 {
+   print_hash_stat("Obj ", CLG_(stat).distinct_objs,
+                   CLG_(stat).obj_hash_resizes, CLG_(stat).obj_hash_lookups,
+                   CLG_(stat).obj_hash_steps, CLG_(stat).obj_hash_max_chain);
+   print_hash_stat("File", CLG_(stat).distinct_files,
+                   CLG_(stat).file_hash_resizes, CLG_(stat).file_hash_lookups,
+                   CLG_(stat).file_hash_steps, CLG_(stat).file_hash_max_chain);
+   print_hash_stat("Fn  ", CLG_(stat).distinct_fns,
+                   CLG_(stat).fn_hash_resizes, CLG_(stat).fn_hash_lookups,
+                   CLG_(stat).fn_hash_steps, CLG_(stat).fn_hash_max_chain);
+   VG_(message)(Vg_DebugMsg, "BB   hash: %d entries, %d resizes\n",
+                CLG_(stat).distinct_bbs, CLG_(stat).bb_hash_resizes);
+   VG_(message)(Vg_DebugMsg, "Thread switches: %llu\n",
+                CLG_(stat).thread_switches);
 }
 
 static void finish(void)
@@ -1545,9 +2199,22 @@ static void finish(void)
    */
   CLG_(forall_threads)(unwind_thread);
 
+  if (SGL_(clo).reduce != 0)
+     SGL_(finish_reduce)();
+
   /* finish IPC with Sigil2 */
   SGL_(term_IPC)();
-  SGL_(end_logging)();
+  print_ipc_stats(VG_(umsg));
+
+  if (SGL_(clo).sample_on > 0)
+     VG_(umsg)("Sampling: %llu windows, %llu gaps, %u phases, "
+               "%llu instructions\n", sample_windows, sample_gaps,
+               sample_num_phases, sample_instrs);
+
+  if (VG_(clo_stats)) {
+    VG_(message)(Vg_DebugMsg, "\n");
+    clg_print_stats();
+  }
 }
 
 
@@ -1582,7 +2249,8 @@ void CLG_(post_clo_init)(void)
    SGL_(is_in_event_collect_func) = False;
 
    if (SGL_(clo).collect_func == NULL &&
-       SGL_(clo).start_collect_func == NULL)
+       SGL_(clo).start_collect_func == NULL &&
+       SGL_(clo).collect_in == False)
    {
       VG_(umsg)("*********************************************\n");
       VG_(umsg)("Beginning event generation from program start\n");
@@ -1590,10 +2258,40 @@ void CLG_(post_clo_init)(void)
       SGL_(is_in_event_collect_func) = True;
    }
 
-   if (SGL_(clo).gen_cf == True)
-      VG_(umsg)("WARNING: Control Flow events unsupported\n");
-   if (SGL_(clo).gen_bb == True)
-      VG_(umsg)("WARNING: Basic Block context events unsupported\n");
+   if (SGL_(clo).block_defs == True && SGL_(clo).batch_events == False) {
+      VG_(umsg)("--block-defs=yes implies --batch-events=yes\n");
+      SGL_(clo).batch_events = True;
+   }
+   if (SGL_(clo).reduce != 0) {
+      if (SGL_(clo).gen_mem == False) {
+         VG_(umsg)("--reduce implies --gen-mem=yes\n");
+         SGL_(clo).gen_mem = True;
+      }
+      /* memory addresses must go through the helpers */
+      if (SGL_(clo).batch_events == True) {
+         VG_(umsg)("--reduce implies --batch-events=no --block-defs=no\n");
+         SGL_(clo).batch_events = False;
+         SGL_(clo).block_defs = False;
+      }
+      SGL_(init_reduce)();
+   }
+   if (SGL_(clo).coalesce_mem == True && SGL_(clo).batch_events == True) {
+      /* memory addresses must go through the helpers */
+      VG_(umsg)("--coalesce-mem=yes implies --batch-events=no --block-defs=no\n");
+      SGL_(clo).batch_events = False;
+      SGL_(clo).block_defs = False;
+   }
+   if (SGL_(clo).sample_on > 0 && SGL_(clo).sample_off == 0) {
+      VG_(umsg)("--sample-off=0: sampling disabled\n");
+      SGL_(clo).sample_on = 0;
+   }
+   /* no translations exist yet */
+   if (!SGL_(is_in_event_collect_func))
+      SGL_(fast_forward) = SGL_(clo).fast_forward;
+   if (SGL_(clo).sample_on > 0) {
+      sample_left = (Long)SGL_(clo).sample_on * 1000000;
+      sample_windows = 1;
+   }
 
    if (VG_(clo_vex_control).iropt_register_updates_default
        != VexRegUpdSpAtMemAccess) {
@@ -1684,17 +2382,17 @@ void CLG_(pre_clo_init)(void)
     VG_(track_post_deliver_signal)( & CLG_(post_signal) );
 
     /* Track syscalls */
+    /* futex syscalls are seen for --gen-sync */
+    VG_(needs_syscall_wrapper)(sgl_pre_syscall, sgl_post_syscall);
+
     /* XXX MDL20170226
-     * Right now syscalls are not being monitored.
+     * Right now memory accesses by syscalls are not being monitored.
      * There hasn't been a convincing case made that memory reads/writes
      * from syscalls are significant enough to warrant the extra monitoring.
-     * If required, the following callbacks can be used to get addt'l info
-     * every time a syscall writes to an address, and also in general when
-     * a syscall is invoked.
+     * If required, the following callback can be used to get addt'l info
+     * every time a syscall writes to an address.
      *
      * VG_(track_post_mem_write) (vgcore_memwrite_callback)
-     * VG_(needs_syscall_wrapp)  (pre_syscall_callback,
-     *                            post_syscall_callback)
      *
      * For more info look in ../include/pub_tool_tooliface.h
      * The other core event callbacks offered by Valgrind probably aren't
@@ -1821,6 +2519,60 @@ void addConstMemStoreStmt( IRSB* bbOut, UWord addr, UInt val, IRType hWordTy)
 				IRExpr_Const(IRConst_U32(val)) ));
 }   
 
+static
+void addSlotStoreStmt( ClgState* clgs, UInt slot, UInt offset, IRAtom* data )
+{
+    IRType tyW  = sizeof(HWord)==4 ? Ity_I32 : Ity_I64;
+    IRTemp addr = newIRTemp(clgs->sbOut->tyenv, tyW);
+    HWord  off  = slot * sizeof(SglEvVariant) + offset;
+
+    addStmtToIRSB( clgs->sbOut,
+		   IRStmt_WrTmp(addr,
+				IRExpr_Binop(tyW == Ity_I32 ? Iop_Add32 : Iop_Add64,
+					     IRExpr_RdTmp(clgs->ev_slots),
+					     mkIRExpr_HWord(off))) );
+    addStmtToIRSB( clgs->sbOut,
+		   IRStmt_Store(CLGEndness, IRExpr_RdTmp(addr), data) );
+}
+
+/* --batch-events: record how much of the block is done at this point;
+ * with --block-defs, the BLOCK event also gets the number of positions */
+static
+void addBlockUsedStmts( ClgState* clgs, IRType hWordTy )
+{
+    addConstMemStoreStmt( clgs->sbOut, (UWord) &SGL_(block_used),
+			  clgs->ev_count, hWordTy );
+    if (SGL_(clo).block_defs)
+	addSlotStoreStmt( clgs, 0, offsetof(SglEvVariant, cxt.len),
+			  mkIRExpr_HWord(clgs->ev_pos) );
+}
+
+/* --block-defs: complete the BLOCK event and build the definition
+ * to be sent before the BB first runs */
+static
+void setBlockDef( ClgState* clgs, Addr origAddr )
+{
+    BB* bb = clgs->bb;
+    SigrindBlockDef def;
+    UInt markers_size = clgs->num_markers * sizeof(SigrindBlockDefInstr);
+
+    def.id            = ++next_block_id;
+    def.base_addr     = origAddr;
+    def.num_positions = clgs->ev_pos;
+    def.num_instrs    = clgs->num_markers;
+
+    clgs->ev_template[0].cxt.len = clgs->ev_pos;
+    clgs->ev_template[0].cxt.idx = def.id;
+
+    if (bb->def)
+	CLG_FREE(bb->def);
+    bb->def_size = sizeof(def) + markers_size;
+    bb->def      = (UChar*) CLG_MALLOC("sgl.instrument.2", bb->def_size);
+    bb->def_sent = False;
+    VG_(memcpy)(bb->def, &def, sizeof(def));
+    VG_(memcpy)(bb->def + sizeof(def), clgs->markers, markers_size);
+}
+
 
 
 static void showEvent ( Event* ev )
@@ -1859,7 +2611,9 @@ static void showEvent ( Event* ev )
          VG_(printf)("\n");
          break;
       case Ev_G:
-         VG_(printf)("G  %p\n", ev->inode);
+         VG_(printf)("G  %p  EA=", ev->inode);
+         ppIRExpr(ev->Ev.G.ea);
+         VG_(printf)("\n");
          break;
       default:
 	 tl_assert(0);
@@ -0,0 +1,127 @@
+#include <string.h>
+#include "sigil2_decode.h"
+
+/* See sigil2_shmem.h for the format. */
+
+static int get_varint(SigrindPackedDecoder* dec, unsigned long long* v)
+{
+    unsigned long long res = 0;
+    unsigned shift = 0;
+
+    while (dec->pos < dec->end && shift < 64)
+    {
+        unsigned char b = *dec->pos++;
+        res |= (unsigned long long)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+        {
+            *v = res;
+            return 1;
+        }
+        shift += 7;
+    }
+
+    return 0;
+}
+
+
+static long long unzigzag(unsigned long long v)
+{
+    return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+
+void sigrind_packed_init(SigrindPackedDecoder* dec, const void* events, size_t used)
+{
+    dec->pos = events;
+    dec->end = dec->pos + used;
+    dec->prev_mem_addr = 0;
+    dec->prev_instr_addr = 0;
+}
+
+
+int sigrind_packed_next(SigrindPackedDecoder* dec, SglEvVariant* ev)
+{
+    unsigned long long a, b;
+
+    if (dec->pos == dec->end)
+        return 0;
+
+    unsigned char header = *dec->pos++;
+    unsigned kind = header & SIGRIND_PACKED_KIND_MASK;
+    unsigned long long sub = header >> SIGRIND_PACKED_KIND_BITS;
+    if (sub == SIGRIND_PACKED_SUB_ESCAPE && !get_varint(dec, &sub))
+        return -1;
+
+    switch (kind)
+    {
+    case SIGRIND_PACKED_MEM:
+        if (!get_varint(dec, &a) || !get_varint(dec, &b))
+            return -1;
+        ev->tag            = SGL_MEM_TAG;
+        ev->mem.type       = (MemType)sub;
+        ev->mem.size       = a;
+        ev->mem.begin_addr = dec->prev_mem_addr + unzigzag(b);
+        dec->prev_mem_addr = ev->mem.begin_addr;
+        return 1;
+
+    case SIGRIND_PACKED_COMP:
+        if (!get_varint(dec, &a))
+            return -1;
+        ev->tag        = SGL_COMP_TAG;
+        ev->comp.type  = (CompCostType)sub;
+        ev->comp.arity = (CompArity)a;
+        return 1;
+
+    case SIGRIND_PACKED_SYNC:
+        if (!get_varint(dec, &a) || !get_varint(dec, &b))
+            return -1;
+        ev->tag          = SGL_SYNC_TAG;
+        ev->sync.type    = (SyncType)sub;
+        ev->sync.data[0] = a;
+        ev->sync.data[1] = b;
+        return 1;
+
+    case SIGRIND_PACKED_CXT:
+        ev->tag      = SGL_CXT_TAG;
+        ev->cxt.type = (CxtType)sub;
+        switch (sub)
+        {
+        case SGLPRIM_CXT_INSTR:
+            if (!get_varint(dec, &a))
+                return -1;
+            ev->cxt.id = dec->prev_instr_addr + unzigzag(a);
+            dec->prev_instr_addr = ev->cxt.id;
+            return 1;
+        case SGLPRIM_CXT_FUNC_ENTER:
+        case SGLPRIM_CXT_FUNC_EXIT:
+        case SIGRIND_CXT_BLOCK:
+        case SIGRIND_CXT_BLOCK_DEF:
+        case SIGRIND_CXT_FUNC_NAME:
+        case SIGRIND_CXT_BRANCHES:
+        case SIGRIND_CXT_IND_BRANCH:
+        case SIGRIND_CXT_BRANCH_DEF:
+        case SIGRIND_CXT_REDUCE:
+        case SIGRIND_CXT_REDUCE_FNS:
+            if (!get_varint(dec, &a) || !get_varint(dec, &b))
+                return -1;
+            ev->cxt.len = a;
+            ev->cxt.idx = b;
+            return 1;
+        default:
+            if (!get_varint(dec, &a))
+                return -1;
+            ev->cxt.id = a;
+            return 1;
+        }
+
+    case SIGRIND_PACKED_RAW:
+        if ((size_t)(dec->end - dec->pos) < sizeof(*ev))
+            return -1;
+        memcpy(ev, dec->pos, sizeof(*ev));
+        dec->pos += sizeof(*ev);
+        return 1;
+
+    default:
+        return -1;
+    }
+}
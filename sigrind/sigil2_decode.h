@@ -0,0 +1,30 @@
+#ifndef SGL_DECODE_H
+#define SGL_DECODE_H
+
+#include <stddef.h>
+#include "Core/Primitive.h"
+#include "sigil2_shmem.h"
+
+/* Reference decoder for Sigrind's packed event encoding
+ * (--ipc-encoding=packed, see sigil2_shmem.h).
+ *
+ * This is built into the Sigil2 frontend, not into Sigrind.  A decoder
+ * walks one event buffer; the name buffer of the same index is unchanged
+ * and resolves FUNC_ENTER/FUNC_EXIT names as in the fixed encoding. */
+
+typedef struct SigrindPackedDecoder
+{
+    const unsigned char* pos;
+    const unsigned char* end;
+    PtrVal prev_mem_addr;
+    PtrVal prev_instr_addr;
+} SigrindPackedDecoder;
+
+/* Start decoding 'used' bytes of a packed event buffer */
+void sigrind_packed_init(SigrindPackedDecoder* dec, const void* events, size_t used);
+
+/* Decode the next event into 'ev'.
+ * Returns 1 on success, 0 at the end of the buffer, -1 on malformed input */
+int sigrind_packed_next(SigrindPackedDecoder* dec, SglEvVariant* ev);
+
+#endif
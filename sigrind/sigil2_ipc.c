@@ -1,49 +1,577 @@
 #include "sigil2_ipc.h"
+#include "sigil2_shmem.h"
 #include "coregrind/pub_core_libcfile.h"
 #include "coregrind/pub_core_aspacemgr.h"
 #include "coregrind/pub_core_syscall.h"
+#include "coregrind/m_debuginfo/minilzo.h"
 #include "pub_tool_basics.h"
+#include "pub_tool_threadstate.h"
 #include "pub_tool_vki.h"       // errnum, vki_timespec
-#include "pub_tool_vkiscnums.h" // __NR_nanosleep
+#include "pub_tool_vkiscnums.h" // __NR_nanosleep, __NR_futex, __NR_kill
 
 static Bool initialized = False;
-static Int emptyfd;
-static Int fullfd;
-static Sigil2DBISharedData* shmem;
-/* IPC channel */
 
+SigrindIpcStats SGL_(ipc_stat);
 
-static UInt           curr_idx;
-static EventBuffer*   curr_ev_buf;
-static SglEvVariant*  curr_ev_slot;
-static NameBuffer*    curr_name_buf;
-static char*          curr_name_slot;
-/* cached IPC state */
+typedef struct IpcChannel
+{
+    Int                 emptyfd;
+    Int                 fullfd;
+    SigrindRingControl* ring;
+    /* transport; the FIFOs are only used by channel 0 */
+
+    UInt  num_buffers;
+    UInt  buffer_events;
+    UInt  buffer_name_bytes;
+    Addr  event_buffers;
+    SizeT event_buffer_stride;
+    Addr  name_buffers;
+    SizeT name_buffer_stride;
+    /* buffer geometry, either Sigil2DBISharedData's
+     * or negotiated through a SigrindShmemHeader */
+
+    UInt           curr_idx;
+    EventBuffer*   curr_ev_buf;
+    SglEvVariant*  curr_ev_slot;
+    UInt           curr_ev_used;
+    NameBuffer*    curr_name_buf;
+    char*          curr_name_slot;
+    UInt           curr_name_used;
+    /* cached IPC state;
+     * the 'used' counts are only written to shared memory on a flush */
+
+    Bool* is_full;
+    /* track available buffers */
+
+    SglEvVariant* pending_block;
+    UInt          pending_count;
+    /* --batch-events state;
+     * the slots of the last superblock stay reserved until the next
+     * acquisition, when the ones after the block's actual exit are dropped */
+
+    UChar* packed_pos;
+    UChar* packed_limit;
+    Addr   prev_mem_addr;
+    Addr   prev_instr_addr;
+    /* --ipc-encoding=packed state */
+
+    SigrindTraceChunk* trace_chunk;
+    Int                trace_fd;
+    UInt               trace_channel;
+    ULong              trace_offset;
+    /* --trace-out state; the transport is unused,
+     * and there is a single buffer, which is written out when full */
+} IpcChannel;
+
+static IpcChannel ch;
+/* The channel of the active thread.
+ * With --ipc-channels=per-thread, the state of the other threads' channels
+ * is saved in 'channels' and swapped in on a thread switch */
+
+
+static IpcChannel**         channels;
+static IpcChannel*          channel_list[SIGRIND_MAX_CHANNELS];
+static ThreadId             ch_tid;
+static UInt                 num_channels;
+static SigrindChannelTable* channel_table;
+static ULong                switch_stamp;
+/* --ipc-channels=per-thread state */
+
+
+UInt                 SGL_(block_used);
+static SglEvVariant  block_staging[SGL_MAX_BLOCK_EVENTS];
+/* --batch-events state shared by all channels */
+
+
+static Bool          packed;
+static SglEvVariant  staged_ev;
+static Bool          have_staged;
+static ULong         packed_events;
+/* --ipc-encoding=packed state;
+ * events are filled in 'staged_ev' and encoded on the next acquire,
+ * so the loggers stay unaware of the encoding */
+
+static SglEvVariant* last_slot;
+/* fixed encoding: the event slot acquired last, whose tag is counted
+ * on the next acquire, once the logger filled it in */
 
+static SglEvVariant  coalesced[2];
+static Bool          have_coalesced[2];
+static UInt          coalesced_first;
+static ULong         coalesced_accesses;
+static ULong         coalesced_events;
+/* --coalesce-mem state, indexed by load/store;
+ * the pending accesses of the active thread, merged until any other event
+ * is acquired.  'coalesced_first' is the one that was started first */
 
-static Bool is_full[SIGIL2_IPC_BUFFERS];
-/* track available buffers */
+/* a merged access does not grow beyond a page */
+#define COALESCE_MAX_BYTES 4096
+
+/* worst case: header byte + escaped subtype + two 64-bit varints,
+ * or header byte + a raw SglEvVariant */
+#define PACKED_EVENT_MAX_BYTES (1 + 5 + 10 + 10 + sizeof(SglEvVariant))
+
+
+static inline EventBuffer* get_event_buffer(UInt buf_idx)
+{
+    return (EventBuffer*)(ch.event_buffers + buf_idx * ch.event_buffer_stride);
+}
+
+
+static inline NameBuffer* get_name_buffer(UInt buf_idx)
+{
+    return (NameBuffer*)(ch.name_buffers + buf_idx * ch.name_buffer_stride);
+}
 
 
 static inline void set_and_init_buffer(UInt buf_idx)
 {
-    curr_ev_buf = shmem->eventBuffers + buf_idx;
-    curr_ev_buf->used = 0;
-    curr_ev_slot = curr_ev_buf->events + curr_ev_buf->used;
+    ch.curr_ev_buf = get_event_buffer(buf_idx);
+    ch.curr_ev_used = 0;
+    ch.curr_ev_slot = ch.curr_ev_buf->events;
+
+    ch.curr_name_buf = get_name_buffer(buf_idx);
+    ch.curr_name_used = 0;
+    ch.curr_name_slot = ch.curr_name_buf->names;
 
-    curr_name_buf = shmem->nameBuffers + buf_idx;
-    curr_name_buf->used = 0;
-    curr_name_slot = curr_name_buf->names + curr_name_buf->used;
+    if (packed)
+    {
+        ch.packed_pos   = (UChar*)ch.curr_ev_buf->events;
+        ch.packed_limit = ch.packed_pos + (SizeT)ch.buffer_events * sizeof(SglEvVariant)
+                                        - PACKED_EVENT_MAX_BYTES;
+        ch.prev_mem_addr   = 0;
+        ch.prev_instr_addr = 0;
+    }
 }
 
 
-static inline void flush_to_sigil2(void)
+static inline void count_event(const SglEvVariant* ev)
+{
+    if (ev->tag <= SGL_CF_TAG)
+        ++SGL_(ipc_stat).events[ev->tag];
+}
+
+
+static inline void count_published(void)
+{
+    /* events are counted by tag when they are committed */
+    if (packed)
+        SGL_(ipc_stat).event_bytes += ch.curr_ev_used;
+    else
+        SGL_(ipc_stat).event_bytes += ch.curr_ev_used * sizeof(SglEvVariant);
+
+    SGL_(ipc_stat).name_bytes += ch.curr_name_used;
+    ++SGL_(ipc_stat).buffers;
+}
+
+
+static inline void commit_used_counts(void)
+{
+    if (packed)
+        ch.curr_ev_used  = ch.packed_pos - (UChar*)ch.curr_ev_buf->events;
+
+    ch.curr_ev_buf->used   = ch.curr_ev_used;
+    ch.curr_name_buf->used = ch.curr_name_used;
+    count_published();
+}
+
+
+static ULong stall_clock(void)
+{
+    struct vki_timespec ts;
+    VG_(do_syscall2)(__NR_clock_gettime, VKI_CLOCK_MONOTONIC, (UWord)&ts);
+    return (ULong)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/******************************
+ * Packed encoding
+ ******************************/
+static inline UChar* put_varint(UChar* p, ULong v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (UChar)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (UChar)v;
+    return p;
+}
+
+
+static inline ULong zigzag(Long v)
+{
+    return ((ULong)v << 1) ^ (ULong)(v >> 63);
+}
+
+
+static inline UChar* put_header(UChar* p, UInt kind, UInt sub)
+{
+    if (sub < SIGRIND_PACKED_SUB_ESCAPE)
+        *p++ = (UChar)(kind | (sub << SIGRIND_PACKED_KIND_BITS));
+    else
+    {
+        *p++ = (UChar)(kind | (SIGRIND_PACKED_SUB_ESCAPE << SIGRIND_PACKED_KIND_BITS));
+        p = put_varint(p, sub);
+    }
+    return p;
+}
+
+
+static void encode_event(const SglEvVariant* ev)
+{
+    UChar* p = ch.packed_pos;
+
+    count_event(ev);
+
+    switch (ev->tag)
+    {
+    case SGL_MEM_TAG:
+        p = put_header(p, SIGRIND_PACKED_MEM, ev->mem.type);
+        p = put_varint(p, ev->mem.size);
+        p = put_varint(p, zigzag((Long)(ev->mem.begin_addr - ch.prev_mem_addr)));
+        ch.prev_mem_addr = ev->mem.begin_addr;
+        break;
+    case SGL_COMP_TAG:
+        p = put_header(p, SIGRIND_PACKED_COMP, ev->comp.type);
+        p = put_varint(p, ev->comp.arity);
+        break;
+    case SGL_SYNC_TAG:
+        p = put_header(p, SIGRIND_PACKED_SYNC, ev->sync.type);
+        p = put_varint(p, ev->sync.data[0]);
+        p = put_varint(p, ev->sync.data[1]);
+        break;
+    case SGL_CXT_TAG:
+        p = put_header(p, SIGRIND_PACKED_CXT, ev->cxt.type);
+        /* Sigrind's own types are not part of CxtType */
+        switch ((UInt)ev->cxt.type)
+        {
+        case SGLPRIM_CXT_INSTR:
+            p = put_varint(p, zigzag((Long)(ev->cxt.id - ch.prev_instr_addr)));
+            ch.prev_instr_addr = ev->cxt.id;
+            break;
+        case SGLPRIM_CXT_FUNC_ENTER:
+        case SGLPRIM_CXT_FUNC_EXIT:
+        case SIGRIND_CXT_BLOCK:
+        case SIGRIND_CXT_BLOCK_DEF:
+        case SIGRIND_CXT_FUNC_NAME:
+        case SIGRIND_CXT_BRANCHES:
+        case SIGRIND_CXT_IND_BRANCH:
+        case SIGRIND_CXT_BRANCH_DEF:
+        case SIGRIND_CXT_REDUCE:
+        case SIGRIND_CXT_REDUCE_FNS:
+            p = put_varint(p, ev->cxt.len);
+            p = put_varint(p, ev->cxt.idx);
+            break;
+        default:
+            p = put_varint(p, ev->cxt.id);
+            break;
+        }
+        break;
+    default:
+        p = put_header(p, SIGRIND_PACKED_RAW, 0);
+        VG_(memcpy)(p, ev, sizeof(*ev));
+        p += sizeof(*ev);
+        break;
+    }
+
+    ch.packed_pos = p;
+}
+
+
+static inline void encode_pending(void)
+{
+    /* room for the staged event was checked when it was acquired */
+    if (have_staged)
+    {
+        encode_event(&staged_ev);
+        have_staged = False;
+    }
+}
+
+
+static inline void count_pending(void)
+{
+    if (last_slot != NULL)
+    {
+        count_event(last_slot);
+        last_slot = NULL;
+    }
+}
+
+
+/******************************
+ * Ring transport
+ ******************************/
+static inline void futex_wait(volatile UInt* addr, UInt val)
+{
+    /* spurious wakeups, EAGAIN (value already changed) and timeouts are
+     * fine, callers always re-check the condition */
+    struct vki_timespec ts;
+    ts.tv_sec  = SIGRIND_RING_LIVENESS_MS / 1000;
+    ts.tv_nsec = (SIGRIND_RING_LIVENESS_MS % 1000) * 1000000;
+    VG_(do_syscall4)(__NR_futex, (UWord)addr, VKI_FUTEX_WAIT, val, (UWord)&ts);
+}
+
+
+static inline void futex_wake(volatile UInt* addr)
+{
+    VG_(do_syscall3)(__NR_futex, (UWord)addr, VKI_FUTEX_WAKE, 1);
+}
+
+
+/* --ipc-wait polling: the pause between two polls of the ring tail
+ * doubles up to RING_MAX_PAUSES; hybrid gives up after RING_HYBRID_POLLS */
+#define RING_MAX_PAUSES   1024
+#define RING_HYBRID_POLLS 16
+
+static inline void cpu_relax(void)
+{
+#if defined(VGA_x86) || defined(VGA_amd64)
+    __asm__ __volatile__("pause" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+
+static Int sigil2_parent;
+/* Sigrind's parent process at startup,
+ * taken for Sigil2 until it announces its own pid */
+
+static void ring_check_consumer(SigrindRingControl* ctrl)
+{
+    Int pid = (Int)__atomic_load_n(&ctrl->consumer_pid, __ATOMIC_ACQUIRE);
+    Bool gone;
+
+    if (pid != 0)
+    {
+        /* EPERM still means the process exists */
+        SysRes res = VG_(do_syscall2)(__NR_kill, pid, 0);
+        gone = sr_isError(res) && sr_Err(res) == VKI_ESRCH;
+    }
+    else
+    {
+        /* orphaned processes are reparented */
+        pid  = sigil2_parent;
+        gone = VG_(getppid)() != sigil2_parent;
+    }
+
+    if (gone)
+    {
+        VG_(umsg)("error waiting for Sigil2\n");
+        VG_(umsg)("Sigil2 (pid %d) exited\n", pid);
+        VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
+        VG_(exit)(1);
+    }
+}
+
+
+static UInt ring_poll_for_empty(UInt head)
+{
+    UInt  pauses = 1;
+    UInt  polls  = 0;
+    UInt  tail;
+    ULong check  = 0;
+
+    do
+    {
+        for (UInt i = 0; i < pauses; ++i)
+            cpu_relax();
+        if (pauses < RING_MAX_PAUSES)
+            pauses *= 2;
+
+        tail = __atomic_load_n(&ch.ring->tail, __ATOMIC_ACQUIRE);
+        if (head - tail < ch.num_buffers)
+            break;
+
+        /* --ipc-wait=spin never sleeps, so Sigil2 is checked on here */
+        if (pauses == RING_MAX_PAUSES)
+        {
+            ULong now = stall_clock();
+            if (check != 0 && now >= check)
+                ring_check_consumer(ch.ring);
+            if (check == 0 || now >= check)
+                check = now + SIGRIND_RING_LIVENESS_MS * 1000000ULL;
+        }
+    }
+    while (SGL_(clo).ipc_wait == ipc_spin || ++polls < RING_HYBRID_POLLS);
+
+    return tail;
+}
+
+
+static inline void ring_publish(void)
+{
+    /* buffer contents must be visible before the new head */
+    __atomic_store_n(&ch.ring->head, ch.ring->head + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ch.ring->consumer_waiting, __ATOMIC_SEQ_CST))
+    {
+        __atomic_store_n(&ch.ring->consumer_waiting, 0, __ATOMIC_SEQ_CST);
+        futex_wake(&ch.ring->head);
+    }
+}
+
+
+static inline void ring_wait_for_empty(void)
+{
+    /* only Sigrind writes head, so it can be read without ordering */
+    UInt head = ch.ring->head;
+    UInt tail = __atomic_load_n(&ch.ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail < ch.num_buffers)
+        return;
+
+    ULong start = stall_clock();
+    if (SGL_(clo).ipc_wait != ipc_block)
+        tail = ring_poll_for_empty(head);
+    if (head - tail >= ch.num_buffers)
+        ++SGL_(ipc_stat).stall_blocks;
+
+    while (head - tail >= ch.num_buffers)
+    {
+        __atomic_store_n(&ch.ring->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        tail = __atomic_load_n(&ch.ring->tail, __ATOMIC_SEQ_CST);
+        if (head - tail < ch.num_buffers)
+            break;
+
+        futex_wait(&ch.ring->tail, tail);
+        tail = __atomic_load_n(&ch.ring->tail, __ATOMIC_ACQUIRE);
+        if (head - tail >= ch.num_buffers)
+            ring_check_consumer(ch.ring);
+    }
+    ++SGL_(ipc_stat).stalls;
+    SGL_(ipc_stat).stall_nsecs += stall_clock() - start;
+}
+
+
+/******************************
+ * Trace files
+ ******************************/
+static UChar* trace_zbuf;
+static void*  trace_wrkmem;
+static ULong  trace_buffers;
+static ULong  trace_bytes;
+static ULong  trace_zbytes;
+/* --trace-out state shared by all channels */
+
+
+static void trace_write(const void* buf, SizeT len)
+{
+    const UChar* p = buf;
+    while (len > 0)
+    {
+        Int res = VG_(write)(ch.trace_fd, p, len);
+        if (res <= 0)
+        {
+            VG_(umsg)("error VG_(write)\n");
+            VG_(umsg)("error writing to Sigrind trace file\n");
+            VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
+            VG_(exit)(1);
+        }
+        p   += res;
+        len -= res;
+    }
+}
+
+
+static void trace_open_chunk(void)
+{
+    Int filename_len = VG_(strlen)(SGL_(clo).trace_out) +
+                       VG_(strlen)(SIGRIND_TRACE_BASENAME) + 24;
+    HChar path[filename_len];
+    VG_(snprintf)(path, filename_len, "%s/%s-%u-%u", SGL_(clo).trace_out,
+                  SIGRIND_TRACE_BASENAME, ch.trace_channel, ch.trace_chunk->chunk);
+
+    ch.trace_fd = VG_(fd_open)(path, VKI_O_WRONLY|VKI_O_CREAT|VKI_O_TRUNC, 0644);
+    if (ch.trace_fd < 0)
+    {
+        VG_(umsg)("Creating %s for Sigrind failed\n", path);
+        VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
+        VG_(exit)(1);
+    }
+
+    /* the index is rewritten when the chunk is complete */
+    ch.trace_chunk->magic       = 0;
+    ch.trace_chunk->num_records = 0;
+    VG_(memset)(ch.trace_chunk->records, 0, sizeof(ch.trace_chunk->records));
+    trace_write(ch.trace_chunk, sizeof(SigrindTraceChunk));
+    ch.trace_offset = sizeof(SigrindTraceChunk);
+}
+
+
+static void trace_close_chunk(void)
+{
+    SigrindTraceChunk* chunk = ch.trace_chunk;
+
+    chunk->magic = SIGRIND_TRACE_MAGIC;
+    chunk->tid   = channel_table != NULL ? channel_table->tid[ch.trace_channel] : 0;
+    if (VG_(lseek)(ch.trace_fd, 0, VKI_SEEK_SET) != 0)
+    {
+        VG_(umsg)("error VG_(lseek)\n");
+        VG_(umsg)("error rewinding Sigrind trace file\n");
+        VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
+        VG_(exit)(1);
+    }
+    trace_write(chunk, sizeof(SigrindTraceChunk));
+    VG_(close)(ch.trace_fd);
+
+    ch.trace_fd = -1;
+    ++chunk->chunk;
+}
+
+
+static UInt trace_put(const void* data, UInt len)
+{
+    /* only keep the compressed data if it is smaller */
+    lzo_uint zlen = 0;
+    if (len > 0 &&
+        lzo1x_1_compress(data, len, trace_zbuf, &zlen, trace_wrkmem) == LZO_E_OK &&
+        zlen < len)
+        trace_write(trace_zbuf, zlen);
+    else
+    {
+        zlen = len;
+        trace_write(data, len);
+    }
+
+    ch.trace_offset += zlen;
+    trace_bytes     += len;
+    trace_zbytes    += zlen;
+    return zlen;
+}
+
+
+static void trace_publish(void)
+{
+    if (ch.trace_fd < 0)
+        trace_open_chunk();
+
+    SigrindTraceRecord* rec = &ch.trace_chunk->records[ch.trace_chunk->num_records++];
+    rec->offset        = ch.trace_offset;
+    rec->events_used   = ch.curr_ev_used;
+    rec->events_bytes  = packed ? ch.curr_ev_used
+                                : ch.curr_ev_used * sizeof(SglEvVariant);
+    rec->events_zbytes = trace_put(ch.curr_ev_buf->events, rec->events_bytes);
+    rec->names_used    = ch.curr_name_used;
+    rec->names_zbytes  = trace_put(ch.curr_name_buf->names, rec->names_used);
+    ++trace_buffers;
+
+    if (ch.trace_chunk->num_records == SIGRIND_TRACE_CHUNK_RECORDS)
+        trace_close_chunk();
+}
+
+
+/******************************
+ * FIFO transport
+ ******************************/
+static inline void fifo_publish(void)
 {
     /* Mark that the buffer is being flushed,
      * and tell Sigil2 the buffer is ready to consume */
-    is_full[curr_idx] = True;
-    Int res = VG_(write)(fullfd, &curr_idx, sizeof(curr_idx));
-    if (res != sizeof(curr_idx))
+    ch.is_full[ch.curr_idx] = True;
+    Int res = VG_(write)(ch.fullfd, &ch.curr_idx, sizeof(ch.curr_idx));
+    if (res != sizeof(ch.curr_idx))
     {
         VG_(umsg)("error VG_(write)\n");
         VG_(umsg)("error writing to Sigrind fifo\n");
@@ -53,19 +581,18 @@ static inline void flush_to_sigil2(void)
 }
 
 
-static inline void set_next_buffer(void)
+static inline void fifo_wait_for_empty(void)
 {
-    /* try the next buffer, circular */
-    ++curr_idx;
-    if (curr_idx == SIGIL2_IPC_BUFFERS)
-        curr_idx = 0;
-
     /* if the next buffer is full,
      * wait until Sigil2 communicates that it's free */
-    if (is_full[curr_idx])
+    if (ch.is_full[ch.curr_idx])
     {
         UInt buf_idx;
-        Int res = VG_(read)(emptyfd, &buf_idx, sizeof(buf_idx));
+        ULong start = stall_clock();
+        Int res = VG_(read)(ch.emptyfd, &buf_idx, sizeof(buf_idx));
+        ++SGL_(ipc_stat).stalls;
+        ++SGL_(ipc_stat).stall_blocks;
+        SGL_(ipc_stat).stall_nsecs += stall_clock() - start;
         if (res != sizeof(buf_idx))
         {
             VG_(umsg)("error VG_(read)\n");
@@ -74,31 +601,114 @@ static inline void set_next_buffer(void)
             VG_(exit)(1);
         }
 
-        tl_assert(buf_idx < SIGIL2_IPC_BUFFERS);
-        tl_assert(buf_idx == curr_idx);
-        curr_idx = buf_idx;
-        is_full[curr_idx] = False;
+        tl_assert(buf_idx < ch.num_buffers);
+        tl_assert(buf_idx == ch.curr_idx);
+        ch.curr_idx = buf_idx;
+        ch.is_full[ch.curr_idx] = False;
+    }
+}
+
+
+static inline void flush_to_sigil2(void)
+{
+    commit_used_counts();
+    if (ch.trace_chunk != NULL)
+        trace_publish();
+    else if (ch.ring != NULL)
+        ring_publish();
+    else
+        fifo_publish();
+}
+
+
+static inline void set_next_buffer(void)
+{
+    if (ch.trace_chunk != NULL)
+    {
+        /* the buffer was already written out */
+        ch.curr_idx = 0;
+    }
+    else if (ch.ring != NULL)
+    {
+        ch.curr_idx = ch.ring->head % ch.num_buffers;
+        ring_wait_for_empty();
+    }
+    else
+    {
+        /* try the next buffer, circular */
+        ++ch.curr_idx;
+        if (ch.curr_idx == ch.num_buffers)
+            ch.curr_idx = 0;
+        fifo_wait_for_empty();
     }
 
-    set_and_init_buffer(curr_idx);
+    set_and_init_buffer(ch.curr_idx);
 }
 
 
 static inline Bool is_events_full(void)
 {
-    return curr_ev_buf->used == SIGIL2_EVENTS_BUFFER_SIZE;
+    if (packed)
+        return ch.packed_pos > ch.packed_limit;
+    return ch.curr_ev_used == ch.buffer_events;
 }
 
 
 static inline Bool is_names_full(UInt size)
 {
-    return (curr_name_buf->used + size) > SIGIL2_EVENTS_BUFFER_SIZE;
+    return (ch.curr_name_used + size) > ch.buffer_name_bytes;
 }
 
 
-SglEvVariant* SGL_(acq_event_slot)()
+static inline Bool block_fits(UInt count)
 {
-    tl_assert(initialized == True);
+    if (packed)
+        return ch.packed_pos + count * PACKED_EVENT_MAX_BYTES
+               <= ch.packed_limit + PACKED_EVENT_MAX_BYTES;
+    return ch.curr_ev_used + count <= ch.buffer_events;
+}
+
+
+static void commit_block(void)
+{
+    UInt used = SGL_(block_used);
+    tl_assert(used <= ch.pending_count);
+
+    if (packed)
+    {
+        for (UInt i = 0; i < used; ++i)
+            encode_event(&ch.pending_block[i]);
+        packed_events += used;
+    }
+    else
+    {
+        for (UInt i = 0; i < used; ++i)
+            count_event(&ch.pending_block[i]);
+
+        /* drop the slots after the block's actual exit */
+        ch.curr_ev_used -= ch.pending_count - used;
+        ch.curr_ev_slot -= ch.pending_count - used;
+    }
+
+    ch.pending_block = NULL;
+}
+
+
+static inline void commit_pending(void)
+{
+    /* at most one of these is pending */
+    if (packed)
+        encode_pending();
+    else
+        count_pending();
+    if (ch.pending_block != NULL)
+        commit_block();
+}
+
+
+static SglEvVariant* next_event_slot(void)
+{
+    commit_pending();
 
     if (is_events_full())
     {
@@ -106,14 +716,112 @@ SglEvVariant* SGL_(acq_event_slot)()
         set_next_buffer();
     }
 
-    curr_ev_buf->used++;
-    return curr_ev_slot++;
+    if (packed)
+    {
+        have_staged = True;
+        ++packed_events;
+        return &staged_ev;
+    }
+
+    ch.curr_ev_used++;
+    last_slot = ch.curr_ev_slot;
+    return ch.curr_ev_slot++;
+}
+
+
+static void flush_coalesced_one(UInt k)
+{
+    if (have_coalesced[k])
+    {
+        *next_event_slot() = coalesced[k];
+        have_coalesced[k] = False;
+        ++coalesced_events;
+    }
+}
+
+
+static inline void flush_coalesced(void)
+{
+    if (!have_coalesced[0] && !have_coalesced[1])
+        return;
+
+    /* oldest first, to keep the order of the first accesses */
+    UInt first = coalesced_first;
+    flush_coalesced_one(first);
+    flush_coalesced_one(first ^ 1);
+}
+
+
+static inline Bool overlaps(const SglMemEv* mem, Addr addr, Word size)
+{
+    return addr < mem->begin_addr + mem->size && mem->begin_addr < addr + size;
+}
+
+
+void SGL_(coalesce_mem)(Int type, Addr addr, Word size)
+{
+    tl_assert(initialized == True);
+
+    UInt k = type == SGLPRIM_MEM_LOAD ? 0 : 1;
+    SglMemEv* mem   = &coalesced[k].mem;
+    SglMemEv* other = &coalesced[k ^ 1].mem;
+    ++coalesced_accesses;
+
+    /* an access must not move past one to the same bytes of the other type */
+    if (have_coalesced[k ^ 1] && overlaps(other, addr, size))
+        flush_coalesced();
+
+    if (have_coalesced[k])
+    {
+        Addr begin = mem->begin_addr;
+        Addr end   = mem->begin_addr + mem->size;
+
+        /* adjacent or overlapping */
+        if (addr <= end && addr + size >= begin)
+        {
+            if (addr < begin)
+                begin = addr;
+            if (addr + size > end)
+                end = addr + size;
+            if (end - begin <= COALESCE_MAX_BYTES)
+            {
+                mem->begin_addr = begin;
+                mem->size       = end - begin;
+                return;
+            }
+        }
+
+        if (coalesced_first == k)
+            flush_coalesced_one(k);
+        else
+            flush_coalesced();
+    }
+
+    coalesced_first   = have_coalesced[k ^ 1] ? k ^ 1 : k;
+    coalesced[k].tag  = SGL_MEM_TAG;
+    mem->type         = type;
+    mem->begin_addr   = addr;
+    mem->size         = size;
+    have_coalesced[k] = True;
+}
+
+
+SglEvVariant* SGL_(acq_event_slot)()
+{
+    tl_assert(initialized == True);
+
+    flush_coalesced();
+    return next_event_slot();
 }
 
 
 EventNameSlotTuple SGL_(acq_event_name_slot)(UInt size)
 {
     tl_assert(initialized == True);
+    tl_assert(size <= ch.buffer_name_bytes);
+
+    flush_coalesced();
+    commit_pending();
 
     if (is_events_full() || is_names_full(size))
     {
@@ -121,26 +829,76 @@ EventNameSlotTuple SGL_(acq_event_name_slot)(UInt size)
         set_next_buffer();
     }
 
-    EventNameSlotTuple tuple = {curr_ev_slot, curr_name_slot, curr_name_buf->used};
-    curr_ev_buf->used   += 1;
-    curr_ev_slot        += 1;
-    curr_name_buf->used += size;
-    curr_name_slot      += size;
+    EventNameSlotTuple tuple = {ch.curr_ev_slot, ch.curr_name_slot, ch.curr_name_used};
+    if (packed)
+    {
+        have_staged = True;
+        ++packed_events;
+        tuple.event_slot = &staged_ev;
+    }
+    else
+    {
+        last_slot = ch.curr_ev_slot;
+        ch.curr_ev_used += 1;
+        ch.curr_ev_slot += 1;
+    }
+    ch.curr_name_used += size;
+    ch.curr_name_slot += size;
 
     return tuple;
 }
 
 
+SglEvVariant* SGL_(acq_block_slots)(const SglEvVariant* template, UInt count)
+{
+    tl_assert(initialized == True);
+    tl_assert(count <= SGL_MAX_BLOCK_EVENTS);
+
+    flush_coalesced();
+    commit_pending();
+
+    if (!block_fits(count))
+    {
+        flush_to_sigil2();
+        set_next_buffer();
+    }
+
+    SglEvVariant* slots;
+    if (packed)
+        slots = block_staging;
+    else
+    {
+        slots = ch.curr_ev_slot;
+        ch.curr_ev_used += count;
+        ch.curr_ev_slot += count;
+    }
+
+    VG_(memcpy)(slots, template, count * sizeof(SglEvVariant));
+    ch.pending_block = slots;
+    ch.pending_count = count;
+    SGL_(block_used) = count;
+
+    return slots;
+}
+
+
+void SGL_(end_block)(void)
+{
+    if (ch.pending_block != NULL)
+        commit_block();
+}
+
+
 /******************************
  * Initialization/Termination
  ******************************/
-static int open_fifo(const HChar *fifo_path, int flags)
+static int open_ipc_file(const HChar *path, int flags)
 {
     tl_assert(initialized == False);
 
     int tries = 0;
     const int max_tries = 4;
-    int fd = VG_(fd_open)(fifo_path, flags, 0600);
+    int fd = VG_(fd_open)(path, flags, 0600);
     while (fd < 0)
     {
         if (++tries < max_tries)
@@ -159,11 +917,11 @@ static int open_fifo(const HChar *fifo_path, int flags)
 #else
 #error "Only linux is supported"
 #endif
-            fd = VG_(fd_open)(fifo_path, flags, 0600);
+            fd = VG_(fd_open)(path, flags, 0600);
         }
         else
         {
-            VG_(umsg)("FIFO for Sigrind failed\n");
+            VG_(umsg)("Opening %s for Sigrind failed\n", path);
             VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
             VG_(exit) (1);
         }
@@ -173,19 +931,76 @@ static int open_fifo(const HChar *fifo_path, int flags)
 }
 
 
-static Sigil2DBISharedData* open_shmem(const HChar *shmem_path, int flags)
+static Bool uses_shmem_header(void)
 {
-    tl_assert(initialized == False);
+    /* the default geometry and encoding are implied by Sigil2DBISharedData */
+    return SGL_(clo).ipc_buffers > 0 ||
+           SGL_(clo).ipc_buffer_events > 0 ||
+           SGL_(clo).ipc_encoding != ipc_fixed ||
+           SGL_(clo).ipc_channels != ipc_single;
+}
+
 
-    int shared_mem_fd = VG_(fd_open)(shmem_path, flags, 0600);
-    if (shared_mem_fd < 0)
+static void set_header_geometry(UInt num_buffers)
+{
+    ch.num_buffers       = num_buffers;
+    ch.buffer_events     = SGL_(clo).ipc_buffer_events > 0 ?
+                           SGL_(clo).ipc_buffer_events : SIGIL2_EVENTS_BUFFER_SIZE;
+    ch.buffer_name_bytes = ch.buffer_events;
+
+    /* keep every buffer on its own cache lines */
+    ch.event_buffer_stride = VG_ROUNDUP(offsetof(EventBuffer, events) +
+                                        (ULong)ch.buffer_events * sizeof(SglEvVariant), 64);
+    ch.name_buffer_stride  = VG_ROUNDUP(offsetof(NameBuffer, names) +
+                                        (ULong)ch.buffer_name_bytes, 64);
+}
+
+
+static Addr map_shmem(Int shared_mem_fd, const HChar *shmem_path, Bool use_header)
+{
+    ULong size;
+
+    if (use_header)
     {
-        VG_(umsg)("Cannot open shared_mem file %s\n", shmem_path);
-        VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
-        VG_(exit)(1);
+        set_header_geometry(SGL_(clo).ipc_buffers > 0 ?
+                            SGL_(clo).ipc_buffers : SIGIL2_IPC_BUFFERS);
+        size = VG_ROUNDUP(sizeof(SigrindShmemHeader), 64) +
+               (ULong)ch.num_buffers * (ch.event_buffer_stride + ch.name_buffer_stride);
+
+        /* Sigil2 does not know the geometry up front,
+         * so the file may still need to grow */
+        if (VG_(fsize)(shared_mem_fd) < (Long)size &&
+            sr_isError(VG_(do_syscall2)(__NR_ftruncate, shared_mem_fd, size)))
+        {
+            VG_(umsg)("error resizing %s to %llu bytes\n", shmem_path, size);
+            VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
+            VG_(exit)(1);
+        }
+    }
+    else
+    {
+        ch.num_buffers         = SIGIL2_IPC_BUFFERS;
+        ch.buffer_events       = SIGIL2_EVENTS_BUFFER_SIZE;
+        ch.buffer_name_bytes   = SIGIL2_EVENTS_BUFFER_SIZE;
+        ch.event_buffer_stride = sizeof(EventBuffer);
+        ch.name_buffer_stride  = sizeof(NameBuffer);
+
+        /* the ring control block follows the event/name buffers */
+        size = sizeof(Sigil2DBISharedData);
+        if (SGL_(clo).ipc_transport == ipc_ring)
+        {
+            size += sizeof(SigrindRingControl);
+            if (VG_(fsize)(shared_mem_fd) < (Long)size)
+            {
+                VG_(umsg)("shared_mem file %s is too small for --ipc-transport=ring\n",
+                          shmem_path);
+                VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
+                VG_(exit)(1);
+            }
+        }
     }
 
-    SysRes res = VG_(am_shared_mmap_file_float_valgrind)(sizeof(Sigil2DBISharedData),
+    SysRes res = VG_(am_shared_mmap_file_float_valgrind)(size,
                                                          VKI_PROT_READ|VKI_PROT_WRITE,
                                                          shared_mem_fd, (Off64T)0);
     if (sr_isError(res))
@@ -199,20 +1014,162 @@ static Sigil2DBISharedData* open_shmem(const HChar *shmem_path, int flags)
     Addr addr_shared = sr_Res (res);
     VG_(close)(shared_mem_fd);
 
-    return (Sigil2DBISharedData*) addr_shared;
+    if (use_header)
+    {
+        SigrindShmemHeader* hdr = (SigrindShmemHeader*)addr_shared;
+        ch.event_buffers = addr_shared + VG_ROUNDUP(sizeof(SigrindShmemHeader), 64);
+        ch.name_buffers  = ch.event_buffers + ch.num_buffers * ch.event_buffer_stride;
+
+        hdr->version              = SIGRIND_SHMEM_VERSION;
+        hdr->num_buffers          = ch.num_buffers;
+        hdr->buffer_events        = ch.buffer_events;
+        hdr->buffer_name_bytes    = ch.buffer_name_bytes;
+        hdr->event_size           = sizeof(SglEvVariant);
+        hdr->encoding             = packed ? SIGRIND_ENCODING_PACKED
+                                           : SIGRIND_ENCODING_FIXED;
+        hdr->max_channels         = SGL_(clo).ipc_channels == ipc_per_thread ?
+                                    SIGRIND_MAX_CHANNELS : 0;
+        hdr->event_buffers_offset = ch.event_buffers - addr_shared;
+        hdr->event_buffer_stride  = ch.event_buffer_stride;
+        hdr->name_buffers_offset  = ch.name_buffers - addr_shared;
+        hdr->name_buffer_stride   = ch.name_buffer_stride;
+        hdr->total_size           = size;
+        __atomic_store_n(&hdr->magic, SIGRIND_SHMEM_MAGIC, __ATOMIC_SEQ_CST);
+        futex_wake(&hdr->magic);
+    }
+    else
+    {
+        Sigil2DBISharedData* shared = (Sigil2DBISharedData*)addr_shared;
+        ch.event_buffers = (Addr)shared->eventBuffers;
+        ch.name_buffers  = (Addr)shared->nameBuffers;
+    }
+
+    return addr_shared;
 }
 
 
-void SGL_(init_IPC)()
+static Addr open_shmem(const HChar *shmem_path, int flags)
 {
     tl_assert(initialized == False);
 
+    int shared_mem_fd = open_ipc_file(shmem_path, flags);
+    return map_shmem(shared_mem_fd, shmem_path, uses_shmem_header());
+}
+
+
+static SigrindRingControl* init_ring(Addr addr_shared, Bool use_header)
+{
+    SigrindRingControl* ctrl;
+    if (use_header)
+        ctrl = &((SigrindShmemHeader*)addr_shared)->ring;
+    else
+        ctrl = (SigrindRingControl*)((Sigil2DBISharedData*)addr_shared + 1);
+
+    /* Sigil2 hands over a zero-filled control block;
+     * the magic number tells it that the ring is in use */
+    UInt head = ctrl->head;
+    UInt tail = ctrl->tail;
+    if (head != 0 || tail != 0)
+    {
+        VG_(umsg)("expected a zero-filled ring control block, "
+                  "found head/tail = %u/%u\n", head, tail);
+        VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
+        VG_(exit)(1);
+    }
+    sigil2_parent = VG_(getppid)();
+    ctrl->version = SIGRIND_RING_VERSION;
+    __atomic_store_n(&ctrl->magic, SIGRIND_RING_MAGIC, __ATOMIC_SEQ_CST);
+    futex_wake(&ctrl->magic);
+
+    return ctrl;
+}
+
+
+static void open_trace(UInt n)
+{
+    /* one buffer in tool memory, laid out like in shared memory */
+    set_header_geometry(1);
+    ch.event_buffers = (Addr)CLG_MALLOC("sgl.ipc.ot.1", ch.event_buffer_stride);
+    ch.name_buffers  = (Addr)CLG_MALLOC("sgl.ipc.ot.2", ch.name_buffer_stride);
+    ch.ring    = NULL;
+    ch.emptyfd = -1;
+    ch.fullfd  = -1;
+
+    SigrindTraceChunk* chunk = (SigrindTraceChunk*) CLG_MALLOC("sgl.ipc.ot.3",
+                                                               sizeof(SigrindTraceChunk));
+    VG_(memset)(chunk, 0, sizeof(SigrindTraceChunk));
+    chunk->version           = SIGRIND_TRACE_VERSION;
+    chunk->channel           = n;
+    chunk->buffer_events     = ch.buffer_events;
+    chunk->buffer_name_bytes = ch.buffer_name_bytes;
+    chunk->event_size        = sizeof(SglEvVariant);
+    chunk->encoding          = packed ? SIGRIND_ENCODING_PACKED
+                                      : SIGRIND_ENCODING_FIXED;
+
+    ch.trace_chunk   = chunk;
+    ch.trace_fd      = -1;
+    ch.trace_channel = n;
+}
+
+
+static void init_trace(void)
+{
+    open_trace(0);
+
+    /* worst case LZO1X expansion of the larger of both buffers */
+    SizeT max_bytes = (SizeT)ch.buffer_events * sizeof(SglEvVariant);
+    trace_zbuf   = (UChar*) CLG_MALLOC("sgl.ipc.it.1", max_bytes + max_bytes / 16 + 64 + 3);
+    trace_wrkmem = CLG_MALLOC("sgl.ipc.it.2", LZO1X_1_MEM_COMPRESS);
+
+    trace_buffers = 0;
+    trace_bytes   = 0;
+    trace_zbytes  = 0;
+
+    /* there is no Sigil2 to announce the channels to */
+    if (SGL_(clo).ipc_channels == ipc_per_thread)
+    {
+        channel_table = (SigrindChannelTable*) CLG_MALLOC("sgl.ipc.it.3",
+                                                          sizeof(SigrindChannelTable));
+        VG_(memset)(channel_table, 0, sizeof(SigrindChannelTable));
+    }
+}
+
+
+static void init_channel_state(void)
+{
+    /* initialize cached IPC state */
+    ch.curr_idx = 0;
+    set_and_init_buffer(ch.curr_idx);
+    ch.pending_block = NULL;
+    tl_assert(block_fits(SGL_MAX_BLOCK_EVENTS));
+    ch.is_full = (Bool*) CLG_MALLOC("sgl.ipc.init.1", ch.num_buffers * sizeof(Bool));
+    for (UInt i=0; i<ch.num_buffers; ++i)
+        ch.is_full[i] = False;
+}
+
+
+static void connect_sigil2(void)
+{
     if (SGL_(clo).ipc_dir == NULL)
     {
        VG_(fmsg)("No --ipc-dir argument found, shutting down...\n");
        VG_(exit)(1);
     }
 
+    if (SGL_(clo).ipc_channels == ipc_per_thread &&
+        SGL_(clo).ipc_transport != ipc_ring)
+    {
+       VG_(fmsg)("--ipc-channels=per-thread requires --ipc-transport=ring\n");
+       VG_(exit)(1);
+    }
+
+    if (SGL_(clo).ipc_wait != ipc_block &&
+        SGL_(clo).ipc_transport != ipc_ring)
+    {
+       VG_(fmsg)("--ipc-wait=spin|hybrid requires --ipc-transport=ring\n");
+       VG_(exit)(1);
+    }
+
     Int ipc_dir_len = VG_(strlen)(SGL_(clo).ipc_dir);
     Int filename_len;
 
@@ -229,28 +1186,198 @@ void SGL_(init_IPC)()
     HChar fullfifo_path[filename_len];
     VG_(snprintf)(fullfifo_path, filename_len, "%s/%s-0", SGL_(clo).ipc_dir, SIGIL2_IPC_FULLFIFO_BASENAME);
 
-    emptyfd = open_fifo(emptyfifo_path, VKI_O_RDONLY);
-    fullfd  = open_fifo(fullfifo_path, VKI_O_WRONLY);
-    shmem   = open_shmem(shmem_path, VKI_O_RDWR);
+    if (SGL_(clo).ipc_transport == ipc_ring)
+    {
+        /* the FIFOs are unused */
+        Addr shared = open_shmem(shmem_path, VKI_O_RDWR);
+        ch.ring = init_ring(shared, uses_shmem_header());
+        if (SGL_(clo).ipc_channels == ipc_per_thread)
+            channel_table = &((SigrindShmemHeader*)shared)->channels;
+    }
+    else
+    {
+        ch.emptyfd = open_ipc_file(emptyfifo_path, VKI_O_RDONLY);
+        ch.fullfd  = open_ipc_file(fullfifo_path, VKI_O_WRONLY);
+        open_shmem(shmem_path, VKI_O_RDWR);
+        ch.ring    = NULL;
+    }
+}
 
-    /* initialize cached IPC state */
-    curr_idx = 0;
-    set_and_init_buffer(curr_idx);
-    for (UInt i=0; i<SIGIL2_IPC_BUFFERS; ++i)
-        is_full[i] = False;
+
+void SGL_(init_IPC)()
+{
+    tl_assert(initialized == False);
+
+    packed      = SGL_(clo).ipc_encoding == ipc_packed;
+    have_staged = False;
+    last_slot   = NULL;
+
+    if (SGL_(clo).trace_out != NULL)
+        init_trace();
+    else
+        connect_sigil2();
+
+    init_channel_state();
+
+    /* channel 0 is assigned to the first thread that runs */
+    ch_tid       = VG_INVALID_THREADID;
+    num_channels = 0;
+    switch_stamp = 0;
+    if (SGL_(clo).ipc_channels == ipc_per_thread)
+    {
+        channels = (IpcChannel**) CLG_MALLOC("sgl.ipc.init.2",
+                                             VG_N_THREADS * sizeof(IpcChannel*));
+        for (UInt i=0; i<VG_N_THREADS; ++i)
+            channels[i] = NULL;
+    }
 
     initialized = True;
 }
 
 
-void SGL_(term_IPC)(void)
+/******************************
+ * Per-thread channels
+ ******************************/
+static void open_channel(UInt n)
+{
+    if (SGL_(clo).trace_out != NULL)
+    {
+        open_trace(n);
+        init_channel_state();
+        return;
+    }
+
+    /* Sigil2 only provides channel 0, the others are created here */
+    Int filename_len = VG_(strlen)(SGL_(clo).ipc_dir) +
+                       VG_(strlen)(SIGIL2_IPC_SHMEM_BASENAME) + 13;
+    HChar shmem_path[filename_len];
+    VG_(snprintf)(shmem_path, filename_len, "%s/%s-%u",
+                  SGL_(clo).ipc_dir, SIGIL2_IPC_SHMEM_BASENAME, n);
+
+    Int fd = VG_(fd_open)(shmem_path, VKI_O_RDWR|VKI_O_CREAT|VKI_O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        VG_(umsg)("Creating %s for Sigrind failed\n", shmem_path);
+        VG_(umsg)("Cannot recover from previous error. Good-bye.\n");
+        VG_(exit)(1);
+    }
+
+    Addr shared = map_shmem(fd, shmem_path, True);
+    ch.ring    = init_ring(shared, True);
+    ch.emptyfd = -1;
+    ch.fullfd  = -1;
+    init_channel_state();
+}
+
+
+static IpcChannel* new_channel(ThreadId tid)
+{
+    /* overflow threads share channel 0 */
+    if (num_channels == SIGRIND_MAX_CHANNELS)
+        return channel_list[0];
+
+    /* channel 0 was opened by init_IPC and is still in 'ch' */
+    if (num_channels > 0)
+        open_channel(num_channels);
+
+    IpcChannel* saved = (IpcChannel*) CLG_MALLOC("sgl.ipc.nc.1", sizeof(IpcChannel));
+    *saved = ch;
+    channel_list[num_channels] = saved;
+
+    channel_table->tid[num_channels] = tid;
+    __atomic_store_n(&channel_table->count, num_channels + 1, __ATOMIC_SEQ_CST);
+    futex_wake(&channel_table->count);
+    ++num_channels;
+
+    return saved;
+}
+
+
+static inline Bool is_buffer_empty(void)
+{
+    if (packed)
+        return ch.packed_pos == (UChar*)ch.curr_ev_buf->events &&
+               ch.curr_name_used == 0;
+    return ch.curr_ev_used == 0 && ch.curr_name_used == 0;
+}
+
+
+void SGL_(switch_channel)(ThreadId tid)
 {
     tl_assert(initialized == True);
+    tl_assert(SGL_(clo).ipc_channels == ipc_per_thread);
+
+    if (tid == ch_tid || tid == VG_INVALID_THREADID)
+        return;
+
+    flush_coalesced();
+    commit_pending();
+    if (ch_tid != VG_INVALID_THREADID)
+    {
+        /* publish the events of the descheduled thread,
+         * so they can be merged with the other channels */
+        if (!is_buffer_empty())
+        {
+            flush_to_sigil2();
+            set_next_buffer();
+        }
+        *channels[ch_tid] = ch;
+    }
+
+    if (channels[tid] == NULL)
+        channels[tid] = new_channel(tid);
+    ch     = *channels[tid];
+    ch_tid = tid;
+
+    /* start the next segment of this thread */
+    SglEvVariant* slot  = SGL_(acq_event_slot)();
+    slot->tag           = SGL_SYNC_TAG;
+    slot->sync.type     = SGLPRIM_SYNC_SWAP;
+    slot->sync.data[0]  = tid;
+    slot->sync.data[1]  = ++switch_stamp;
+}
+
+
+/******************************
+ * Termination
+ ******************************/
+static void term_ring(void)
+{
+    /* publish the last, partially filled buffer */
+    ring_publish();
+    __atomic_store_n(&ch.ring->finished, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&ch.ring->head);
+}
+
+
+static void term_trace(void)
+{
+    /* write the last, partially filled buffer */
+    if (!is_buffer_empty())
+        trace_publish();
+    if (ch.trace_fd >= 0)
+        trace_close_chunk();
+}
+
 
+static void wait_for_disconnect(SigrindRingControl* ctrl)
+{
+    /* wait until Sigil2 drained the ring and disconnects */
+    while (__atomic_load_n(&ctrl->disconnected, __ATOMIC_ACQUIRE) == 0)
+    {
+        futex_wait(&ctrl->disconnected, 0);
+        if (__atomic_load_n(&ctrl->disconnected, __ATOMIC_ACQUIRE) == 0)
+            ring_check_consumer(ctrl);
+    }
+}
+
+
+static void term_fifo(void)
+{
     /* send finish sequence */
     UInt finished = SIGIL2_IPC_FINISHED;
-    if (VG_(write)(fullfd, &curr_idx, sizeof(curr_idx)) != sizeof(curr_idx) ||
-        VG_(write)(fullfd, &finished, sizeof(finished)) != sizeof(finished))
+    if (VG_(write)(ch.fullfd, &ch.curr_idx, sizeof(ch.curr_idx)) != sizeof(ch.curr_idx) ||
+        VG_(write)(ch.fullfd, &finished, sizeof(finished)) != sizeof(finished))
     {
         VG_(umsg)("error VG_(write)\n");
         VG_(umsg)("error writing to Sigrind fifo\n");
@@ -259,8 +1386,66 @@ void SGL_(term_IPC)(void)
     }
 
     /* wait until Sigrind disconnects */
-    while (VG_(read)(emptyfd, &finished, sizeof(finished)) > 0);
+    while (VG_(read)(ch.emptyfd, &finished, sizeof(finished)) > 0);
+
+    VG_(close)(ch.emptyfd);
+    VG_(close)(ch.fullfd);
+}
+
+
+void SGL_(term_IPC)(void)
+{
+    tl_assert(initialized == True);
+
+    flush_coalesced();
+    commit_pending();
+
+    if (num_channels > 0)
+    {
+        /* finish all channels before waiting for any of them,
+         * Sigil2 may only disconnect after merging all streams */
+        *channels[ch_tid] = ch;
+        for (UInt n=0; n<num_channels; ++n)
+        {
+            ch = *channel_list[n];
+            commit_used_counts();
+            if (ch.trace_chunk != NULL)
+                term_trace();
+            else
+                term_ring();
+        }
+        for (UInt n=0; n<num_channels; ++n)
+            if (channel_list[n]->ring != NULL)
+                wait_for_disconnect(channel_list[n]->ring);
+    }
+    else
+    {
+        commit_used_counts();
+        if (ch.trace_chunk != NULL)
+            term_trace();
+        else if (ch.ring != NULL)
+        {
+            term_ring();
+            wait_for_disconnect(ch.ring);
+        }
+        else
+            term_fifo();
+    }
+
+    if (packed && packed_events > 0)
+    {
+        ULong per_event = SGL_(ipc_stat).event_bytes * 100 / packed_events;
+        VG_(umsg)("Packed events: %llu in %llu bytes "
+                  "(%llu.%02llu bytes/event, %lu unpacked)\n",
+                  packed_events, SGL_(ipc_stat).event_bytes,
+                  per_event / 100, per_event % 100, sizeof(SglEvVariant));
+    }
+
+    if (SGL_(clo).coalesce_mem && coalesced_events > 0)
+        VG_(umsg)("Coalesced memory events: %llu accesses in %llu events\n",
+                  coalesced_accesses, coalesced_events);
 
-    VG_(close)(emptyfd);
-    VG_(close)(fullfd);
+    if (SGL_(clo).trace_out != NULL)
+        VG_(umsg)("Trace: %llu buffers, %llu bytes compressed to %llu in %s\n",
+                  trace_buffers, trace_bytes, trace_zbytes, SGL_(clo).trace_out);
 }
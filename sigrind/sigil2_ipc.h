@@ -18,6 +18,10 @@ typedef struct EventNameSlotTuple
 void SGL_(init_IPC)(void);
 void SGL_(term_IPC)(void);
 
+void SGL_(switch_channel)(ThreadId tid);
+/* --ipc-channels=per-thread: make the channel of 'tid' the active one,
+ * creating it on first use, and start a new segment in it */
+
 SglEvVariant* SGL_(acq_event_slot)(void);
 /* Get a buffer slot to add an event */
 
@@ -25,4 +29,42 @@ EventNameSlotTuple SGL_(acq_event_name_slot)(UInt size);
 /* Get a buffer slot to add an event (probably a context event)
  * and a name slot to add a name with it (like a function name) */
 
+void SGL_(coalesce_mem)(Int type, Addr addr, Word size);
+/* Add a MEM event, merged with the previous access of the same type
+ * if their ranges are adjacent or overlap (--coalesce-mem).
+ * Merging stops at the next acquisition of any other event */
+
+#define SGL_MAX_BLOCK_EVENTS 1024
+SglEvVariant* SGL_(acq_block_slots)(const SglEvVariant* template, UInt count);
+/* Get 'count' consecutive slots for the events of a superblock
+ * (--batch-events), initialized from 'template'.
+ * The block may be left early through a side exit, so only the first
+ * SGL_(block_used) slots are kept; the instrumented code sets it */
+
+void SGL_(end_block)(void);
+/* Commit the slots of the last superblock, if still pending.
+ * Any other slot acquisition does this implicitly */
+
+extern UInt SGL_(block_used);
+
+typedef struct SigrindIpcStats
+{
+    ULong events[SGL_CF_TAG + 1];
+    /* published events by EvTag */
+
+    ULong buffers;
+    ULong event_bytes;
+    ULong name_bytes;
+    /* published buffers and the bytes used in them */
+
+    ULong stalls;
+    ULong stall_blocks;
+    ULong stall_nsecs;
+    /* waits for Sigil2 to return an empty buffer, those that blocked in
+     * the kernel (not ended by --ipc-wait polling), and their total time */
+} SigrindIpcStats;
+
+extern SigrindIpcStats SGL_(ipc_stat);
+/* Producer-side counters, updated when a buffer is published */
+
 #endif
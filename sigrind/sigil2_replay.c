@@ -0,0 +1,509 @@
+/* sigrind-replay: stream a Sigrind trace (--trace-out) into Sigil2.
+ *
+ * usage: sigrind-replay [options] <trace-dir> <ipc-dir>
+ *
+ * Takes the place of Sigrind on the other end of --ipc-dir, with the ring
+ * transport and the geometry header; see "Trace files" in sigil2_shmem.h.
+ * Every traced channel is replayed into its own shared-memory file by its
+ * own group of threads, which decompress buffers directly into the ring
+ * slots.  Within a channel, buffers are decompressed in parallel but
+ * published in order. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "Frontends/CommonShmemIPC.h"
+#include "sigil2_shmem.h"
+#include "../coregrind/m_debuginfo/minilzo.h"
+
+typedef struct
+{
+    unsigned chunk;
+    unsigned record;
+} RecordRef;
+
+typedef struct
+{
+    unsigned n;
+    unsigned num_chunks;
+    SigrindTraceChunk* chunks;
+    RecordRef* records;
+    unsigned num_records;
+
+    SigrindShmemHeader* hdr;
+    char* base;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  turn;
+    unsigned next;      /* next record to decompress */
+    unsigned published; /* records published, i.e. ring->head */
+} Channel;
+
+static const char* trace_dir;
+static const char* ipc_dir;
+static unsigned    num_buffers = SIGIL2_IPC_BUFFERS;
+static unsigned    jobs = 2;
+static int         verbose = 0;
+
+static Channel  channels[SIGRIND_MAX_CHANNELS];
+static unsigned num_channels;
+static SigrindTraceChunk geometry;
+
+
+static void die(const char* fmt, const char* arg)
+{
+    fprintf(stderr, "sigrind-replay: ");
+    fprintf(stderr, fmt, arg);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: sigrind-replay [options] <trace-dir> <ipc-dir>\n"
+            "\n"
+            "  --ipc-buffers=<n>  ring buffers per channel [%u]\n"
+            "  --jobs=<n>         decompressing threads per channel [2]\n"
+            "  -v                 print a summary per channel\n",
+            SIGIL2_IPC_BUFFERS);
+    exit(1);
+}
+
+
+/******************************
+ * Ring transport
+ ******************************/
+static void futex_wait(volatile unsigned* addr, unsigned val)
+{
+    /* other replay threads may be waiting on the same word,
+     * and Sigil2 only wakes one of them */
+    struct timespec timeout = {0, 1000000};
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &timeout, NULL, 0);
+}
+
+
+static void futex_wake(volatile unsigned* addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+
+static void check_consumer(SigrindRingControl* ring)
+{
+    /* unlike Sigrind, replay is not started by Sigil2,
+     * so there is nothing to check before Sigil2 announces itself */
+    pid_t pid = (pid_t)__atomic_load_n(&ring->consumer_pid, __ATOMIC_ACQUIRE);
+    if (pid != 0 && kill(pid, 0) != 0 && errno == ESRCH)
+        die("%s", "Sigil2 exited");
+}
+
+
+static void wait_for_slot(SigrindRingControl* ring, unsigned seq)
+{
+    unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    while (seq - tail >= num_buffers)
+    {
+        __atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+        if (seq - tail < num_buffers)
+            break;
+
+        futex_wait(&ring->tail, tail);
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        check_consumer(ring);
+    }
+}
+
+
+static void publish(Channel* c, unsigned seq)
+{
+    SigrindRingControl* ring = &c->hdr->ring;
+
+    pthread_mutex_lock(&c->lock);
+    while (c->published != seq)
+        pthread_cond_wait(&c->turn, &c->lock);
+
+    __atomic_store_n(&ring->head, seq + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->consumer_waiting, __ATOMIC_SEQ_CST))
+    {
+        __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_SEQ_CST);
+        futex_wake(&ring->head);
+    }
+
+    c->published = seq + 1;
+    pthread_cond_broadcast(&c->turn);
+    pthread_mutex_unlock(&c->lock);
+}
+
+
+/******************************
+ * Trace files
+ ******************************/
+static void chunk_path(char* path, size_t len, unsigned n, unsigned chunk)
+{
+    snprintf(path, len, "%s/%s-%u-%u", trace_dir, SIGRIND_TRACE_BASENAME, n, chunk);
+}
+
+
+/* Sigrind's limit for --ipc-buffer-events, which also sizes name buffers */
+#define MAX_BUFFER_EVENTS (1U << 24)
+
+static int valid_record(const SigrindTraceChunk* hdr, const SigrindTraceRecord* rec)
+{
+    unsigned long long events_bytes =
+        hdr->encoding == SIGRIND_ENCODING_PACKED
+            ? rec->events_used
+            : (unsigned long long)rec->events_used * sizeof(SglEvVariant);
+
+    /* every part must fit into its ring slot, and is never stored
+     * larger than it is (see read_part) */
+    return rec->events_bytes == events_bytes &&
+           events_bytes <= (unsigned long long)hdr->buffer_events * sizeof(SglEvVariant) &&
+           rec->names_used <= hdr->buffer_name_bytes &&
+           rec->events_zbytes <= rec->events_bytes &&
+           rec->names_zbytes <= rec->names_used;
+}
+
+
+static int read_chunk_header(unsigned n, unsigned chunk, SigrindTraceChunk* hdr)
+{
+    char path[PATH_MAX];
+    chunk_path(path, sizeof(path), n, chunk);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    ssize_t res = pread(fd, hdr, sizeof(*hdr), 0);
+    close(fd);
+    if (res != sizeof(*hdr))
+        die("%s: truncated chunk", path);
+
+    if (hdr->magic != SIGRIND_TRACE_MAGIC)
+    {
+        /* the run was aborted while this chunk was written */
+        fprintf(stderr, "sigrind-replay: %s: incomplete chunk, ignored\n", path);
+        return 0;
+    }
+    if (hdr->version != SIGRIND_TRACE_VERSION ||
+        hdr->event_size != sizeof(SglEvVariant) ||
+        hdr->num_records > SIGRIND_TRACE_CHUNK_RECORDS)
+        die("%s: unsupported trace format", path);
+    if (hdr->buffer_events != geometry.buffer_events ||
+        hdr->buffer_name_bytes != geometry.buffer_name_bytes ||
+        hdr->encoding != geometry.encoding)
+        die("%s: geometry differs from the first chunk", path);
+
+    for (unsigned k = 0; k < hdr->num_records; ++k)
+        if (!valid_record(hdr, &hdr->records[k]))
+            die("%s: corrupt chunk index", path);
+
+    return 1;
+}
+
+
+static void scan_trace(void)
+{
+    char path[PATH_MAX];
+
+    chunk_path(path, sizeof(path), 0, 0);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || pread(fd, &geometry, sizeof(geometry), 0) != sizeof(geometry))
+        die("%s: no trace found", path);
+    close(fd);
+    if (geometry.buffer_events == 0 || geometry.buffer_events > MAX_BUFFER_EVENTS ||
+        geometry.buffer_name_bytes == 0 || geometry.buffer_name_bytes > MAX_BUFFER_EVENTS ||
+        (geometry.encoding != SIGRIND_ENCODING_FIXED &&
+         geometry.encoding != SIGRIND_ENCODING_PACKED))
+        die("%s: unsupported trace format", path);
+
+    for (num_channels = 0; num_channels < SIGRIND_MAX_CHANNELS; ++num_channels)
+    {
+        Channel* c = &channels[num_channels];
+        SigrindTraceChunk hdr;
+
+        c->n = num_channels;
+        while (read_chunk_header(c->n, c->num_chunks, &hdr))
+        {
+            c->chunks = realloc(c->chunks, (c->num_chunks + 1) * sizeof(*c->chunks));
+            c->records = realloc(c->records,
+                                 (c->num_records + hdr.num_records) * sizeof(*c->records));
+            if (c->chunks == NULL || c->records == NULL)
+                die("%s", strerror(ENOMEM));
+
+            for (unsigned k = 0; k < hdr.num_records; ++k)
+            {
+                c->records[c->num_records].chunk  = c->num_chunks;
+                c->records[c->num_records].record = k;
+                ++c->num_records;
+            }
+            c->chunks[c->num_chunks++] = hdr;
+        }
+
+        if (c->num_chunks == 0)
+            break;
+    }
+
+    if (num_channels == 0)
+        die("%s: no complete chunk", trace_dir);
+}
+
+
+/******************************
+ * Shared memory
+ ******************************/
+static SigrindShmemHeader* map_channel(unsigned n)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s-%u", ipc_dir, SIGIL2_IPC_SHMEM_BASENAME, n);
+
+    /* Sigil2 only provides channel 0, like with Sigrind */
+    int fd;
+    if (n == 0)
+    {
+        int tries = 0;
+        while ((fd = open(path, O_RDWR)) < 0 && ++tries < 4)
+            usleep(500000);
+    }
+    else
+        fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0)
+        die("opening %s failed", path);
+
+    unsigned long long event_stride =
+        (offsetof(EventBuffer, events) +
+         (unsigned long long)geometry.buffer_events * sizeof(SglEvVariant) + 63) & ~63ULL;
+    unsigned long long name_stride =
+        (offsetof(NameBuffer, names) + (unsigned long long)geometry.buffer_name_bytes + 63) & ~63ULL;
+    unsigned long long header_size = (sizeof(SigrindShmemHeader) + 63) & ~63ULL;
+    unsigned long long size = header_size + num_buffers * (event_stride + name_stride);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        ((unsigned long long)st.st_size < size && ftruncate(fd, size) != 0))
+        die("resizing %s failed", path);
+
+    SigrindShmemHeader* hdr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED)
+        die("mapping %s failed", path);
+    close(fd);
+
+    hdr->version              = SIGRIND_SHMEM_VERSION;
+    hdr->num_buffers          = num_buffers;
+    hdr->buffer_events        = geometry.buffer_events;
+    hdr->buffer_name_bytes    = geometry.buffer_name_bytes;
+    hdr->event_size           = sizeof(SglEvVariant);
+    hdr->encoding             = geometry.encoding;
+    hdr->max_channels         = num_channels > 1 ? SIGRIND_MAX_CHANNELS : 0;
+    hdr->event_buffers_offset = header_size;
+    hdr->event_buffer_stride  = event_stride;
+    hdr->name_buffers_offset  = header_size + num_buffers * event_stride;
+    hdr->name_buffer_stride   = name_stride;
+    hdr->total_size           = size;
+    __atomic_store_n(&hdr->magic, SIGRIND_SHMEM_MAGIC, __ATOMIC_SEQ_CST);
+    futex_wake(&hdr->magic);
+
+    hdr->ring.version = SIGRIND_RING_VERSION;
+    __atomic_store_n(&hdr->ring.magic, SIGRIND_RING_MAGIC, __ATOMIC_SEQ_CST);
+    futex_wake(&hdr->ring.magic);
+
+    return hdr;
+}
+
+
+static void open_channels(void)
+{
+    SigrindChannelTable* table = NULL;
+
+    for (unsigned n = 0; n < num_channels; ++n)
+    {
+        Channel* c = &channels[n];
+        c->hdr  = map_channel(n);
+        c->base = (char*)c->hdr;
+        pthread_mutex_init(&c->lock, NULL);
+        pthread_cond_init(&c->turn, NULL);
+
+        if (num_channels == 1)
+            break;
+
+        if (n == 0)
+            table = &c->hdr->channels;
+        table->tid[n] = c->chunks[0].tid;
+        __atomic_store_n(&table->count, n + 1, __ATOMIC_SEQ_CST);
+        futex_wake(&table->count);
+    }
+}
+
+
+/******************************
+ * Replay
+ ******************************/
+typedef struct
+{
+    Channel* c;
+    int      fd;       /* of 'chunk' */
+    unsigned chunk;
+    unsigned char* zbuf;
+} Worker;
+
+
+static void read_part(Worker* w, void* dst, unsigned long long offset,
+                      unsigned zbytes, unsigned bytes)
+{
+    /* stored as is unless it shrank */
+    void* buf = zbytes < bytes ? w->zbuf : dst;
+    if (pread(w->fd, buf, zbytes, offset) != (ssize_t)zbytes)
+        die("%s", "truncated trace data");
+
+    if (zbytes < bytes)
+    {
+        lzo_uint len = bytes;
+        if (lzo1x_decompress_safe(buf, zbytes, dst, &len, NULL) != LZO_E_OK ||
+            len != bytes)
+            die("%s", "corrupt trace data");
+    }
+}
+
+
+static void replay_record(Worker* w, unsigned seq)
+{
+    Channel* c = w->c;
+    RecordRef ref = c->records[seq];
+    const SigrindTraceRecord* rec = &c->chunks[ref.chunk].records[ref.record];
+
+    if (w->fd < 0 || w->chunk != ref.chunk)
+    {
+        char path[PATH_MAX];
+        if (w->fd >= 0)
+            close(w->fd);
+        chunk_path(path, sizeof(path), c->n, ref.chunk);
+        w->fd = open(path, O_RDONLY);
+        if (w->fd < 0)
+            die("opening %s failed", path);
+        w->chunk = ref.chunk;
+    }
+
+    wait_for_slot(&c->hdr->ring, seq);
+
+    unsigned slot = seq % num_buffers;
+    EventBuffer* eb = (EventBuffer*)(c->base + c->hdr->event_buffers_offset +
+                                     slot * c->hdr->event_buffer_stride);
+    NameBuffer*  nb = (NameBuffer*)(c->base + c->hdr->name_buffers_offset +
+                                    slot * c->hdr->name_buffer_stride);
+
+    read_part(w, eb->events, rec->offset, rec->events_zbytes, rec->events_bytes);
+    read_part(w, nb->names, rec->offset + rec->events_zbytes,
+              rec->names_zbytes, rec->names_used);
+    eb->used = rec->events_used;
+    nb->used = rec->names_used;
+
+    publish(c, seq);
+}
+
+
+static void* replay_channel(void* arg)
+{
+    Worker w = { arg, -1, 0, NULL };
+
+    size_t max_bytes = (size_t)geometry.buffer_events * sizeof(SglEvVariant);
+    if (geometry.buffer_name_bytes > max_bytes)
+        max_bytes = geometry.buffer_name_bytes;
+    w.zbuf = malloc(max_bytes);
+    if (w.zbuf == NULL)
+        die("%s", strerror(ENOMEM));
+
+    for (;;)
+    {
+        unsigned seq = __atomic_fetch_add(&w.c->next, 1, __ATOMIC_SEQ_CST);
+        if (seq >= w.c->num_records)
+            break;
+        replay_record(&w, seq);
+    }
+
+    if (w.fd >= 0)
+        close(w.fd);
+    free(w.zbuf);
+    return NULL;
+}
+
+
+int main(int argc, char** argv)
+{
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i)
+    {
+        if (strncmp(argv[i], "--ipc-buffers=", 14) == 0)
+            num_buffers = atoi(argv[i] + 14);
+        else if (strncmp(argv[i], "--jobs=", 7) == 0)
+            jobs = atoi(argv[i] + 7);
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = 1;
+        else
+            usage();
+    }
+    if (argc - i != 2 || num_buffers < 1 || num_buffers > 1024 || jobs < 1)
+        usage();
+    trace_dir = argv[i];
+    ipc_dir   = argv[i + 1];
+
+    if (lzo_init() != LZO_E_OK)
+        die("%s", "lzo_init failed");
+
+    scan_trace();
+    open_channels();
+
+    unsigned num_threads = num_channels * jobs;
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+    if (threads == NULL)
+        die("%s", strerror(ENOMEM));
+    for (unsigned t = 0; t < num_threads; ++t)
+        if (pthread_create(&threads[t], NULL, replay_channel, &channels[t / jobs]) != 0)
+            die("%s", "pthread_create failed");
+    for (unsigned t = 0; t < num_threads; ++t)
+        pthread_join(threads[t], NULL);
+
+    /* finish all channels before waiting for any of them,
+     * Sigil2 may only disconnect after merging all streams */
+    for (unsigned n = 0; n < num_channels; ++n)
+    {
+        SigrindRingControl* ring = &channels[n].hdr->ring;
+        __atomic_store_n(&ring->finished, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&ring->head);
+    }
+    for (unsigned n = 0; n < num_channels; ++n)
+    {
+        SigrindRingControl* ring = &channels[n].hdr->ring;
+        while (__atomic_load_n(&ring->disconnected, __ATOMIC_ACQUIRE) == 0)
+        {
+            futex_wait(&ring->disconnected, 0);
+            check_consumer(ring);
+        }
+
+        if (verbose)
+            fprintf(stderr, "sigrind-replay: channel %u (thread %u): "
+                    "%u buffers in %u chunks\n",
+                    n, channels[n].chunks[0].tid, channels[n].num_records,
+                    channels[n].num_chunks);
+    }
+
+    free(threads);
+    return 0;
+}
+
+
+#include "../coregrind/m_debuginfo/minilzo-inl.c"
@@ -0,0 +1,519 @@
+#ifndef SGL_SHMEM_H
+#define SGL_SHMEM_H
+
+/* Sigrind extensions to the Sigil2 shared-memory protocol.
+ *
+ * This header is shared with the Sigil2 frontend, so it must stay free of
+ * Valgrind types and includes; only plain C types are used.
+ * 'unsigned int' is assumed to be 32 bits wide. */
+
+
+/***************************************************************************
+ * Ring transport (--ipc-transport=ring)
+ *
+ * Instead of announcing every full/empty buffer over the FIFOs, Sigrind and
+ * Sigil2 coordinate through two free-running counters in a control block:
+ *
+ *   head: number of buffers published by Sigrind
+ *   tail: number of buffers released by Sigil2
+ *
+ * With N buffers (SIGIL2_IPC_BUFFERS, or 'num_buffers' from the geometry
+ * header below), buffer (head % N) is the next one Sigrind fills, and is
+ * only available while (head - tail) < N.  Sigil2 consumes buffer
+ * (tail % N) while tail != head.
+ *
+ * A side that runs out of work sets its '*_waiting' flag, re-checks the
+ * other side's counter, and then sleeps with FUTEX_WAIT on that counter.
+ * The other side issues a FUTEX_WAKE after advancing its counter if it
+ * sees the flag set.  The FIFOs are not used in this mode.
+ *
+ * The control block directly follows Sigil2DBISharedData in the
+ * shared-memory file, unless the geometry header is in use, in which case
+ * it is embedded in that header.  Either way it starts out zero-filled.
+ * Sigrind fills in 'version' and then 'magic' at startup; Sigil2 must not
+ * touch the block before 'magic' is set.
+ *
+ * At exit, Sigrind publishes its last (possibly partial) buffer, sets
+ * 'finished' and wakes Sigil2.  Sigil2 drains the ring, then sets
+ * 'disconnected' and wakes Sigrind.
+ *
+ * Sigil2 stores its process id into 'consumer_pid' once it sees 'magic'.
+ * Sigrind never sleeps on the ring for longer than
+ * SIGRIND_RING_LIVENESS_MS at a time.  In between, it checks that this
+ * process (or its own parent process, if 'consumer_pid' is still 0)
+ * exists, and gives up with an error if it is gone.
+ ***************************************************************************/
+
+#define SIGRIND_RING_MAGIC   0x52474c53U /* "SGLR" */
+#define SIGRIND_RING_VERSION 2U
+
+#define SIGRIND_RING_LIVENESS_MS 1000
+
+typedef struct SigrindRingControl
+{
+    volatile unsigned int magic;
+    volatile unsigned int version;
+
+    volatile unsigned int head;
+    volatile unsigned int tail;
+
+    volatile unsigned int producer_waiting;
+    volatile unsigned int consumer_waiting;
+
+    volatile unsigned int finished;
+    volatile unsigned int disconnected;
+
+    volatile unsigned int consumer_pid;
+} SigrindRingControl;
+
+
+/***************************************************************************
+ * Per-thread channels (--ipc-channels=per-thread, requires the ring)
+ *
+ * Channel 0 is the usual shared-memory file ("<SIGIL2_IPC_SHMEM_BASENAME>-0")
+ * and carries the events of the first guest thread.  When another thread
+ * first runs, Sigrind creates "<SIGIL2_IPC_SHMEM_BASENAME>-<n>" in the IPC
+ * directory for channel n, lays it out with the geometry header and the
+ * ring transport like channel 0, and then announces it in the channel
+ * table in channel 0's header: it stores the thread id into tid[n], then
+ * increments 'count' and issues a FUTEX_WAKE on it.  Channels are not
+ * removed; a thread id that is reused by Valgrind reuses its channel.
+ * Threads that do not fit into the table share channel 0.
+ *
+ * Every channel is an independent stream.  Whenever Sigrind switches to
+ * a thread, the thread's channel gets a SYNC event of type
+ * SGLPRIM_SYNC_SWAP with data[0] = thread id and data[1] = a global
+ * sequence stamp, which increases by one on every switch.  The events up
+ * to the next stamp in that channel happened between the two switches,
+ * so the global order is restored by merging the channels' segments in
+ * stamp order.  When a thread is switched out, its partially filled
+ * buffer is published, so a merging consumer never waits for events that
+ * Sigrind still holds.  Stamps are sent regardless of --gen-sync.
+ ***************************************************************************/
+
+#define SIGRIND_MAX_CHANNELS 256
+
+typedef struct SigrindChannelTable
+{
+    volatile unsigned int count;
+    unsigned int tid[SIGRIND_MAX_CHANNELS];
+} SigrindChannelTable;
+
+
+/***************************************************************************
+ * Buffer geometry header (--ipc-buffers=N, --ipc-buffer-events=M)
+ *
+ * By default the shared-memory file is exactly Sigil2DBISharedData, sized
+ * by the compile-time SIGIL2_IPC_BUFFERS and SIGIL2_EVENTS_BUFFER_SIZE.
+ * If either option (or --ipc-encoding=packed, or --ipc-channels=per-thread)
+ * is given, the file instead starts with this header, followed by
+ * 'num_buffers' event buffers and then 'num_buffers' name buffers, at the
+ * given offsets and strides from the start of the file.
+ *
+ * Every buffer has the same shape as the EventBuffer/NameBuffer structs,
+ * only with 'buffer_events' SglEvVariant slots and 'buffer_name_bytes'
+ * name characters respectively.  A buffer's 'used' count is only valid
+ * once the buffer has been handed over to Sigil2.
+ *
+ * Sigrind grows the file to 'total_size' bytes if needed, fills in the
+ * header and stores 'magic' last, followed by a FUTEX_WAKE on it.  Sigil2
+ * should wait for 'magic' (e.g. by mapping only the header first) before
+ * mapping and reading the buffers.
+ *
+ * 'max_channels' is 0 unless --ipc-channels=per-thread is given, see
+ * "Per-thread channels" above.
+ ***************************************************************************/
+
+#define SIGRIND_SHMEM_MAGIC   0x48534753U /* "SGSH" */
+#define SIGRIND_SHMEM_VERSION 1U
+
+#define SIGRIND_ENCODING_FIXED  0U /* one SglEvVariant per event */
+#define SIGRIND_ENCODING_PACKED 1U /* see "Packed event encoding" below */
+
+typedef struct SigrindShmemHeader
+{
+    volatile unsigned int magic;
+    unsigned int version;
+
+    unsigned int num_buffers;
+    unsigned int buffer_events;     /* SglEvVariant slots per event buffer */
+    unsigned int buffer_name_bytes; /* chars per name buffer */
+    unsigned int event_size;        /* sizeof(SglEvVariant), as a sanity check */
+    unsigned int encoding;          /* SIGRIND_ENCODING_* */
+    unsigned int max_channels;      /* capacity of 'channels', or 0 */
+
+    unsigned long long event_buffers_offset;
+    unsigned long long event_buffer_stride;
+    unsigned long long name_buffers_offset;
+    unsigned long long name_buffer_stride;
+    unsigned long long total_size;
+
+    SigrindRingControl ring;
+
+    SigrindChannelTable channels;   /* only valid in channel 0 */
+} SigrindShmemHeader;
+
+
+/***************************************************************************
+ * Packed event encoding (--ipc-encoding=packed)
+ *
+ * The event area of each event buffer is used as a byte stream, and its
+ * 'used' count is in bytes rather than events.  Name buffers are
+ * unchanged.  Every buffer can be decoded on its own: the delta bases
+ * below start at 0 for each buffer.
+ *
+ * Each event starts with one header byte:
+ *
+ *   bits 0-2: record kind (SIGRIND_PACKED_*)
+ *   bits 3-7: subtype, i.e. the event's MemType/CompCostType/SyncType/
+ *             CxtType.  The value 31 means the subtype did not fit and
+ *             follows as a varint.
+ *
+ * followed by kind-specific fields.  Varints are unsigned LEB128;
+ * signed values are zigzag-encoded ((v << 1) ^ (v >> 63)) first.
+ *
+ *   MEM:  size, zigzag(begin_addr - previous MEM begin_addr)
+ *   COMP: arity
+ *   SYNC: data[0], data[1]
+ *   CXT:  INSTR:                 zigzag(id - previous INSTR id)
+ *         FUNC_ENTER/FUNC_EXIT,
+ *         BLOCK/BLOCK_DEF,
+ *         FUNC_NAME,
+ *         BRANCHES/IND_BRANCH/
+ *         BRANCH_DEF,
+ *         REDUCE/REDUCE_FNS:     len, idx
+ *         otherwise:             id
+ *   RAW:  sizeof(SglEvVariant) bytes, copied verbatim (subtype is 0);
+ *         used for all other event tags.
+ *
+ * sigil2_decode.h provides a reference decoder.
+ ***************************************************************************/
+
+#define SIGRIND_PACKED_MEM  1U
+#define SIGRIND_PACKED_COMP 2U
+#define SIGRIND_PACKED_SYNC 3U
+#define SIGRIND_PACKED_CXT  4U
+#define SIGRIND_PACKED_RAW  7U
+
+#define SIGRIND_PACKED_KIND_BITS  3
+#define SIGRIND_PACKED_KIND_MASK  0x7U
+#define SIGRIND_PACKED_SUB_ESCAPE 31U
+
+
+/***************************************************************************
+ * Block definitions (--block-defs=yes, implies --batch-events=yes)
+ *
+ * Instead of one SGLPRIM_CXT_INSTR event per executed instruction, every
+ * batched superblock emits a single CXT event of type SIGRIND_CXT_BLOCK:
+ *
+ *   cxt.idx: block id
+ *   cxt.len: number of positions executed (see below)
+ *
+ * followed by the block's other events (memory, compute).  The first time
+ * a block runs, it is preceded by a CXT event of type
+ * SIGRIND_CXT_BLOCK_DEF, whose cxt.len bytes at cxt.idx in the name
+ * buffer hold a SigrindBlockDef followed by 'num_instrs'
+ * SigrindBlockDefInstr entries.  The payload is not aligned, so it
+ * should be copied out before use.
+ *
+ * A block's positions are its INSTR events and its other events in the
+ * order the unbatched stream would have them.  Entry k of the definition
+ * places the INSTR event for address (base_addr + offset) at 'position';
+ * all other positions are taken, in order, by the events that follow the
+ * BLOCK event.  A block that leaves through a side exit executes fewer
+ * positions than 'num_positions'.
+ *
+ * Block ids are unique for the whole run, also across per-thread
+ * channels; a retranslated block gets a new id and definition.  Blocks
+ * that cannot be batched keep sending INSTR events.
+ ***************************************************************************/
+
+#define SIGRIND_CXT_BLOCK_DEF 0x100U
+#define SIGRIND_CXT_BLOCK     0x101U
+
+typedef struct SigrindBlockDef
+{
+    unsigned long long id;
+    unsigned long long base_addr;
+    unsigned int num_positions;
+    unsigned int num_instrs;
+} SigrindBlockDef;
+
+typedef struct SigrindBlockDefInstr
+{
+    unsigned int position;
+    unsigned int offset;
+} SigrindBlockDefInstr;
+
+
+/***************************************************************************
+ * Function name interning (--intern-fn-names=yes)
+ *
+ * Function entry and exit are sent as CXT events of type
+ * SIGRIND_CXT_FUNC_ENTER_ID/SIGRIND_CXT_FUNC_EXIT_ID, with the function's
+ * numeric id in cxt.id, instead of SGLPRIM_CXT_FUNC_ENTER/EXIT with the
+ * name in the name buffer.  Before a function's id is first used, a CXT
+ * event of type SIGRIND_CXT_FUNC_NAME defines it: its cxt.len bytes at
+ * cxt.idx in the name buffer are the id as an (unaligned) unsigned int,
+ * followed by the NUL-terminated name.  Ids are unique for the whole run,
+ * also across per-thread channels.
+ ***************************************************************************/
+
+#define SIGRIND_CXT_FUNC_NAME     0x102U
+#define SIGRIND_CXT_FUNC_ENTER_ID 0x103U
+#define SIGRIND_CXT_FUNC_EXIT_ID  0x104U
+
+
+/***************************************************************************
+ * Sampling (--sample-on=N, --sample-off=M)
+ *
+ * Events are generated in windows of N million guest instructions,
+ * separated by M million instructions without instruction, memory and
+ * compute events.  Function entry/exit and sync events are still sent
+ * between windows.  Instructions are only counted while events are
+ * collected at all (see --at-func, --start-func).  With
+ * --sample-phases=yes, a window is only generated if the instructions
+ * skipped before it do not look like a program phase that has been
+ * sampled already; otherwise another M million instructions are skipped.
+ *
+ * The start and end of each window is marked with a CXT event of type
+ * SIGRIND_CXT_SAMPLE_ON/SIGRIND_CXT_SAMPLE_OFF, whose cxt.id is the
+ * number of instructions counted so far.  It is sent on the channel of
+ * the thread that crossed the boundary.  Window boundaries are only
+ * precise to a superblock.
+ ***************************************************************************/
+
+#define SIGRIND_CXT_SAMPLE_ON     0x105U
+#define SIGRIND_CXT_SAMPLE_OFF    0x106U
+
+
+/***************************************************************************
+ * Vector compute events (--gen-comp=yes)
+ *
+ * SIMD ops are sent as COMP events of type SIGRIND_COMP_VEC_IOP (integer
+ * lanes) or SIGRIND_COMP_VEC_FLOP (floating point lanes).  Such an event
+ * summarizes several ops of the same shape, and comp.arity is packed as:
+ *
+ *   bits  0-3:  arity of the ops (SGLPRIM_COMP_UNARY..QUARTERNARY)
+ *   bits  4-9:  number of lanes
+ *   bits 10-18: bits per lane
+ *   bits 19-30: number of ops
+ *
+ * Ops that only work on the lowest lane count as one lane.  Ops on a
+ * whole 128/256-bit register (logic, moves) count as one integer lane of
+ * that width.
+ *
+ * The vector ops of a superblock are summarized between its exits: all
+ * ops up to an exit (or the end of the block) are sent after the other
+ * events of that stretch, instead of at the position of the instruction
+ * they belong to.  Scalar compute events are unchanged.
+ ***************************************************************************/
+
+#define SIGRIND_COMP_VEC_IOP  0x100U
+#define SIGRIND_COMP_VEC_FLOP 0x101U
+
+#define SIGRIND_COMP_VEC_MAX_COUNT 0xfffU
+
+#define SIGRIND_COMP_VEC(arity, lanes, bits, count) \
+    ((arity) | ((lanes) << 4) | ((bits) << 10) | ((count) << 19))
+#define SIGRIND_COMP_VEC_ARITY(a) ((a) & 0xfU)
+#define SIGRIND_COMP_VEC_LANES(a) (((a) >> 4) & 0x3fU)
+#define SIGRIND_COMP_VEC_BITS(a)  (((a) >> 10) & 0x1ffU)
+#define SIGRIND_COMP_VEC_COUNT(a) (((a) >> 19) & 0xfffU)
+
+
+/***************************************************************************
+ * Control flow events (--gen-cf=yes, --gen-bb=yes)
+ *
+ * With --gen-bb=yes, every executed superblock starts with a CXT event of
+ * type SIGRIND_CXT_BB whose cxt.id is the block's guest address.
+ *
+ * With --gen-cf=yes, the branches of a superblock are sent after its
+ * other events, once the next block is entered.  The block's conditional
+ * branches (its side exits) are numbered in program order, and the
+ * outcomes of the ones executed are sent as a bit vector in a CXT event
+ * of type SIGRIND_CXT_BRANCHES:
+ *
+ *   cxt.idx: guest address of the block
+ *   cxt.len: bit i set if branch i was taken, plus a marker bit just
+ *            above the last outcome, i.e. the number of outcomes is
+ *            the index of the highest set bit
+ *
+ * If there are more outcomes than fit into cxt.len, they are sent in
+ * several consecutive events.  If the block ended in a jump to a
+ * computed address (not a return), a CXT event of type
+ * SIGRIND_CXT_IND_BRANCH follows, with the address of the jumping
+ * instruction in cxt.idx and the address jumped to in cxt.len.
+ *
+ * The first time a block's branches are sent, they are preceded by a
+ * CXT event of type SIGRIND_CXT_BRANCH_DEF, whose cxt.len bytes at
+ * cxt.idx in the name buffer hold a SigrindBranchDef followed by
+ * 'num_branches' unsigned int offsets of the branch instructions from
+ * 'base_addr'.  The payload is not aligned.  Branches of the last block
+ * before the program exits are not sent.
+ ***************************************************************************/
+
+#define SIGRIND_CXT_BB           0x107U
+#define SIGRIND_CXT_BRANCHES     0x108U
+#define SIGRIND_CXT_IND_BRANCH   0x109U
+#define SIGRIND_CXT_BRANCH_DEF   0x10aU
+
+typedef struct SigrindBranchDef
+{
+    unsigned long long base_addr;
+    unsigned int num_branches;
+    unsigned int ind_branch;    /* 1 if the block ends in an indirect jump */
+} SigrindBranchDef;
+
+
+/***************************************************************************
+ * Reducers (--reduce=footprint,reuse)
+ *
+ * Memory accesses are aggregated in Sigrind instead of being sent as
+ * MEM events.  Every --reduce-interval million accesses, and at exit,
+ * Sigrind sends a CXT event of type SIGRIND_CXT_REDUCE, whose cxt.len
+ * bytes at cxt.idx in the name buffer hold a SigrindReduceSummary for
+ * the accesses since the previous one.  Accesses are mapped to lines of
+ * 'line_size' bytes; an access that spans two lines touches both.
+ *
+ * footprint: read/write bytes, and the number of distinct lines read and
+ *            written in the interval.  'new_lines' counts lines never
+ *            touched before, so its sum over all summaries is the
+ *            footprint of the whole run.  Per-function read/write bytes
+ *            follow in 'num_fns' SigrindReduceFn records, spread over
+ *            SIGRIND_CXT_REDUCE_FNS events laid out like the summary.
+ *            Function ids are defined by SIGRIND_CXT_FUNC_NAME events
+ *            (see "Function name interning").
+ * reuse:     a histogram of reuse times: the number of accesses since
+ *            the previous access to the same line.  Bucket k counts
+ *            reuse times in [2^k, 2^(k+1)), the last bucket counts
+ *            first accesses to a line.
+ *
+ * Fields of a reducer that is not selected are 0.  The payloads are not
+ * aligned.
+ ***************************************************************************/
+
+#define SIGRIND_CXT_REDUCE       0x10bU
+#define SIGRIND_CXT_REDUCE_FNS   0x10cU
+
+#define SIGRIND_REDUCE_BUCKETS   32
+
+typedef struct SigrindReduceSummary
+{
+    unsigned long long accesses;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned long long lines_read;
+    unsigned long long lines_written;
+    unsigned long long new_lines;
+    unsigned long long reuse[SIGRIND_REDUCE_BUCKETS];
+    unsigned int line_size;
+    unsigned int num_fns;
+} SigrindReduceSummary;
+
+typedef struct SigrindReduceFn
+{
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned int fn;
+    unsigned int reserved;
+} SigrindReduceFn;
+
+
+/***************************************************************************
+ * Further sync events (--gen-sync=yes, --gen-atomics=yes)
+ *
+ * Besides the SGLPRIM_SYNC_* types, SYNC events may have these types.
+ * data[0] is the address of the object and data[1] is unused, unless
+ * noted otherwise.
+ *
+ *   RDLOCK, WRLOCK:   pthread rwlock acquired for reading/writing
+ *   RWUNLOCK:         pthread rwlock released
+ *   SEMWAIT:          POSIX semaphore decremented (sem_*wait succeeded)
+ *   SEMPOST:          POSIX semaphore about to be incremented
+ *   FUTEXWAIT:        a futex wait (or PI lock) returned after a wake
+ *   FUTEXWAKE:        a futex wake (requeue, PI unlock) is about to be
+ *                     issued
+ *   ATOMIC:           an atomic read-modify-write (lock-prefixed
+ *                     instruction, LL/SC pair) with data[1] = its size;
+ *                     only with --gen-atomics=yes
+ *
+ * The rwlock, semaphore and C11 thread functions are wrapped by
+ * vgpreload_sigrind (sg_intercepts.c); C11 threads are reported with the
+ * matching pthread types.  Futex events cover the primitives that use
+ * futexes directly (C++20 atomic waits, latches, TBB, ...); they are not
+ * sent for futex calls made inside a wrapped function.
+ ***************************************************************************/
+
+#define SIGRIND_SYNC_RDLOCK    0x80U
+#define SIGRIND_SYNC_WRLOCK    0x81U
+#define SIGRIND_SYNC_RWUNLOCK  0x82U
+#define SIGRIND_SYNC_SEMWAIT   0x83U
+#define SIGRIND_SYNC_SEMPOST   0x84U
+#define SIGRIND_SYNC_FUTEXWAIT 0x85U
+#define SIGRIND_SYNC_FUTEXWAKE 0x86U
+#define SIGRIND_SYNC_ATOMIC    0x87U
+
+
+/***************************************************************************
+ * Trace files (--trace-out=<dir>)
+ *
+ * Instead of handing buffers to a running Sigil2, Sigrind writes every
+ * filled event/name buffer pair to chunk files in <dir>, one stream of
+ * chunks per channel: "<SIGRIND_TRACE_BASENAME>-<channel>-<chunk>", both
+ * numbers counting from 0.  The buffers use the geometry header's layout
+ * (--ipc-buffer-events, --ipc-encoding and --ipc-channels apply), so a
+ * replay can hand them to Sigil2 unchanged.
+ *
+ * Each chunk starts with a SigrindTraceChunk header that indexes up to
+ * SIGRIND_TRACE_CHUNK_RECORDS buffers.  Buffer k is stored at file offset
+ * records[k].offset: first its event data ('events_bytes' bytes, i.e.
+ * 'events_used' slots, or bytes with the packed encoding), then its name
+ * data ('names_used' bytes).  Each part is compressed with LZO1X-1 if
+ * that makes it smaller, in which case its '*_zbytes' is less than its
+ * uncompressed size; otherwise it is stored as is.
+ *
+ * The header is written with 'magic' 0 when a chunk is opened and
+ * rewritten with the final index and 'magic' when it is complete, so a
+ * chunk of an aborted run is recognizable.  Chunks only depend on their
+ * own header, so they can be decompressed in parallel.
+ *
+ * sigrind-replay streams a trace directory back into Sigil2 through the
+ * ring transport, see sigil2_replay.c.
+ ***************************************************************************/
+
+#define SIGRIND_TRACE_BASENAME      "sigrind-trace"
+#define SIGRIND_TRACE_MAGIC         0x54474c53U /* "SLGT" */
+#define SIGRIND_TRACE_VERSION       1U
+#define SIGRIND_TRACE_CHUNK_RECORDS 64
+
+typedef struct SigrindTraceRecord
+{
+    unsigned long long offset;
+    unsigned int events_used;   /* EventBuffer 'used' */
+    unsigned int events_bytes;
+    unsigned int events_zbytes; /* stored size */
+    unsigned int names_used;    /* NameBuffer 'used' */
+    unsigned int names_zbytes;  /* stored size */
+    unsigned int reserved;
+} SigrindTraceRecord;
+
+typedef struct SigrindTraceChunk
+{
+    unsigned int magic;
+    unsigned int version;
+
+    unsigned int channel;
+    unsigned int tid;               /* thread of the channel, 0 if single */
+    unsigned int chunk;
+    unsigned int num_records;
+
+    unsigned int buffer_events;     /* geometry, as in SigrindShmemHeader */
+    unsigned int buffer_name_bytes;
+    unsigned int event_size;
+    unsigned int encoding;
+
+    SigrindTraceRecord records[SIGRIND_TRACE_CHUNK_RECORDS];
+} SigrindTraceChunk;
+
+#endif
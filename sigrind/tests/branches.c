@@ -0,0 +1,23 @@
+// Conditional branches and indirect calls for --gen-cf
+
+#include <stdio.h>
+
+static int twice(int x) { return 2 * x; }
+static int plus1(int x) { return x + 1; }
+
+static int (*const ops[2])(int) = { twice, plus1 };
+
+int main(void)
+{
+   int i, sum = 0;
+
+   for (i = 0; i < 1000; i++) {
+      if (i % 3 == 0)
+         sum += i;
+      else
+         sum -= 1;
+      sum = ops[i & 1](sum) & 0xffff;
+   }
+   printf("sum: %d\n", sum);
+   return 0;
+}
@@ -0,0 +1,251 @@
+/* Microbenchmark for the Sigrind -> Sigil2 buffer handover.
+ *
+ * A producer and a consumer process share an anonymous mapping with
+ * NBUFS event buffers and hand them over either with the FIFO handshake
+ * (one write/read pair per buffer, like --ipc-transport=fifo) or with the
+ * head/tail ring from sigil2_shmem.h (like --ipc-transport=ring).
+ * The consumer touches every event, so the numbers approximate the
+ * per-buffer transport overhead on top of a trivial backend.
+ *
+ * usage: ipc_bench [fifo|ring|both] [events-per-buffer] [total-events] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "sigil2_shmem.h"
+
+#define NBUFS 8
+
+typedef struct {
+   unsigned long tag;
+   unsigned long addr;
+   unsigned long size;
+} Event;
+
+typedef struct {
+   unsigned long used;
+   Event events[];
+} Buffer;
+
+static unsigned long buf_events;
+static unsigned long total_events;
+
+static Buffer* get_buf(char* base, unsigned idx)
+{
+   return (Buffer*)(base + idx * (sizeof(Buffer) + buf_events * sizeof(Event)));
+}
+
+static unsigned long fill(Buffer* b, unsigned long remaining, unsigned long seq)
+{
+   unsigned long n = remaining < buf_events ? remaining : buf_events;
+   unsigned long i;
+   for (i = 0; i < n; i++) {
+      b->events[i].tag  = 1;
+      b->events[i].addr = seq + i;
+      b->events[i].size = 8;
+   }
+   b->used = n;
+   return n;
+}
+
+static unsigned long drain(Buffer* b)
+{
+   unsigned long sum = 0, i;
+   for (i = 0; i < b->used; i++)
+      sum += b->events[i].addr;
+   return sum;
+}
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/******************************
+ * FIFO handshake
+ ******************************/
+static void fifo_producer(char* base, int fullfd, int emptyfd)
+{
+   int is_full[NBUFS] = {0};
+   unsigned long sent = 0;
+   unsigned idx = 0, done = 0xffffffffU;
+
+   while (sent < total_events) {
+      if (is_full[idx]) {
+         unsigned got;
+         if (read(emptyfd, &got, sizeof(got)) != sizeof(got)) exit(1);
+         is_full[got] = 0;
+      }
+      sent += fill(get_buf(base, idx), total_events - sent, sent);
+      is_full[idx] = 1;
+      if (write(fullfd, &idx, sizeof(idx)) != sizeof(idx)) exit(1);
+      idx = (idx + 1) % NBUFS;
+   }
+   if (write(fullfd, &done, sizeof(done)) != sizeof(done)) exit(1);
+}
+
+static unsigned long fifo_consumer(char* base, int fullfd, int emptyfd)
+{
+   unsigned long sum = 0;
+   unsigned idx;
+
+   while (read(fullfd, &idx, sizeof(idx)) == sizeof(idx) && idx != 0xffffffffU) {
+      sum += drain(get_buf(base, idx));
+      if (write(emptyfd, &idx, sizeof(idx)) != sizeof(idx)) exit(1);
+   }
+   return sum;
+}
+
+
+/******************************
+ * Ring
+ ******************************/
+static void futex_wait(volatile unsigned* addr, unsigned val)
+{
+   syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static void futex_wake(volatile unsigned* addr)
+{
+   syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static void ring_producer(char* base, SigrindRingControl* ring)
+{
+   unsigned long sent = 0;
+   unsigned head = 0;
+
+   while (sent < total_events) {
+      unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      while (head - tail >= NBUFS) {
+         __atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_SEQ_CST);
+         tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+         if (head - tail < NBUFS)
+            break;
+         futex_wait(&ring->tail, tail);
+         tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      }
+
+      sent += fill(get_buf(base, head % NBUFS), total_events - sent, sent);
+      __atomic_store_n(&ring->head, ++head, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&ring->consumer_waiting, __ATOMIC_SEQ_CST)) {
+         __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_SEQ_CST);
+         futex_wake(&ring->head);
+      }
+   }
+
+   __atomic_store_n(&ring->finished, 1, __ATOMIC_SEQ_CST);
+   futex_wake(&ring->head);
+}
+
+static unsigned long ring_consumer(char* base, SigrindRingControl* ring)
+{
+   unsigned long sum = 0;
+   unsigned tail = 0;
+
+   for (;;) {
+      unsigned head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      if (head == tail) {
+         if (__atomic_load_n(&ring->finished, __ATOMIC_ACQUIRE)
+             && __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+            break;
+         __atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+         head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+         if (head == tail && !__atomic_load_n(&ring->finished, __ATOMIC_SEQ_CST))
+            futex_wait(&ring->head, head);
+         continue;
+      }
+
+      sum += drain(get_buf(base, tail % NBUFS));
+      __atomic_store_n(&ring->tail, ++tail, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&ring->producer_waiting, __ATOMIC_SEQ_CST)) {
+         __atomic_store_n(&ring->producer_waiting, 0, __ATOMIC_SEQ_CST);
+         futex_wake(&ring->tail);
+      }
+   }
+
+   __atomic_store_n(&ring->disconnected, 1, __ATOMIC_SEQ_CST);
+   return sum;
+}
+
+
+static void run(const char* mode)
+{
+   size_t bufs_size = NBUFS * (sizeof(Buffer) + buf_events * sizeof(Event));
+   size_t size = bufs_size + sizeof(SigrindRingControl);
+   int is_ring = strcmp(mode, "ring") == 0;
+   int full[2], empty[2];
+   unsigned long expected = total_events * (total_events - 1) / 2;
+   unsigned long sum;
+   double start, secs;
+   pid_t pid;
+
+   char* base = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+   if (base == MAP_FAILED) { perror("mmap"); exit(1); }
+   SigrindRingControl* ring = (SigrindRingControl*)(base + bufs_size);
+
+   if (!is_ring && (pipe(full) != 0 || pipe(empty) != 0)) {
+      perror("pipe"); exit(1);
+   }
+
+   start = now();
+   pid = fork();
+   if (pid < 0) { perror("fork"); exit(1); }
+   if (pid == 0) {
+      if (is_ring)
+         ring_producer(base, ring);
+      else
+         fifo_producer(base, full[1], empty[0]);
+      _exit(0);
+   }
+
+   sum = is_ring ? ring_consumer(base, ring)
+                 : fifo_consumer(base, full[0], empty[1]);
+   waitpid(pid, NULL, 0);
+   secs = now() - start;
+
+   printf("%-5s %10lu events/buffer: %8.2f Mevents/s  (%s)\n",
+          mode, buf_events, total_events / secs / 1e6,
+          sum == expected ? "ok" : "MISMATCH");
+
+   if (!is_ring) {
+      close(full[0]); close(full[1]);
+      close(empty[0]); close(empty[1]);
+   }
+   munmap(base, size);
+}
+
+int main(int argc, char** argv)
+{
+   const char* mode = argc > 1 ? argv[1] : "both";
+   buf_events   = argc > 2 ? strtoul(argv[2], NULL, 0) : 4096;
+   total_events = argc > 3 ? strtoul(argv[3], NULL, 0) : 50000000;
+
+   if (buf_events == 0) {
+      fprintf(stderr, "events-per-buffer must be > 0\n");
+      return 1;
+   }
+
+   if (strcmp(mode, "both") == 0) {
+      run("fifo");
+      run("ring");
+   } else if (strcmp(mode, "fifo") == 0 || strcmp(mode, "ring") == 0) {
+      run(mode);
+   } else {
+      fprintf(stderr, "usage: %s [fifo|ring|both] [events-per-buffer] [total-events]\n",
+              argv[0]);
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,242 @@
+/* Checks the CXT records of a Sigrind trace (--trace-out).
+ *
+ * usage: trace_check <trace-dir> <type>...
+ *
+ * Decodes every buffer of channel 0, with either encoding, and checks
+ * that each record of the given types carries its payload, e.g. that a
+ * BRANCHES record names a block defined by a BRANCH_DEF.  Prints one
+ * line per type: "ok" if records were seen and all were sane, "none" if
+ * there were no records, otherwise how many were bad. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sigil2_decode.h"
+#include "../../coregrind/m_debuginfo/minilzo.h"
+
+typedef struct
+{
+    const char* name;
+    unsigned    type;
+    unsigned    seen;
+    unsigned    bad;
+} Check;
+
+static Check checks[] = {
+    { "BRANCHES",   SIGRIND_CXT_BRANCHES },
+    { "IND_BRANCH", SIGRIND_CXT_IND_BRANCH },
+    { "BRANCH_DEF", SIGRIND_CXT_BRANCH_DEF },
+    { "REDUCE",     SIGRIND_CXT_REDUCE },
+    { "REDUCE_FNS", SIGRIND_CXT_REDUCE_FNS },
+};
+
+#define NUM_CHECKS (sizeof(checks) / sizeof(checks[0]))
+
+
+static void die(const char* fmt, const char* arg)
+{
+    fprintf(stderr, "trace_check: ");
+    fprintf(stderr, fmt, arg);
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+
+/* base addresses of the blocks defined so far */
+#define DEFS_SIZE (1U << 16)
+static unsigned long long defs[DEFS_SIZE];
+
+static int def_slot(unsigned long long addr)
+{
+    unsigned i = (unsigned)(addr ^ (addr >> 16)) & (DEFS_SIZE - 1);
+    unsigned n;
+    for (n = 0; n < DEFS_SIZE; n++, i = (i + 1) & (DEFS_SIZE - 1))
+        if (defs[i] == addr || defs[i] == 0)
+            return i;
+    die("%s", "too many blocks");
+    return -1;
+}
+
+
+static int in_names(const SglEvVariant* ev, size_t names_used)
+{
+    return ev->cxt.idx <= names_used && ev->cxt.len <= names_used - ev->cxt.idx;
+}
+
+
+/* Is the payload of 'ev', if any, where it should be? */
+static int sane(const SglEvVariant* ev, const char* names, size_t names_used)
+{
+    SigrindBranchDef def;
+    SigrindReduceSummary summary;
+
+    switch ((unsigned)ev->cxt.type)
+    {
+    case SIGRIND_CXT_BRANCHES:
+        return ev->cxt.len != 0 && ev->cxt.idx != 0 &&
+               defs[def_slot(ev->cxt.idx)] == ev->cxt.idx;
+    case SIGRIND_CXT_IND_BRANCH:
+        return ev->cxt.idx != 0;
+    case SIGRIND_CXT_BRANCH_DEF:
+        if (ev->cxt.len < sizeof(def) || !in_names(ev, names_used))
+            return 0;
+        memcpy(&def, names + ev->cxt.idx, sizeof(def));
+        if (def.base_addr == 0 ||
+            ev->cxt.len != sizeof(def) + def.num_branches * sizeof(unsigned))
+            return 0;
+        defs[def_slot(def.base_addr)] = def.base_addr;
+        return 1;
+    case SIGRIND_CXT_REDUCE:
+        if (ev->cxt.len != sizeof(summary) || !in_names(ev, names_used))
+            return 0;
+        memcpy(&summary, names + ev->cxt.idx, sizeof(summary));
+        return summary.line_size != 0 &&
+               (summary.line_size & (summary.line_size - 1)) == 0;
+    case SIGRIND_CXT_REDUCE_FNS:
+        return ev->cxt.len != 0 && ev->cxt.len % sizeof(SigrindReduceFn) == 0
+               && in_names(ev, names_used);
+    default:
+        return 1;
+    }
+}
+
+
+static void check_event(const SglEvVariant* ev, const char* names,
+                        size_t names_used)
+{
+    unsigned i;
+
+    if (ev->tag != SGL_CXT_TAG)
+        return;
+    for (i = 0; i < NUM_CHECKS; i++)
+        if (checks[i].type == (unsigned)ev->cxt.type)
+        {
+            checks[i].seen++;
+            if (!sane(ev, names, names_used))
+                checks[i].bad++;
+        }
+}
+
+
+static void read_part(FILE* f, char* dst, unsigned long long offset,
+                      unsigned zbytes, unsigned bytes)
+{
+    static char zbuf[1 << 24];
+    char* buf = zbytes < bytes ? zbuf : dst;
+
+    if (zbytes > sizeof(zbuf) ||
+        fseek(f, (long)offset, SEEK_SET) != 0 ||
+        fread(buf, 1, zbytes, f) != zbytes)
+        die("%s", "truncated trace data");
+    if (zbytes < bytes)
+    {
+        lzo_uint len = bytes;
+        if (lzo1x_decompress_safe((unsigned char*)buf, zbytes,
+                                  (unsigned char*)dst, &len, NULL)
+            != LZO_E_OK || len != bytes)
+            die("%s", "corrupt trace data");
+    }
+}
+
+
+static void check_record(FILE* f, const SigrindTraceChunk* hdr,
+                         const SigrindTraceRecord* rec)
+{
+    char* events = malloc(rec->events_bytes + 1);
+    char* names  = malloc(rec->names_used + 1);
+    SglEvVariant ev;
+
+    if (events == NULL || names == NULL)
+        die("%s", "out of memory");
+    read_part(f, events, rec->offset, rec->events_zbytes, rec->events_bytes);
+    read_part(f, names, rec->offset + rec->events_zbytes,
+              rec->names_zbytes, rec->names_used);
+
+    if (hdr->encoding == SIGRIND_ENCODING_PACKED)
+    {
+        SigrindPackedDecoder dec;
+        int res;
+
+        sigrind_packed_init(&dec, events, rec->events_bytes);
+        for (;;)
+        {
+            memset(&ev, 0, sizeof(ev));
+            res = sigrind_packed_next(&dec, &ev);
+            if (res < 0)
+                die("%s", "malformed packed buffer");
+            if (res == 0)
+                break;
+            check_event(&ev, names, rec->names_used);
+        }
+    }
+    else
+    {
+        unsigned i;
+        for (i = 0; i < rec->events_used; i++)
+        {
+            memcpy(&ev, events + i * sizeof(ev), sizeof(ev));
+            check_event(&ev, names, rec->names_used);
+        }
+    }
+
+    free(events);
+    free(names);
+}
+
+
+int main(int argc, char** argv)
+{
+    char path[4096];
+    unsigned chunk, i, j;
+
+    if (argc < 3)
+        die("%s", "usage: trace_check <trace-dir> <type>...");
+    if (lzo_init() != LZO_E_OK)
+        die("%s", "lzo_init failed");
+
+    for (chunk = 0; ; chunk++)
+    {
+        SigrindTraceChunk hdr;
+        FILE* f;
+
+        snprintf(path, sizeof(path), "%s/%s-0-%u",
+                 argv[1], SIGRIND_TRACE_BASENAME, chunk);
+        f = fopen(path, "rb");
+        if (f == NULL)
+            break;
+        if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+            hdr.magic != SIGRIND_TRACE_MAGIC ||
+            hdr.version != SIGRIND_TRACE_VERSION ||
+            hdr.num_records > SIGRIND_TRACE_CHUNK_RECORDS ||
+            hdr.event_size != sizeof(SglEvVariant))
+            die("%s: bad chunk header", path);
+
+        for (j = 0; j < hdr.num_records; j++)
+            check_record(f, &hdr, &hdr.records[j]);
+        fclose(f);
+    }
+    if (chunk == 0)
+        die("%s: no trace", argv[1]);
+
+    for (i = 2; i < (unsigned)argc; i++)
+    {
+        for (j = 0; j < NUM_CHECKS; j++)
+            if (strcmp(argv[i], checks[j].name) == 0)
+                break;
+        if (j == NUM_CHECKS)
+            die("unknown type %s", argv[i]);
+
+        if (checks[j].seen == 0)
+            printf("%s: none\n", checks[j].name);
+        else if (checks[j].bad == 0)
+            printf("%s: ok\n", checks[j].name);
+        else
+            printf("%s: %u bad of %u\n", checks[j].name,
+                   checks[j].bad, checks[j].seen);
+    }
+    return 0;
+}
+
+
+#include "../../coregrind/m_debuginfo/minilzo-inl.c"
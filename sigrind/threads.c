@@ -27,6 +27,7 @@
 */
 
 #include "log_events.h"
+#include "sigil2_ipc.h"
 #include "global.h"
 #include "Core/PrimitiveEnums.h"
 
@@ -38,7 +39,8 @@ static exec_state* exec_state_restore(void);
 static exec_state* push_exec_state(int);
 static exec_state* top_exec_state(void);
 
-static exec_stack current_states;
+/* exec stack of the current thread, points into its thread_info */
+static exec_stack* current_states = 0;
 
 
 /*------------------------------------------------------------*/
@@ -56,6 +58,10 @@ static exec_stack current_states;
  *  - call hash
  *  - event counters: last, current
  *
+ * These stay in the thread_info of their thread; the current_* variables
+ * of the other modules point into it, so that a thread switch only
+ * saves the execution state and sets pointers.
+ *
  * Even when ignoring MT, we need this functions to set up some
  * datastructures for the process (= Thread 1).
  */
@@ -136,6 +142,12 @@ void SGL_(switch_thread)(ThreadId tid)
 
   SGL_(active_tid) = tid;
 
+  /* the channel switch sends the SWAP event, with a sequence stamp */
+  if (SGL_(clo).ipc_channels == ipc_per_thread) {
+    SGL_(switch_channel)(tid);
+    return;
+  }
+
   /* ML: always send thread switch events; 
    * valgrind can change at any time, even if sigrind is 'inside' 
    * a synchronization call or outside the function being collected */ 
@@ -149,24 +161,11 @@ void CLG_(switch_thread)(ThreadId tid)
 
   CLG_DEBUG(0, ">> thread %u (was %u)\n", tid, CLG_(current_tid));
 
-  if (CLG_(current_tid) != VG_INVALID_THREADID) {    
-    /* save thread state */
-    thread_info* t = thread[CLG_(current_tid)];
+  CLG_(stat).thread_switches++;
 
-    CLG_ASSERT(t != 0);
-
-    /* current context (including signal handler contexts) */
+  /* everything else is kept in place in the thread_info */
+  if (CLG_(current_tid) != VG_INVALID_THREADID)
     exec_state_save();
-    CLG_(copy_current_exec_stack)( &(t->states) );
-    CLG_(copy_current_call_stack)( &(t->calls) );
-    CLG_(copy_current_fn_stack)  ( &(t->fns) );
-
-    CLG_(copy_current_fn_array) ( &(t->fn_active) );
-    /* If we cumulate costs of threads, use TID 1 for all jccs/bccs */
-    if (!CLG_(clo).separate_threads) t = thread[1];
-    CLG_(copy_current_bbcc_hash)( &(t->bbccs) );
-    CLG_(copy_current_jcc_hash) ( &(t->jccs) );
-  }
 
   CLG_(current_tid) = tid;
   CLG_ASSERT(tid < VG_N_THREADS);
@@ -215,7 +214,7 @@ void CLG_(pre_signal)(ThreadId tid, Int sigNum, Bool alt_stack)
 
     /* setup new cxtinfo struct for this signal handler */
     es = push_exec_state(sigNum);
-    es->call_stack_bottom = CLG_(current_call_stack).sp;
+    es->call_stack_bottom = CLG_(current_call_stack)->sp;
 
     /* setup current state for a spontaneous call */
     CLG_(init_exec_state)( &CLG_(current_state) );
@@ -234,7 +233,7 @@ void CLG_(run_post_signal_on_call_stack_bottom)()
     CLG_ASSERT(es != 0);
     CLG_ASSERT(CLG_(current_state).sig >0);
 
-    if (CLG_(current_call_stack).sp == es->call_stack_bottom)
+    if (CLG_(current_call_stack)->sp == es->call_stack_bottom)
 	CLG_(post_signal)( CLG_(current_tid), CLG_(current_state).sig );
 }
 
@@ -255,7 +254,7 @@ void CLG_(post_signal)(ThreadId tid, Int sigNum)
      */
     es = top_exec_state();
     CLG_ASSERT(es != 0);
-    while(CLG_(current_call_stack).sp > es->call_stack_bottom)
+    while(CLG_(current_call_stack)->sp > es->call_stack_bottom)
       CLG_(pop_call_stack)();
 
     if (CLG_(current_state).cxt) {
@@ -267,22 +266,22 @@ void CLG_(post_signal)(ThreadId tid, Int sigNum)
 	       CLG_(current_state).cxt->fn[0]->name, *pactive);
     }
 
-    if (CLG_(current_fn_stack).top > CLG_(current_fn_stack).bottom) {
+    if (CLG_(current_fn_stack)->top > CLG_(current_fn_stack)->bottom) {
 	/* set fn_stack_top back.
 	 * top can point to 0 if nothing was executed in the signal handler;
 	 * this is possible at end on unwinding handlers.
 	 */
-	if (*(CLG_(current_fn_stack).top) != 0) {
-	    CLG_(current_fn_stack).top--;
-	    CLG_ASSERT(*(CLG_(current_fn_stack).top) == 0);
+	if (*(CLG_(current_fn_stack)->top) != 0) {
+	    CLG_(current_fn_stack)->top--;
+	    CLG_ASSERT(*(CLG_(current_fn_stack)->top) == 0);
 	}
-      if (CLG_(current_fn_stack).top > CLG_(current_fn_stack).bottom)
-	CLG_(current_fn_stack).top--;
+      if (CLG_(current_fn_stack)->top > CLG_(current_fn_stack)->bottom)
+	CLG_(current_fn_stack)->top--;
     }
 
     /* restore previous context */
     es->sig = -1;
-    current_states.sp--;
+    current_states->sp--;
     es = top_exec_state();
     CLG_(current_state).sig = es->sig;
     exec_state_restore();
@@ -345,22 +344,11 @@ void CLG_(init_exec_stack)(exec_stack* es)
   es->sp = 0;
 }
 
-void CLG_(copy_current_exec_stack)(exec_stack* dst)
-{
-  Int i;
-
-  dst->sp = current_states.sp;
-  for(i=0;i<MAX_SIGHANDLERS;i++)
-    dst->entry[i] = current_states.entry[i];
-}
-
 void CLG_(set_current_exec_stack)(exec_stack* dst)
 {
-  Int i;
+  CLG_ASSERT(dst != 0);
 
-  current_states.sp = dst->sp;
-  for(i=0;i<MAX_SIGHANDLERS;i++)
-    current_states.entry[i] = dst->entry[i];
+  current_states = dst;
 }
 
 
@@ -368,11 +356,11 @@ void CLG_(set_current_exec_stack)(exec_stack* dst)
 static
 exec_state* top_exec_state(void)
 {
-  Int sp = current_states.sp;
+  Int sp = current_states->sp;
   exec_state* es;
 
   CLG_ASSERT((sp >= 0) && (sp < MAX_SIGHANDLERS));
-  es = current_states.entry[sp];
+  es = current_states->entry[sp];
   CLG_ASSERT(es != 0);
   return es;
 }
@@ -386,15 +374,15 @@ static exec_state* push_exec_state(int sigNum)
   Int sp;
   exec_state* es;
 
-  current_states.sp++;
-  sp = current_states.sp;
+  current_states->sp++;
+  sp = current_states->sp;
 
   CLG_ASSERT((sigNum > 0) && (sigNum <= _VKI_NSIG));
   CLG_ASSERT((sp > 0) && (sp < MAX_SIGHANDLERS));
-  es = current_states.entry[sp];
+  es = current_states->entry[sp];
   if (!es) {
     es = new_exec_state(sigNum);
-    current_states.entry[sp] = es;
+    current_states->entry[sp] = es;
   }
   else
     es->sig = sigNum;